@@ -0,0 +1,215 @@
+#include "acpi.h"
+#include "paging.h"
+#include "kprint.h"
+
+#include <stddef.h>
+
+#define EBDA_SEGMENT_PTR 0x40E
+#define BIOS_AREA_START  0xE0000
+#define BIOS_AREA_END    0x100000
+
+/* MADT entry types */
+#define MADT_LAPIC          0
+#define MADT_IOAPIC         1
+#define MADT_OVERRIDE       2
+#define MADT_LAPIC_ADDR     5
+
+#define MADT_LAPIC_ENABLED  0x1
+#define MADT_PCAT_COMPAT    0x1
+
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+    /* Revision 2+ */
+    uint32_t length;
+    uint64_t xsdt_addr;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_t;
+
+typedef struct {
+    acpi_sdt_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_header_t;
+
+/* HPET description table */
+typedef struct {
+    acpi_sdt_t header;
+    uint32_t block_id;
+    uint8_t space_id;           /* Generic address: 0 = memory */
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+    uint8_t number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed)) acpi_hpet_table_t;
+
+#define ACPI_SPACE_MEMORY   0
+
+static acpi_madt_t madt;
+static int madt_found = 0;
+static uint64_t hpet_address = 0;
+
+static int checksum_ok(const void* data, uint64_t len) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+    for (uint64_t i = 0; i < len; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+static int signature_is(const char* sig, const char* expect, int len) {
+    for (int i = 0; i < len; i++) {
+        if (sig[i] != expect[i]) return 0;
+    }
+    return 1;
+}
+
+/* Scan a BIOS range for the RSDP (16-byte aligned, identity mapped) */
+static acpi_rsdp_t* scan_rsdp(uint64_t start, uint64_t end) {
+    for (uint64_t addr = start; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*)addr;
+        if (signature_is(rsdp->signature, "RSD PTR ", 8) && checksum_ok(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+/* Map a whole table (the header first, to learn its length) */
+static acpi_sdt_t* map_table(uint64_t phys) {
+    acpi_sdt_t* header = (acpi_sdt_t*)paging_map_io(phys, sizeof(acpi_sdt_t), 0);
+    if (!header) {
+        return NULL;
+    }
+    acpi_sdt_t* table = (acpi_sdt_t*)paging_map_io(phys, header->length, 0);
+    if (!table || !checksum_ok(table, table->length)) {
+        return NULL;
+    }
+    return table;
+}
+
+/* Find a table by signature through the RSDT or XSDT */
+static acpi_sdt_t* find_table(acpi_rsdp_t* rsdp, const char* signature) {
+    int wide = rsdp->revision >= 2 && rsdp->xsdt_addr;
+    acpi_sdt_t* root = map_table(wide ? rsdp->xsdt_addr : rsdp->rsdt_addr);
+    if (!root) {
+        return NULL;
+    }
+
+    uint32_t entry_size = wide ? 8 : 4;
+    uint32_t count = (root->length - sizeof(acpi_sdt_t)) / entry_size;
+    uint8_t* entries = (uint8_t*)root + sizeof(acpi_sdt_t);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t phys = wide ? *(uint64_t*)(entries + i * 8) : *(uint32_t*)(entries + i * 4);
+        acpi_sdt_t* header = (acpi_sdt_t*)paging_map_io(phys, sizeof(acpi_sdt_t), 0);
+        if (header && signature_is(header->signature, signature, 4)) {
+            return map_table(phys);
+        }
+    }
+    return NULL;
+}
+
+static void parse_madt(acpi_madt_header_t* header) {
+    madt.lapic_addr = header->lapic_addr;
+    madt.has_8259 = (header->flags & MADT_PCAT_COMPAT) != 0;
+    madt.cpu_count = 0;
+    madt.ioapic_count = 0;
+
+    /* Identity routing unless overridden */
+    for (uint32_t irq = 0; irq < ACPI_LEGACY_IRQS; irq++) {
+        madt.irq_gsi[irq] = irq;
+        madt.irq_flags[irq] = 0;
+    }
+
+    uint8_t* entry = (uint8_t*)header + sizeof(acpi_madt_header_t);
+    uint8_t* end = (uint8_t*)header + header->header.length;
+
+    while (entry + 2 <= end && entry[1] >= 2) {
+        switch (entry[0]) {
+            case MADT_LAPIC:
+                if ((*(uint32_t*)(entry + 4) & MADT_LAPIC_ENABLED) && madt.cpu_count < ACPI_MAX_CPUS) {
+                    madt.cpu_apic_ids[madt.cpu_count++] = entry[3];
+                }
+                break;
+            case MADT_IOAPIC:
+                if (madt.ioapic_count < ACPI_MAX_IOAPICS) {
+                    acpi_ioapic_t* io = &madt.ioapics[madt.ioapic_count++];
+                    io->id = entry[2];
+                    io->addr = *(uint32_t*)(entry + 4);
+                    io->gsi_base = *(uint32_t*)(entry + 8);
+                }
+                break;
+            case MADT_OVERRIDE: {
+                uint8_t source = entry[3];
+                if (entry[2] == 0 && source < ACPI_LEGACY_IRQS) {  /* ISA bus */
+                    madt.irq_gsi[source] = *(uint32_t*)(entry + 4);
+                    madt.irq_flags[source] = *(uint16_t*)(entry + 8);
+                }
+                break;
+            }
+            case MADT_LAPIC_ADDR:
+                madt.lapic_addr = *(uint64_t*)(entry + 4);
+                break;
+        }
+        entry += entry[1];
+    }
+}
+
+int acpi_init(void) {
+    /* The EBDA's first 1KB, then the BIOS read-only area */
+    uint64_t ebda = (uint64_t)(*(uint16_t*)EBDA_SEGMENT_PTR) << 4;
+    acpi_rsdp_t* rsdp = ebda ? scan_rsdp(ebda, ebda + 1024) : NULL;
+    if (!rsdp) {
+        rsdp = scan_rsdp(BIOS_AREA_START, BIOS_AREA_END);
+    }
+    if (!rsdp) {
+        kprint_info("ACPI: No RSDP found");
+        return 0;
+    }
+
+    /* The HPET is optional and independent of interrupt routing */
+    acpi_hpet_table_t* hpet = (acpi_hpet_table_t*)find_table(rsdp, "HPET");
+    if (hpet && hpet->space_id == ACPI_SPACE_MEMORY) {
+        hpet_address = hpet->address;
+    }
+
+    acpi_sdt_t* table = find_table(rsdp, "APIC");
+    if (!table) {
+        kprint_info("ACPI: No MADT found");
+        return 0;
+    }
+
+    parse_madt((acpi_madt_header_t*)table);
+    madt_found = 1;
+    kprint_ok("ACPI MADT parsed");
+    return 1;
+}
+
+const acpi_madt_t* acpi_get_madt(void) {
+    return madt_found ? &madt : NULL;
+}
+
+uint64_t acpi_hpet_address(void) {
+    return hpet_address;
+}
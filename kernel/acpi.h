@@ -0,0 +1,49 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+/* ACPI Table Discovery
+ * Only what interrupt routing and timekeeping need: the RSDP is found
+ * in the BIOS area, then the MADT ("APIC" table) is read for the Local
+ * APIC address, the CPUs, the IOAPICs and the legacy IRQ overrides, and
+ * the HPET table for the event timer block's address.
+ */
+
+#define ACPI_MAX_CPUS    16
+#define ACPI_MAX_IOAPICS 4
+#define ACPI_LEGACY_IRQS 16
+
+/* MPS INTI flags of an interrupt source override */
+#define ACPI_POLARITY_MASK  0x3
+#define ACPI_POLARITY_LOW   0x3
+#define ACPI_TRIGGER_MASK   0xC
+#define ACPI_TRIGGER_LEVEL  0xC
+
+typedef struct {
+    uint8_t id;
+    uint32_t addr;              /* Physical register base */
+    uint32_t gsi_base;          /* First global system interrupt */
+} acpi_ioapic_t;
+
+typedef struct {
+    uint64_t lapic_addr;        /* Physical Local APIC base */
+    int has_8259;               /* Legacy PICs are present too */
+    uint32_t cpu_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS];
+    uint32_t ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    uint32_t irq_gsi[ACPI_LEGACY_IRQS];     /* Legacy IRQ -> GSI */
+    uint16_t irq_flags[ACPI_LEGACY_IRQS];   /* Polarity/trigger (0 = ISA default) */
+} acpi_madt_t;
+
+/* Find and parse the MADT (returns 1 if found) */
+int acpi_init(void);
+
+/* Parsed MADT (NULL if acpi_init() found none) */
+const acpi_madt_t* acpi_get_madt(void);
+
+/* Physical base of the HPET registers (0 if there is no HPET table) */
+uint64_t acpi_hpet_address(void);
+
+#endif
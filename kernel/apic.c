@@ -0,0 +1,245 @@
+#include "apic.h"
+#include "idt.h"
+#include "paging.h"
+#include "pmm.h"
+#include "kprint.h"
+
+#include <stddef.h>
+
+/* IA32_APIC_BASE MSR */
+#define MSR_APIC_BASE       0x1B
+#define APIC_BASE_ENABLE    (1ULL << 11)
+#define APIC_BASE_X2APIC    (1ULL << 10)
+#define APIC_BASE_ADDR_MASK 0xFFFFFF000ULL
+
+/* x2APIC registers are MSRs 0x800 + (MMIO offset >> 4) */
+#define MSR_X2APIC_BASE     0x800
+
+/* Local APIC registers (MMIO offsets) */
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ESR           0x280
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+
+#define LAPIC_SVR_ENABLE    0x100
+#define LVT_MASKED          0x10000
+#define LVT_DELIVERY_NMI    0x400
+
+/* IOAPIC registers */
+#define IOAPIC_REGSEL       0x00
+#define IOAPIC_WINDOW       0x10
+#define IOAPIC_REG_VERSION  0x01
+#define IOAPIC_REG_REDIR    0x10
+
+#define REDIR_ACTIVE_LOW    (1ULL << 13)
+#define REDIR_LEVEL         (1ULL << 15)
+#define REDIR_MASKED        (1ULL << 16)
+
+/* CPUID.1 feature bits */
+#define CPUID_EDX_APIC      (1U << 9)
+#define CPUID_ECX_X2APIC    (1U << 21)
+
+typedef struct {
+    volatile uint32_t* regs;
+    uint32_t gsi_base;
+    uint32_t entries;
+} ioapic_t;
+
+static volatile uint32_t* lapic = NULL;
+static int x2apic = 0;
+static ioapic_t ioapics[ACPI_MAX_IOAPICS];
+static uint32_t ioapic_count = 0;
+static const acpi_madt_t* routing = NULL;
+static uint32_t bsp_apic_id = 0;
+
+/* Ignore spurious interrupts (irq.asm, no EOI) */
+extern void apic_spurious_handler(void);
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* ecx, uint32_t* edx) {
+    uint32_t eax, ebx;
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static uint32_t lapic_read(uint32_t reg) {
+    if (x2apic) {
+        return (uint32_t)rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+    }
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    if (x2apic) {
+        wrmsr(MSR_X2APIC_BASE + (reg >> 4), value);
+    } else {
+        lapic[reg / 4] = value;
+    }
+}
+
+static uint32_t ioapic_read(ioapic_t* io, uint32_t reg) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    return io->regs[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(ioapic_t* io, uint32_t reg, uint32_t value) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    io->regs[IOAPIC_WINDOW / 4] = value;
+}
+
+/* IOAPIC and pin serving a global system interrupt */
+static ioapic_t* ioapic_for(uint32_t gsi, uint32_t* pin) {
+    for (uint32_t i = 0; i < ioapic_count; i++) {
+        ioapic_t* io = &ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->entries) {
+            *pin = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return NULL;
+}
+
+/* Program the redirection entry of a legacy IRQ */
+static void route_irq(uint8_t irq, int masked) {
+    uint32_t pin;
+    ioapic_t* io = ioapic_for(routing->irq_gsi[irq], &pin);
+    if (!io) {
+        return;
+    }
+
+    uint64_t entry = APIC_IRQ_VECTOR_BASE + irq;  /* Fixed delivery, physical destination */
+    uint16_t flags = routing->irq_flags[irq];
+    if ((flags & ACPI_POLARITY_MASK) == ACPI_POLARITY_LOW) {
+        entry |= REDIR_ACTIVE_LOW;
+    }
+    if ((flags & ACPI_TRIGGER_MASK) == ACPI_TRIGGER_LEVEL) {
+        entry |= REDIR_LEVEL;
+    }
+    if (masked) {
+        entry |= REDIR_MASKED;
+    }
+    entry |= (uint64_t)(bsp_apic_id & 0xFF) << 56;
+
+    /* High half first so the entry is never live with a stale destination */
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2 + 1, (uint32_t)(entry >> 32));
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, (uint32_t)entry);
+}
+
+int apic_init(const acpi_madt_t* madt) {
+    if (!madt || madt->ioapic_count == 0) {
+        return 0;
+    }
+
+    uint32_t ecx, edx;
+    cpuid(1, &ecx, &edx);
+    if (!(edx & CPUID_EDX_APIC)) {
+        return 0;
+    }
+    x2apic = (ecx & CPUID_ECX_X2APIC) != 0;
+
+    /* Enable the Local APIC (and x2APIC mode when available) */
+    uint64_t base = rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE;
+    if (x2apic) {
+        base |= APIC_BASE_X2APIC;
+    }
+    wrmsr(MSR_APIC_BASE, base);
+
+    if (!x2apic) {
+        uint64_t phys = madt->lapic_addr ? madt->lapic_addr : (base & APIC_BASE_ADDR_MASK);
+        lapic = (volatile uint32_t*)paging_map_io(phys, PAGE_SIZE, PAGE_CACHE_DISABLE);
+        if (!lapic) {
+            return 0;
+        }
+    }
+
+    /* Map the IOAPICs and mask every input */
+    ioapic_count = 0;
+    for (uint32_t i = 0; i < madt->ioapic_count; i++) {
+        ioapic_t* io = &ioapics[ioapic_count];
+        io->regs = (volatile uint32_t*)paging_map_io(madt->ioapics[i].addr, PAGE_SIZE,
+                                                     PAGE_CACHE_DISABLE);
+        if (!io->regs) {
+            continue;
+        }
+        io->gsi_base = madt->ioapics[i].gsi_base;
+        io->entries = ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+        for (uint32_t pin = 0; pin < io->entries; pin++) {
+            ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, REDIR_MASKED);
+        }
+        ioapic_count++;
+    }
+    if (ioapic_count == 0) {
+        return 0;
+    }
+
+    /* Spurious vector must be installed before the APIC is software enabled */
+    idt_set_handler(APIC_SPURIOUS_VECTOR, apic_spurious_handler);
+
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LVT_DELIVERY_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    /* xAPIC IDs live in bits 24-31, x2APIC IDs are the whole register */
+    bsp_apic_id = x2apic ? lapic_read(LAPIC_ID) : lapic_read(LAPIC_ID) >> 24;
+
+    /* Legacy IRQs start masked, like on the PIC */
+    routing = madt;
+    for (uint8_t irq = 0; irq < ACPI_LEGACY_IRQS; irq++) {
+        route_irq(irq, 1);
+    }
+
+    kprint_ok(x2apic ? "x2APIC and IOAPIC enabled" : "Local APIC and IOAPIC enabled");
+    return 1;
+}
+
+void apic_eoi(void) {
+    if (x2apic) {
+        wrmsr(MSR_X2APIC_BASE + (LAPIC_EOI >> 4), 0);
+    } else {
+        lapic[LAPIC_EOI / 4] = 0;
+    }
+}
+
+void apic_irq_mask(uint8_t irq) {
+    if (routing && irq < ACPI_LEGACY_IRQS) {
+        route_irq(irq, 1);
+    }
+}
+
+void apic_irq_unmask(uint8_t irq) {
+    if (routing && irq < ACPI_LEGACY_IRQS) {
+        route_irq(irq, 0);
+    }
+}
+
+uint8_t apic_set_priority(uint8_t threshold) {
+    uint8_t old = (uint8_t)(lapic_read(LAPIC_TPR) >> 4);
+    lapic_write(LAPIC_TPR, (uint32_t)(threshold & 0xF) << 4);
+    return old;
+}
+
+uint32_t apic_id(void) {
+    return bsp_apic_id;
+}
+
+int apic_is_x2apic(void) {
+    return x2apic;
+}
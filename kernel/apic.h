@@ -0,0 +1,39 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include "acpi.h"
+
+/* Local APIC and IOAPIC
+ * The Local APIC is driven through its MMIO page, or through MSRs when
+ * the CPU supports x2APIC. Legacy IRQs are routed through the IOAPIC
+ * redirection table to the same vectors the PIC used (32-47), honouring
+ * the MADT's interrupt source overrides (e.g. the PIT on GSI 2).
+ *
+ * Priority: the Task Priority Register holds off every vector whose
+ * class (vector >> 4) is at or below the threshold.
+ */
+
+#define APIC_IRQ_VECTOR_BASE  32
+#define APIC_SPURIOUS_VECTOR  0xFF
+
+/* Enable the Local APIC and program the IOAPICs (returns 1 on success) */
+int apic_init(const acpi_madt_t* madt);
+
+/* Signal end of interrupt to the Local APIC */
+void apic_eoi(void);
+
+/* Mask or unmask a legacy IRQ at the IOAPIC */
+void apic_irq_mask(uint8_t irq);
+void apic_irq_unmask(uint8_t irq);
+
+/* Set the task priority threshold (0-15), returns the previous one */
+uint8_t apic_set_priority(uint8_t threshold);
+
+/* Local APIC ID of this CPU */
+uint32_t apic_id(void);
+
+/* Running in x2APIC (MSR) mode */
+int apic_is_x2apic(void);
+
+#endif
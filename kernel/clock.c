@@ -0,0 +1,435 @@
+#include "clock.h"
+#include "acpi.h"
+#include "paging.h"
+#include "timer.h"
+#include "irqtrace.h"
+#include "klog.h"
+#include "initcall.h"
+
+#include <stddef.h>
+
+#define PIT_CHANNEL0    0x40
+#define PIT_CHANNEL2    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE        0x61        /* Channel 2 gate (bit 0) and output (bit 5) */
+#define PIT_BASE_FREQ   1193182
+
+#define PIT_LATCH_CH0   0x00
+#define PIT_ONESHOT_CH2 0xB0        /* Channel 2, lo/hi byte, mode 0 */
+#define PIT_GATE_HIGH   0x01
+#define PIT_SPEAKER     0x02
+#define PIT_OUT2        0x20
+
+/* HPET registers (byte offsets) */
+#define HPET_CAPABILITIES   0x00
+#define HPET_CONFIG         0x10
+#define HPET_COUNTER        0xF0
+#define HPET_REGS_SIZE      0x400
+
+#define HPET_COUNTER_64     (1ULL << 13)
+#define HPET_ENABLE         0x1
+#define HPET_MAX_PERIOD_FS  100000000ULL    /* 100 ns, the spec's upper bound */
+#define FS_PER_SEC          1000000000000000ULL
+
+/* CMOS RTC */
+#define CMOS_INDEX      0x70
+#define CMOS_DATA       0x71
+#define RTC_SECONDS     0x00
+#define RTC_MINUTES     0x02
+#define RTC_HOURS       0x04
+#define RTC_DAY         0x07
+#define RTC_MONTH       0x08
+#define RTC_YEAR        0x09
+#define RTC_STATUS_A    0x0A
+#define RTC_STATUS_B    0x0B
+
+#define RTC_UPDATING    0x80        /* Status A: update in progress */
+#define RTC_24HOUR      0x02        /* Status B */
+#define RTC_BINARY      0x04        /* Status B */
+#define RTC_PM          0x80        /* Hour bit in 12-hour mode */
+
+#define CALIBRATION_MS      10
+#define CALIBRATION_RUNS    3
+#define POLL_LIMIT          10000000    /* Gives up on a counter that never moves */
+
+/* Cycles since the last tick fold into this base */
+static const clocksource_t* current = NULL;
+static volatile uint32_t clock_seq = 0;
+static uint64_t cycle_last = 0;
+static uint64_t ns_last = 0;
+static uint64_t ns_frac = 0;            /* Sub-nanosecond remainder << CLOCK_SHIFT */
+
+static uint64_t realtime_offset = 0;    /* Epoch ns at monotonic 0 */
+static uint64_t tsc_hz = 0;
+
+static volatile uint64_t* hpet_regs = NULL;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+    __asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(0));
+}
+
+/* ---- Clocksources ---- */
+
+static uint64_t tsc_read(void) {
+    return rdtsc();
+}
+
+static uint64_t hpet_read(void) {
+    return hpet_regs[HPET_COUNTER / 8];
+}
+
+/* Ticks times the reload value plus the progress of the current
+ * period. A reload whose IRQ is still pending would step back by one
+ * period, so the result is held at the last value returned. */
+static uint64_t pit_read(void) {
+    static uint64_t pit_last = 0;
+    uint32_t hz = timer_get_frequency();
+    if (!hz) {
+        return pit_last;
+    }
+    uint32_t divisor = PIT_BASE_FREQ / hz;
+    
+    uint64_t flags = irq_save();
+    outb(PIT_COMMAND, PIT_LATCH_CH0);
+    uint32_t count = inb(PIT_CHANNEL0);
+    count |= (uint32_t)inb(PIT_CHANNEL0) << 8;
+    
+    uint64_t value = timer_get_ticks() * divisor + (divisor - count);
+    if (value < pit_last) {
+        value = pit_last;
+    }
+    pit_last = value;
+    irq_restore(flags);
+    return value;
+}
+
+static clocksource_t tsc_source = {
+    .name = "tsc",
+    .read = tsc_read,
+    .mask = ~0ULL,
+};
+
+static clocksource_t hpet_source = {
+    .name = "hpet",
+    .rating = 250,
+    .read = hpet_read,
+};
+
+static clocksource_t pit_source = {
+    .name = "pit",
+    .rating = 50,
+    .read = pit_read,
+    .mask = ~0ULL,
+    .freq_hz = PIT_BASE_FREQ,
+};
+
+/* Map and start the HPET main counter (returns 1 if usable) */
+static int hpet_probe(void) {
+    uint64_t phys = acpi_hpet_address();
+    if (!phys) {
+        return 0;
+    }
+    
+    hpet_regs = (volatile uint64_t*)paging_map_io(phys, HPET_REGS_SIZE, PAGE_CACHE_DISABLE);
+    if (!hpet_regs) {
+        return 0;
+    }
+    
+    uint64_t caps = hpet_regs[HPET_CAPABILITIES / 8];
+    uint64_t period_fs = caps >> 32;
+    if (period_fs == 0 || period_fs > HPET_MAX_PERIOD_FS) {
+        return 0;
+    }
+    
+    /* Legacy replacement stays off: the PIT keeps driving IRQ0 */
+    hpet_regs[HPET_CONFIG / 8] |= HPET_ENABLE;
+    
+    hpet_source.freq_hz = FS_PER_SEC / period_fs;
+    hpet_source.mask = (caps & HPET_COUNTER_64) ? ~0ULL : 0xFFFFFFFFULL;
+    return 1;
+}
+
+/* TSC cycles over CALIBRATION_MS of the HPET */
+static uint64_t tsc_calibrate_hpet(void) {
+    uint64_t target = hpet_source.freq_hz * CALIBRATION_MS / 1000;
+    uint64_t start = hpet_read();
+    uint64_t tsc_start = rdtsc();
+    uint64_t elapsed = 0;
+    
+    for (uint32_t i = 0; i < POLL_LIMIT && elapsed < target; i++) {
+        elapsed = (hpet_read() - start) & hpet_source.mask;
+    }
+    uint64_t cycles = rdtsc() - tsc_start;
+    
+    return elapsed >= target ? cycles * hpet_source.freq_hz / elapsed : 0;
+}
+
+/* TSC cycles over CALIBRATION_MS of PIT channel 2 counting down once */
+static uint64_t tsc_calibrate_pit(void) {
+    uint32_t latch = PIT_BASE_FREQ * CALIBRATION_MS / 1000;
+    uint8_t gate = inb(PIT_GATE);
+    
+    /* Gate on, speaker off; loading the count starts it */
+    outb(PIT_GATE, (gate & ~PIT_SPEAKER) | PIT_GATE_HIGH);
+    outb(PIT_COMMAND, PIT_ONESHOT_CH2);
+    outb(PIT_CHANNEL2, (uint8_t)(latch & 0xFF));
+    outb(PIT_CHANNEL2, (uint8_t)(latch >> 8));
+    
+    uint64_t tsc_start = rdtsc();
+    uint32_t i = 0;
+    while (!(inb(PIT_GATE) & PIT_OUT2) && i < POLL_LIMIT) {
+        i++;
+    }
+    uint64_t cycles = rdtsc() - tsc_start;
+    outb(PIT_GATE, gate);
+    
+    return i < POLL_LIMIT ? cycles * PIT_BASE_FREQ / latch : 0;
+}
+
+/* Find and calibrate the TSC (returns 1 if usable) */
+static int tsc_probe(void) {
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    if (!(d & (1u << 4))) {
+        return 0;
+    }
+    
+    /* An invariant TSC ticks at a constant rate in every power state */
+    int invariant = 0;
+    cpuid(0x80000000, &a, &b, &c, &d);
+    if (a >= 0x80000007) {
+        cpuid(0x80000007, &a, &b, &c, &d);
+        invariant = (d & (1u << 8)) != 0;
+    }
+    
+    /* Several runs: an SMI or a slow port only ever lengthens one, so
+     * the lowest result is the most accurate */
+    uint64_t best = 0;
+    for (int run = 0; run < CALIBRATION_RUNS; run++) {
+        uint64_t hz = hpet_source.rating ? tsc_calibrate_hpet() : tsc_calibrate_pit();
+        if (hz && (!best || hz < best)) {
+            best = hz;
+        }
+    }
+    if (!best) {
+        return 0;
+    }
+    
+    tsc_source.freq_hz = best;
+    tsc_source.rating = invariant ? 300 : 100;
+    return 1;
+}
+
+/* ---- RTC ---- */
+
+static uint8_t cmos_read(uint8_t reg) {
+    outb(CMOS_INDEX, reg);
+    return inb(CMOS_DATA);
+}
+
+static uint8_t from_bcd(uint8_t value) {
+    return (uint8_t)((value >> 4) * 10 + (value & 0x0F));
+}
+
+static void rtc_read_raw(clock_datetime_t* out) {
+    uint32_t i = 0;
+    while ((cmos_read(RTC_STATUS_A) & RTC_UPDATING) && i < POLL_LIMIT) {
+        i++;
+    }
+    out->second = cmos_read(RTC_SECONDS);
+    out->minute = cmos_read(RTC_MINUTES);
+    out->hour = cmos_read(RTC_HOURS);
+    out->day = cmos_read(RTC_DAY);
+    out->month = cmos_read(RTC_MONTH);
+    out->year = cmos_read(RTC_YEAR);
+}
+
+static int datetime_equal(const clock_datetime_t* a, const clock_datetime_t* b) {
+    return a->second == b->second && a->minute == b->minute && a->hour == b->hour &&
+           a->day == b->day && a->month == b->month && a->year == b->year;
+}
+
+/* Read the RTC until two reads agree (an update may land in between) */
+static void rtc_read(clock_datetime_t* out) {
+    clock_datetime_t again;
+    rtc_read_raw(out);
+    for (int tries = 0; tries < 5; tries++) {
+        rtc_read_raw(&again);
+        if (datetime_equal(out, &again)) {
+            break;
+        }
+        *out = again;
+    }
+    
+    uint8_t status = cmos_read(RTC_STATUS_B);
+    uint8_t pm = out->hour & RTC_PM;
+    out->hour &= (uint8_t)~RTC_PM;
+    
+    if (!(status & RTC_BINARY)) {
+        out->second = from_bcd(out->second);
+        out->minute = from_bcd(out->minute);
+        out->hour = from_bcd(out->hour);
+        out->day = from_bcd(out->day);
+        out->month = from_bcd(out->month);
+        out->year = from_bcd((uint8_t)out->year);
+    }
+    
+    /* 12-hour mode: 12 AM is 0, 12 PM stays 12 */
+    if (!(status & RTC_24HOUR)) {
+        out->hour %= 12;
+        if (pm) {
+            out->hour += 12;
+        }
+    }
+    
+    /* The century register is not at a fixed place; assume 1970-2069 */
+    out->year += out->year < 70 ? 2000 : 1900;
+}
+
+/* Days since 1970-01-01 of a civil date (proleptic Gregorian) */
+static uint64_t days_from_civil(uint32_t year, uint32_t month, uint32_t day) {
+    year -= month <= 2;
+    uint32_t era = year / 400;
+    uint32_t yoe = year - era * 400;
+    uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (uint64_t)era * 146097 + doe - 719468;
+}
+
+void clock_to_datetime(uint64_t seconds, clock_datetime_t* out) {
+    uint64_t days = seconds / 86400;
+    uint32_t rem = (uint32_t)(seconds % 86400);
+    out->hour = (uint8_t)(rem / 3600);
+    out->minute = (uint8_t)(rem / 60 % 60);
+    out->second = (uint8_t)(rem % 60);
+    
+    /* Inverse of days_from_civil() */
+    uint64_t z = days + 719468;
+    uint64_t era = z / 146097;
+    uint32_t doe = (uint32_t)(z - era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    
+    out->day = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+    out->month = (uint8_t)(mp < 10 ? mp + 3 : mp - 9);
+    out->year = (uint32_t)(yoe + era * 400) + (out->month <= 2);
+}
+
+/* ---- Clock ---- */
+
+static inline uint64_t cycles_to_ns(uint64_t cycles, uint64_t mult, uint64_t* frac) {
+    unsigned __int128 prod = (unsigned __int128)cycles * mult + *frac;
+    *frac = (uint64_t)prod & ((1ULL << CLOCK_SHIFT) - 1);
+    return (uint64_t)(prod >> CLOCK_SHIFT);
+}
+
+void clock_init(void) {
+    clocksource_t* sources[] = { &hpet_source, &tsc_source, &pit_source };
+    
+    /* The HPET goes first: it is the better reference for the TSC */
+    if (!hpet_probe()) {
+        hpet_source.rating = 0;
+    }
+    if (!tsc_probe()) {
+        tsc_source.rating = 0;
+    }
+    tsc_hz = tsc_source.rating ? tsc_source.freq_hz : 0;
+    
+    clocksource_t* best = NULL;
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        clocksource_t* cs = sources[i];
+        if (!cs->rating) {
+            continue;
+        }
+        cs->mult = (NS_PER_SEC << CLOCK_SHIFT) / cs->freq_hz;
+        if (!best || cs->rating > best->rating) {
+            best = cs;
+        }
+    }
+    
+    cycle_last = best->read();
+    ns_last = 0;
+    ns_frac = 0;
+    current = best;
+    
+    clock_datetime_t now;
+    rtc_read(&now);
+    uint64_t epoch = days_from_civil(now.year, now.month, now.day) * 86400 +
+                     now.hour * 3600u + now.minute * 60u + now.second;
+    realtime_offset = epoch * NS_PER_SEC - clock_monotonic_ns();
+    
+    klog(LOG_OK, "Clocksource %s (%lu kHz, rating %d), TSC %lu kHz",
+         best->name, best->freq_hz / 1000, best->rating, tsc_hz / 1000);
+    klog(LOG_OK, "RTC %u-%02u-%02u %02u:%02u:%02u UTC",
+         now.year, now.month, now.day, now.hour, now.minute, now.second);
+}
+INITCALL(INIT_PLATFORM, clock_init, "irqchip_init");
+
+/* Writer side of the seqlock: only the timer IRQ calls this */
+void clock_tick(void) {
+    if (!current) {
+        return;
+    }
+    uint64_t now = current->read();
+    
+    clock_seq++;
+    __asm__ volatile("" : : : "memory");
+    
+    ns_last += cycles_to_ns((now - cycle_last) & current->mask, current->mult, &ns_frac);
+    cycle_last = now;
+    
+    __asm__ volatile("" : : : "memory");
+    clock_seq++;
+}
+
+uint64_t clock_monotonic_ns(void) {
+    const clocksource_t* cs = current;
+    if (!cs) {
+        return 0;
+    }
+    
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        while ((seq = clock_seq) & 1) {
+            __asm__ volatile("pause");
+        }
+        __asm__ volatile("" : : : "memory");
+        
+        uint64_t frac = ns_frac;
+        ns = ns_last + cycles_to_ns((cs->read() - cycle_last) & cs->mask, cs->mult, &frac);
+        
+        __asm__ volatile("" : : : "memory");
+    } while (clock_seq != seq);
+    
+    return ns;
+}
+
+uint64_t clock_realtime(void) {
+    return realtime_offset + clock_monotonic_ns();
+}
+
+const clocksource_t* clock_source(void) {
+    return current;
+}
+
+uint64_t clock_tsc_hz(void) {
+    return tsc_hz;
+}
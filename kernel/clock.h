@@ -0,0 +1,65 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/* Clocksources and Time of Day
+ * Every usable free-running counter (invariant TSC, HPET, PIT) is probed
+ * at boot, calibrated and rated; the highest rated one backs
+ * clock_monotonic_ns(). Reads turn the counter delta since the last
+ * timer tick into nanoseconds with one multiply and shift, so they are
+ * cheap enough for latency measurements. The timer tick folds the delta
+ * into the base, which keeps narrow counters from wrapping unnoticed.
+ *
+ * Wall-clock time comes from the CMOS RTC, read once at boot and then
+ * carried forward by the monotonic clock.
+ */
+
+#define NS_PER_SEC  1000000000ULL
+#define NS_PER_MS   1000000ULL
+#define NS_PER_US   1000ULL
+
+#define CLOCK_SHIFT 32          /* ns = (cycles * mult) >> CLOCK_SHIFT */
+
+typedef struct clocksource {
+    const char* name;
+    int rating;                 /* Higher is better; 0 = unusable */
+    uint64_t (*read)(void);     /* Current counter value */
+    uint64_t mask;              /* Counter width */
+    uint64_t freq_hz;           /* Counter frequency (set by probing) */
+    uint64_t mult;              /* Nanoseconds per cycle << CLOCK_SHIFT */
+} clocksource_t;
+
+/* Broken-down UTC time */
+typedef struct {
+    uint32_t year;
+    uint8_t month;              /* 1-12 */
+    uint8_t day;                /* 1-31 */
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+} clock_datetime_t;
+
+/* Probe and calibrate the clocksources, pick the best and read the RTC
+ * (needs paging and ACPI, before interrupts are enabled) */
+void clock_init(void);
+
+/* Advance the base to the current counter (called from the timer tick) */
+void clock_tick(void);
+
+/* Nanoseconds since clock_init() */
+uint64_t clock_monotonic_ns(void);
+
+/* Nanoseconds since the Unix epoch (UTC) */
+uint64_t clock_realtime(void);
+
+/* Clocksource in use (NULL before clock_init()) */
+const clocksource_t* clock_source(void);
+
+/* Calibrated TSC frequency (0 if the TSC is not usable) */
+uint64_t clock_tsc_hz(void);
+
+/* Split seconds since the Unix epoch into a UTC date and time */
+void clock_to_datetime(uint64_t seconds, clock_datetime_t* out);
+
+#endif
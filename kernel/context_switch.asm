@@ -16,7 +16,8 @@ context_switch:
     mov [rdi + 32],  rsi
     mov [rdi + 40],  rdi
     mov [rdi + 48],  rbp
-    mov [rdi + 56],  rsp
+    lea rax, [rsp + 8]       ; RSP as seen by the caller after we return
+    mov [rdi + 56],  rax
     mov [rdi + 64],  r8
     mov [rdi + 72],  r9
     mov [rdi + 80],  r10
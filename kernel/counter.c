@@ -0,0 +1,49 @@
+#include "counter.h"
+#include "irqtrace.h"
+
+#include <stddef.h>
+
+static counter_t* counters = NULL;
+static counter_t* counters_tail = NULL;
+
+void counter_register(counter_t* counter) {
+    uint64_t flags = irq_save();
+    
+    counter->next = NULL;
+    if (counters_tail) {
+        counters_tail->next = counter;
+    } else {
+        counters = counter;
+    }
+    counters_tail = counter;
+    
+    irq_restore(flags);
+}
+
+counter_t* counter_first(void) {
+    return counters;
+}
+
+static int name_equal(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+counter_t* counter_find(const char* name) {
+    for (counter_t* c = counters; c; c = c->next) {
+        if (name_equal(c->name, name)) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+uint64_t counter_read(counter_t* counter) {
+    if (counter->read) {
+        return counter->read(counter->ctx);
+    }
+    return counter->value;
+}
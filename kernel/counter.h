@@ -0,0 +1,64 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <stdint.h>
+
+/* Performance Counters
+ * Subsystems define named 64-bit counters statically and register them
+ * once at init; monitors walk the registry and sample them.
+ *
+ *   static counter_t page_allocs = {
+ *       .name = "pmm.page_allocs",
+ *       .kind = COUNTER_EVENT,
+ *   };
+ *   counter_register(&page_allocs);
+ *   counter_inc(&page_allocs);
+ *
+ * A counter with a read callback is computed when sampled instead of
+ * being updated on the hot path.
+ */
+
+typedef enum {
+    COUNTER_EVENT,      /* Only goes up: shown with a rate */
+    COUNTER_GAUGE       /* Current level of something */
+} counter_kind_t;
+
+typedef struct counter {
+    const char* name;
+    counter_kind_t kind;
+    uint64_t (*read)(void* ctx);    /* Optional: value computed on demand */
+    void* ctx;                      /* Passed to read */
+    volatile uint64_t value;
+    struct counter* next;
+} counter_t;
+
+/* Add a counter to the registry (kept in registration order) */
+void counter_register(counter_t* counter);
+
+/* First registered counter; follow ->next for the rest */
+counter_t* counter_first(void);
+
+/* Look a counter up by name (NULL if not registered) */
+counter_t* counter_find(const char* name);
+
+/* Current value */
+uint64_t counter_read(counter_t* counter);
+
+/* Updates are single instructions, safe from interrupt handlers */
+static inline void counter_add(counter_t* counter, uint64_t n) {
+    __atomic_fetch_add(&counter->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void counter_inc(counter_t* counter) {
+    counter_add(counter, 1);
+}
+
+static inline void counter_sub(counter_t* counter, uint64_t n) {
+    __atomic_fetch_sub(&counter->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void counter_set(counter_t* counter, uint64_t value) {
+    __atomic_store_n(&counter->value, value, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -7,6 +7,20 @@ multiboot_header_start:
     dd multiboot_header_end - multiboot_header_start  ; header length
     dd -(0xe85250d6 + 0 + (multiboot_header_end - multiboot_header_start))  ; checksum
 
+    ; Framebuffer tag (optional: GRUB falls back to text mode without one)
+    dw 5    ; type
+    dw 1    ; flags (optional)
+    dd 20   ; size
+    dd 640  ; width
+    dd 480  ; height
+    dd 32   ; depth
+    dd 0    ; pad to the next 8-byte boundary
+
+    ; Module alignment tag: load modules on page boundaries
+    dw 6    ; type
+    dw 1    ; flags (optional)
+    dd 8    ; size
+
     ; End tag
     dw 0    ; type
     dw 0    ; flags
@@ -27,6 +41,12 @@ pdp_table:
 pd_table:
     resq 512
 
+; Multiboot2 handoff (EAX/EBX at entry), passed on to kernel_main
+boot_magic:
+    resd 1
+boot_info:
+    resd 1
+
 section .rodata
 align 8
 gdt64:
@@ -47,6 +67,10 @@ _start:
     cld
 
     bits 32
+    ; Save the Multiboot2 magic and boot information address
+    mov [boot_magic], eax
+    mov [boot_info], ebx
+
     ; Zero page tables (BSS is not guaranteed to be zeroed by the bootloader)
     xor eax, eax
     mov edi, pml4_table
@@ -124,6 +148,9 @@ long_mode_start:
     xor rcx, rcx
     xor rdx, rdx
 
+    ; kernel_main(magic, boot information address)
+    mov edi, [boot_magic]
+    mov esi, [boot_info]
     call kernel_main
 
 hang:
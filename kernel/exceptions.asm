@@ -85,9 +85,10 @@ isr_common_stub:
     push r15
 
     ; Call C exception handler
-    ; Arguments: RDI = interrupt number, RSI = error code
+    ; Arguments: RDI = interrupt number, RSI = error code, RDX = CPU frame
     mov rdi, [rsp + 120]  ; Interrupt number (15 regs * 8 bytes = 120)
     mov rsi, [rsp + 128]  ; Error code
+    lea rdx, [rsp + 136]  ; RIP, CS, RFLAGS, RSP, SS pushed by the CPU
     call exception_handler
 
     ; Restore all general-purpose registers
@@ -1,6 +1,15 @@
 #include "exceptions.h"
 #include "vga.h"
+#include "kprintf.h"
+#include "serial.h"
+#include "klog.h"
 #include "panic.h"
+#include "kstack.h"
+#include "vma.h"
+#include "process.h"
+
+#define EXC_DOUBLE_FAULT 8
+#define EXC_PAGE_FAULT   14
 
 static const char* exception_messages[] = {
     "Divide by Zero",
@@ -37,47 +46,83 @@ static const char* exception_messages[] = {
     "Reserved"
 };
 
-/* Convert number to hex string */
-static void uint_to_hex(uint64_t value, char* buffer) {
-    const char* digits = "0123456789ABCDEF";
-    buffer[0] = '0';
-    buffer[1] = 'x';
-    
-    for (int i = 15; i >= 0; i--) {
-        buffer[2 + (15 - i)] = digits[(value >> (i * 4)) & 0xF];
-    }
-    buffer[18] = '\0';
+/* Read the faulting address of a page fault */
+static inline uint64_t read_cr2(void) {
+    uint64_t value;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(value));
+    return value;
 }
 
-void exception_handler(uint64_t int_no, uint64_t err_code) {
-    char hex_buffer[19];
+void exception_handler(uint64_t int_no, uint64_t err_code, interrupt_frame_t* frame) {
+    uint64_t fault_addr = 0;
+    int stack_overflow = 0;
+    
+    if (int_no == EXC_PAGE_FAULT) {
+        /* Kernel stacks are backed lazily - resolve and retry */
+        fault_addr = read_cr2();
+        kstack_fault_t result = kstack_handle_fault(fault_addr);
+        if (result == KSTACK_FAULT_HANDLED) {
+            return;
+        }
+        stack_overflow = (result == KSTACK_FAULT_OVERFLOW);
+        
+        /* Lazily populated or copy-on-write user page */
+        if (vm_handle_fault(fault_addr, err_code)) {
+            return;
+        }
+    } else if (int_no == EXC_DOUBLE_FAULT) {
+        /* A stack pointer inside a guard page means the stack overflowed */
+        stack_overflow = kstack_is_guard(frame->rsp) || kstack_is_guard(frame->rsp - 8);
+    }
+    
+    /* A fault in ring 3 ends that process, not the system */
+    if ((frame->cs & 3) == 3 && !stack_overflow) {
+        process_t* proc = process_current();
+        klog(LOG_ERROR, "pid %u killed: %s at rip 0x%lx (address 0x%lx, error 0x%lx)",
+             proc->pid, int_no < 32 ? exception_messages[int_no] : "Unknown",
+             frame->rip, fault_addr, err_code);
+        process_exit();
+    }
+    
+    /* Serial output must not wait on an interrupt that will never come */
+    serial_set_polled();
+    
+    /* Get out what was logged but not printed yet */
+    klog_flush();
     
     /* Clear screen and show error */
+    kprint_set_screen(1);
     vga_clear();
-    vga_println("", VGA_COLOR_LIGHT_RED);
-    vga_println("*** CPU EXCEPTION ***", VGA_COLOR_LIGHT_RED);
-    vga_println("", VGA_COLOR_LIGHT_RED);
+    kprintf_color(VGA_COLOR_LIGHT_RED, "\n*** CPU EXCEPTION ***\n\n");
     
     /* Show exception name */
-    vga_print("Exception: ", VGA_COLOR_WHITE);
-    if (int_no < 32) {
-        vga_println(exception_messages[int_no], VGA_COLOR_YELLOW);
-    } else {
-        vga_println("Unknown", VGA_COLOR_YELLOW);
-    }
+    kprintf_color(VGA_COLOR_WHITE, "Exception: ");
+    kprintf_color(VGA_COLOR_YELLOW, "%s\n", int_no < 32 ? exception_messages[int_no] : "Unknown");
     
-    /* Show exception number */
-    vga_print("Number: ", VGA_COLOR_WHITE);
-    uint_to_hex(int_no, hex_buffer);
-    vga_println(hex_buffer, VGA_COLOR_CYAN);
+    /* Show exception number, error code and faulting instruction */
+    kprintf_color(VGA_COLOR_WHITE, "Number: ");
+    kprintf_color(VGA_COLOR_CYAN, "0x%016lX\n", int_no);
+    kprintf_color(VGA_COLOR_WHITE, "Error Code: ");
+    kprintf_color(VGA_COLOR_CYAN, "0x%016lX\n", err_code);
+    kprintf_color(VGA_COLOR_WHITE, "RIP: ");
+    kprintf_color(VGA_COLOR_CYAN, "0x%016lX\n", frame->rip);
     
-    /* Show error code */
-    vga_print("Error Code: ", VGA_COLOR_WHITE);
-    uint_to_hex(err_code, hex_buffer);
-    vga_println(hex_buffer, VGA_COLOR_CYAN);
+    if (int_no == EXC_PAGE_FAULT) {
+        kprintf_color(VGA_COLOR_WHITE, "Fault Address: ");
+        kprintf_color(VGA_COLOR_CYAN, "0x%016lX\n", fault_addr);
+    }
+    
+    if (stack_overflow) {
+        process_t* proc = process_current();
+        
+        kprintf_color(VGA_COLOR_LIGHT_RED, "\nKernel stack overflow (guard page hit)\n");
+        kprintf_color(VGA_COLOR_WHITE, "PID: ");
+        kprintf_color(VGA_COLOR_CYAN, "%u\n", proc ? proc->pid : 0);
+        kprintf_color(VGA_COLOR_WHITE, "Stack Pointer: ");
+        kprintf_color(VGA_COLOR_CYAN, "0x%016lX\n", frame->rsp);
+    }
     
-    vga_println("", VGA_COLOR_WHITE);
-    vga_println("System halted.", VGA_COLOR_LIGHT_GRAY);
+    kprintf_color(VGA_COLOR_LIGHT_GRAY, "\nSystem halted.\n");
     
     /* Halt the system */
     __asm__ volatile("cli");
@@ -3,7 +3,18 @@
 
 #include <stdint.h>
 
-/* Exception handler called from assembly */
-void exception_handler(uint64_t int_no, uint64_t err_code);
+/* Frame pushed by the CPU on exception entry */
+typedef struct {
+    uint64_t rip;
+    uint64_t cs;
+    uint64_t rflags;
+    uint64_t rsp;
+    uint64_t ss;
+} interrupt_frame_t;
+
+/* Exception handler called from assembly
+ * Returns only if the exception was resolved (e.g. a lazily backed page).
+ */
+void exception_handler(uint64_t int_no, uint64_t err_code, interrupt_frame_t* frame);
 
 #endif
@@ -0,0 +1,247 @@
+#include "fiber.h"
+#include "process.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "panic.h"
+#include "kprint.h"
+#include "irqtrace.h"
+#include "initcall.h"
+
+#include <stddef.h>
+
+#define TIMER_WHEEL_SIZE 256   /* Buckets (power of two) */
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define INPUT_QUEUE_SIZE 64    /* Buffered scancodes (power of two) */
+#define EXECUTOR_STACK_SIZE 16384
+
+/* Ready queue (FIFO) */
+static fiber_t* ready_head = NULL;
+static fiber_t* ready_tail = NULL;
+
+/* Timer wheel: sleeping fibers hashed by wakeup tick */
+static fiber_t* timer_wheel[TIMER_WHEEL_SIZE];
+static uint64_t wheel_tick = 0;   /* Last tick the wheel was advanced to */
+
+/* Keyboard input queue (single producer IRQ, single consumer) */
+static volatile uint8_t input_queue[INPUT_QUEUE_SIZE];
+static volatile uint32_t input_head = 0;
+static volatile uint32_t input_tail = 0;
+
+fiber_event_t fiber_input_event;
+
+static uint64_t live_fibers = 0;
+
+/* Append to ready queue (interrupts must be disabled) */
+static void ready_push(fiber_t* f) {
+    f->state = FIBER_STATE_READY;
+    f->next = NULL;
+    if (ready_tail) {
+        ready_tail->next = f;
+    } else {
+        ready_head = f;
+    }
+    ready_tail = f;
+}
+
+void fiber_runtime_init(void) {
+    ready_head = NULL;
+    ready_tail = NULL;
+    for (int i = 0; i < TIMER_WHEEL_SIZE; i++) {
+        timer_wheel[i] = NULL;
+    }
+    wheel_tick = timer_get_ticks();
+    input_head = 0;
+    input_tail = 0;
+    live_fibers = 0;
+    fiber_event_init(&fiber_input_event);
+
+    kprint_ok("Fiber runtime initialized");
+}
+INITCALL(INIT_CORE, fiber_runtime_init);
+
+void fiber_init(fiber_t* f, fiber_fn_t fn, void* arg) {
+    f->fn = fn;
+    f->arg = arg;
+    f->resume = 0;
+    f->state = FIBER_STATE_NEW;
+    f->wake_tick = 0;
+    f->next = NULL;
+}
+
+void fiber_spawn(fiber_t* f) {
+    uint64_t flags = irq_save();
+    live_fibers++;
+    ready_push(f);
+    irq_restore(flags);
+}
+
+void fiber_sleep(fiber_t* f, uint64_t ticks) {
+    uint64_t flags = irq_save();
+
+    if (ticks == 0) {
+        ready_push(f);
+    } else {
+        f->state = FIBER_STATE_SLEEPING;
+        f->wake_tick = timer_get_ticks() + ticks;
+
+        uint32_t bucket = f->wake_tick & TIMER_WHEEL_MASK;
+        f->next = timer_wheel[bucket];
+        timer_wheel[bucket] = f;
+    }
+
+    irq_restore(flags);
+}
+
+void fiber_event_init(fiber_event_t* ev) {
+    ev->waiters = NULL;
+    ev->pending = 0;
+}
+
+int fiber_wait(fiber_t* f, fiber_event_t* ev) {
+    uint64_t flags = irq_save();
+
+    /* Signal arrived before we got here - don't park */
+    if (ev->pending) {
+        ev->pending = 0;
+        irq_restore(flags);
+        return 0;
+    }
+
+    f->state = FIBER_STATE_WAITING;
+    f->next = ev->waiters;
+    ev->waiters = f;
+
+    irq_restore(flags);
+    return 1;
+}
+
+void fiber_event_signal(fiber_event_t* ev) {
+    uint64_t flags = irq_save();
+
+    if (!ev->waiters) {
+        ev->pending = 1;
+    }
+
+    while (ev->waiters) {
+        fiber_t* f = ev->waiters;
+        ev->waiters = f->next;
+        ready_push(f);
+    }
+
+    irq_restore(flags);
+}
+
+void fiber_post_input(uint8_t scancode) {
+    uint32_t next = (input_head + 1) & (INPUT_QUEUE_SIZE - 1);
+    if (next == input_tail) {
+        return;  /* Queue full - drop */
+    }
+    input_queue[input_head] = scancode;
+    input_head = next;
+
+    fiber_event_signal(&fiber_input_event);
+}
+
+int fiber_input_pop(uint8_t* scancode) {
+    if (input_tail == input_head) {
+        return 0;
+    }
+    *scancode = input_queue[input_tail];
+    input_tail = (input_tail + 1) & (INPUT_QUEUE_SIZE - 1);
+    return 1;
+}
+
+/* Move expired sleepers to the ready queue (interrupts disabled) */
+static void advance_timer_wheel(uint64_t now) {
+    if (now <= wheel_tick) {
+        return;
+    }
+
+    /* Visit each bucket at most once per advance */
+    uint64_t steps = now - wheel_tick;
+    if (steps > TIMER_WHEEL_SIZE) {
+        steps = TIMER_WHEEL_SIZE;
+    }
+
+    for (uint64_t t = now - steps + 1; t <= now; t++) {
+        fiber_t** link = &timer_wheel[t & TIMER_WHEEL_MASK];
+        while (*link) {
+            fiber_t* f = *link;
+            if (f->wake_tick <= now) {
+                *link = f->next;
+                ready_push(f);
+            } else {
+                link = &f->next;  /* Due in a later lap of the wheel */
+            }
+        }
+    }
+
+    wheel_tick = now;
+}
+
+/* Run one step of every fiber that is ready; returns number run */
+static uint64_t run_ready_fibers(void) {
+    uint64_t flags = irq_save();
+    advance_timer_wheel(timer_get_ticks());
+
+    /* Detach the current batch so newly readied fibers wait a pass */
+    fiber_t* batch = ready_head;
+    ready_head = NULL;
+    ready_tail = NULL;
+    irq_restore(flags);
+
+    uint64_t ran = 0;
+    while (batch) {
+        fiber_t* f = batch;
+        batch = f->next;
+        f->next = NULL;
+
+        int result = f->fn(f);
+        ran++;
+
+        if (result == FIBER_YIELDED) {
+            flags = irq_save();
+            ready_push(f);
+            irq_restore(flags);
+        } else if (result == FIBER_DONE) {
+            f->state = FIBER_STATE_DONE;
+            live_fibers--;
+        }
+        /* FIBER_WAITING: already parked by fiber_sleep()/fiber_wait() */
+    }
+
+    return ran;
+}
+
+/* Executor process: runs fibers forever, halting while idle */
+static void fiber_executor_main(void) {
+    while (1) {
+        if (run_ready_fibers()) {
+            continue;
+        }
+
+        /* Nothing to do: sleep until the next interrupt. STI+HLT is atomic,
+         * so a wakeup arriving after the check cannot be missed. */
+        uint64_t flags = irq_save();
+        if (!ready_head) {
+            irq_halt();
+        } else {
+            irq_restore(flags);
+        }
+    }
+}
+
+void fiber_executor_start(void) {
+    process_t* proc = process_create(fiber_executor_main, EXECUTOR_STACK_SIZE);
+    if (!proc) {
+        panic("Failed to create fiber executor");
+    }
+    scheduler_add(proc);
+
+    kprint_ok("Fiber executor started");
+}
+INITCALL(INIT_CORE, fiber_executor_start, "fiber_runtime_init", "scheduler_init");
+
+uint64_t fiber_live_count(void) {
+    return live_fibers;
+}
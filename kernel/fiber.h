@@ -0,0 +1,127 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <stdint.h>
+
+/* Lightweight Fibers
+ * Stackless cooperative tasks multiplexed onto one kernel process (M:N).
+ * A fiber is a step function plus a resume point: each call runs until
+ * the next FIBER_YIELD/FIBER_SLEEP/FIBER_AWAIT and returns, so a switch
+ * is one indirect call and no stack is needed per fiber. Thousands of
+ * fibers cost only their fiber_t (embed it in your own state struct).
+ *
+ * Local variables do NOT survive a yield - keep state in the struct
+ * that embeds the fiber. Use at most one FIBER_* wait macro per line.
+ *
+ *   static int blink(fiber_t* f) {
+ *       FIBER_BEGIN(f);
+ *       while (1) {
+ *           toggle_led();
+ *           FIBER_SLEEP(f, 50);
+ *       }
+ *       FIBER_END(f);
+ *   }
+ */
+
+/* Step function results */
+#define FIBER_YIELDED 0   /* Runnable again immediately */
+#define FIBER_WAITING 1   /* Parked on a timer or event */
+#define FIBER_DONE    2   /* Finished */
+
+/* Fiber states */
+typedef enum {
+    FIBER_STATE_NEW,
+    FIBER_STATE_READY,
+    FIBER_STATE_SLEEPING,
+    FIBER_STATE_WAITING,
+    FIBER_STATE_DONE
+} fiber_state_t;
+
+struct fiber;
+typedef int (*fiber_fn_t)(struct fiber* f);
+
+/* Fiber control block */
+typedef struct fiber {
+    fiber_fn_t fn;          /* Step function */
+    void* arg;              /* User argument */
+    uint32_t resume;        /* Continuation point (0 = start) */
+    fiber_state_t state;    /* Current state */
+    uint64_t wake_tick;     /* Wakeup time while sleeping */
+    struct fiber* next;     /* Ready queue / timer bucket / wait list link */
+} fiber_t;
+
+/* Event fibers can wait on (signal is safe from IRQ context) */
+typedef struct {
+    fiber_t* waiters;       /* Fibers parked on this event */
+    uint8_t pending;        /* Signaled with nobody waiting */
+} fiber_event_t;
+
+/* Continuation macros */
+#define FIBER_BEGIN(f)  switch ((f)->resume) { case 0:
+
+#define FIBER_END(f)    } (f)->resume = 0; return FIBER_DONE
+
+#define FIBER_YIELD(f)                                  \
+    do {                                                \
+        (f)->resume = __LINE__;                         \
+        return FIBER_YIELDED;                           \
+        case __LINE__:;                                 \
+    } while (0)
+
+#define FIBER_SLEEP(f, ticks)                           \
+    do {                                                \
+        (f)->resume = __LINE__;                         \
+        fiber_sleep((f), (ticks));                      \
+        return FIBER_WAITING;                           \
+        case __LINE__:;                                 \
+    } while (0)
+
+#define FIBER_AWAIT(f, ev)                              \
+    do {                                                \
+        (f)->resume = __LINE__;                         \
+        if (fiber_wait((f), (ev))) return FIBER_WAITING; \
+        __attribute__((fallthrough));                   \
+        case __LINE__:;                                 \
+    } while (0)
+
+/* Wait until a keyboard scancode is available, then store it in sc */
+#define FIBER_AWAIT_INPUT(f, sc)                        \
+    while (!fiber_input_pop(&(sc))) FIBER_AWAIT((f), &fiber_input_event)
+
+/* Signaled whenever a scancode is posted */
+extern fiber_event_t fiber_input_event;
+
+/* Prepare a fiber (storage is owned by the caller) */
+void fiber_init(fiber_t* f, fiber_fn_t fn, void* arg);
+
+/* Make a fiber runnable */
+void fiber_spawn(fiber_t* f);
+
+/* Park the fiber until `ticks` timer ticks have passed */
+void fiber_sleep(fiber_t* f, uint64_t ticks);
+
+/* Park the fiber on an event (returns 0 if a pending signal was consumed) */
+int fiber_wait(fiber_t* f, fiber_event_t* ev);
+
+/* Initialize an event */
+void fiber_event_init(fiber_event_t* ev);
+
+/* Wake every fiber waiting on the event */
+void fiber_event_signal(fiber_event_t* ev);
+
+/* Queue a keyboard scancode for fibers (called from IRQ) */
+void fiber_post_input(uint8_t scancode);
+
+/* Pop a queued scancode (returns 0 if none) */
+int fiber_input_pop(uint8_t* scancode);
+
+/* Initialize the fiber runtime */
+void fiber_runtime_init(void);
+
+/* Start the executor process that runs all fibers */
+void fiber_executor_start(void);
+
+/* Number of fibers that have not finished */
+uint64_t fiber_live_count(void);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef FONT8X16_H
+#define FONT8X16_H
+
+#include <stdint.h>
+
+/* Glyph cell size in pixels */
+#define FONT_WIDTH   8
+#define FONT_HEIGHT  16
+
+/* Printable ASCII only: glyph i draws character FONT_FIRST + i */
+#define FONT_FIRST   32
+#define FONT_GLYPHS  95
+
+extern const uint8_t font8x16[FONT_GLYPHS][FONT_HEIGHT];
+
+#endif
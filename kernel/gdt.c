@@ -0,0 +1,59 @@
+#include "gdt.h"
+#include "kprint.h"
+#include "initcall.h"
+
+#define GDT_ENTRIES 7  /* null, kernel code/data, user data/code, TSS (2 slots) */
+
+static uint64_t gdt[GDT_ENTRIES];
+static struct gdt_ptr gdt_descriptor;
+static struct tss kernel_tss;
+
+/* Dedicated stacks for exceptions that must not run on a broken stack */
+static uint8_t ist_stacks[2][IST_STACK_SIZE] __attribute__((aligned(16)));
+
+/* External assembly functions */
+extern void gdt_load(struct gdt_ptr* ptr, uint16_t code_sel, uint16_t data_sel);
+extern void tss_load(uint16_t selector);
+
+/* Encode a 16-byte system descriptor for the TSS */
+static void gdt_set_tss(int index, uint64_t base, uint32_t limit) {
+    gdt[index] = (limit & 0xFFFF)
+               | ((base & 0xFFFFFF) << 16)
+               | (0x89ULL << 40)                     /* Present, 64-bit TSS (available) */
+               | ((uint64_t)((limit >> 16) & 0xF) << 48)
+               | (((base >> 24) & 0xFF) << 56);
+    gdt[index + 1] = base >> 32;
+}
+
+void gdt_init(void) {
+    /* Flat 64-bit segments (same as the boot GDT) */
+    gdt[0] = 0;
+    gdt[1] = 0x00AF9A000000FFFF;   /* Kernel code */
+    gdt[2] = 0x00AF92000000FFFF;   /* Kernel data */
+    gdt[3] = 0x00AFF2000000FFFF;   /* User data (DPL 3) */
+    gdt[4] = 0x00AFFA000000FFFF;   /* User code (DPL 3) */
+
+    /* Prepare the TSS */
+    uint8_t* tss_bytes = (uint8_t*)&kernel_tss;
+    for (uint64_t i = 0; i < sizeof(kernel_tss); i++) {
+        tss_bytes[i] = 0;
+    }
+    kernel_tss.ist[IST_DOUBLE_FAULT - 1] = (uint64_t)&ist_stacks[0][IST_STACK_SIZE];
+    kernel_tss.ist[IST_PAGE_FAULT - 1] = (uint64_t)&ist_stacks[1][IST_STACK_SIZE];
+    kernel_tss.iomap_base = sizeof(kernel_tss);  /* No I/O permission bitmap */
+
+    gdt_set_tss(GDT_TSS / 8, (uint64_t)&kernel_tss, sizeof(kernel_tss) - 1);
+
+    /* Load GDT, reload segment registers, then the task register */
+    gdt_descriptor.limit = sizeof(gdt) - 1;
+    gdt_descriptor.base = (uint64_t)&gdt;
+    gdt_load(&gdt_descriptor, GDT_KERNEL_CODE, GDT_KERNEL_DATA);
+    tss_load(GDT_TSS);
+
+    kprint_ok("GDT loaded (TSS with IST stacks)");
+}
+INITCALL(INIT_EARLY, gdt_init);
+
+void gdt_set_kernel_stack(uint64_t rsp0) {
+    kernel_tss.rsp0 = rsp0;
+}
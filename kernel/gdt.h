@@ -0,0 +1,53 @@
+#ifndef GDT_H
+#define GDT_H
+
+#include <stdint.h>
+
+/* Global Descriptor Table + Task State Segment
+ * The boot GDT in entry.asm only has code/data segments and lives in
+ * .rodata; this one is writable and adds a TSS so the CPU can switch to
+ * dedicated Interrupt Stack Table (IST) stacks for critical exceptions.
+ */
+
+/* Segment selectors */
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_DATA   0x18   /* SYSRET expects user data right before user code */
+#define GDT_USER_CODE   0x20
+#define GDT_TSS         0x28
+
+/* Requested privilege level for ring 3 selectors */
+#define GDT_RPL_USER    3
+
+/* IST slots (1-7, 0 means "use the current stack") */
+#define IST_DOUBLE_FAULT 1
+#define IST_PAGE_FAULT   2
+
+/* Size of each IST stack */
+#define IST_STACK_SIZE 8192
+
+/* 64-bit Task State Segment */
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp0;          /* Stack used on privilege change to ring 0 */
+    uint64_t rsp1;
+    uint64_t rsp2;
+    uint64_t reserved1;
+    uint64_t ist[7];        /* Interrupt Stack Table (IST1-IST7) */
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed));
+
+/* Build the GDT/TSS and load them (must run before idt_init) */
+void gdt_init(void);
+
+/* Set the stack the CPU switches to when entering ring 0 from ring 3 */
+void gdt_set_kernel_stack(uint64_t rsp0);
+
+#endif
@@ -0,0 +1,26 @@
+global gdt_load
+global tss_load
+
+; void gdt_load(struct gdt_ptr* ptr, uint16_t code_sel, uint16_t data_sel)
+; RDI = GDT pointer, RSI = code selector, RDX = data selector
+gdt_load:
+    lgdt [rdi]
+
+    ; Reload data segment registers
+    mov ax, dx
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Reload CS with a far return to the caller
+    pop rax
+    push rsi
+    push rax
+    o64 retf
+
+; void tss_load(uint16_t selector)
+tss_load:
+    ltr di
+    ret
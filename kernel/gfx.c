@@ -0,0 +1,395 @@
+#include "gfx.h"
+#include "font8x16.h"
+#include "pmm.h"
+#include "paging.h"
+#include "irqtrace.h"
+#include "kprint.h"
+
+#include <stddef.h>
+
+/* Four pixels per SSE2 register. The _u variants are for addresses that
+ * are only 4-byte aligned; may_alias lets them read uint32_t buffers. */
+typedef uint32_t v4u __attribute__((vector_size(16), may_alias));
+typedef uint32_t v4u_u __attribute__((vector_size(16), may_alias, aligned(4)));
+typedef uint16_t v8w __attribute__((vector_size(16), may_alias));
+
+/* CR0/CR4 bits needed before touching an XMM register */
+#define CR0_EM          (1ULL << 2)
+#define CR0_MP          (1ULL << 1)
+#define CR4_OSFXSR      (1ULL << 9)
+#define CR4_OSXMMEXCPT  (1ULL << 10)
+
+/* Framebuffer (mapped) and the back buffer, stride = width */
+static uint8_t* fb = NULL;
+static uint32_t fb_pitch = 0;
+static uint32_t* back = NULL;
+static int width = 0;
+static int height = 0;
+static int active = 0;
+
+/* Channel shifts of the mode */
+static uint8_t red_shift, green_shift, blue_shift;
+
+/* Text mode palette, converted to pixels at init */
+static const uint8_t vga_palette_rgb[16][3] = {
+    {0x00, 0x00, 0x00}, {0x00, 0x00, 0xAA}, {0x00, 0xAA, 0x00}, {0x00, 0xAA, 0xAA},
+    {0xAA, 0x00, 0x00}, {0xAA, 0x00, 0xAA}, {0xAA, 0x55, 0x00}, {0xAA, 0xAA, 0xAA},
+    {0x55, 0x55, 0x55}, {0x55, 0x55, 0xFF}, {0x55, 0xFF, 0x55}, {0x55, 0xFF, 0xFF},
+    {0xFF, 0x55, 0x55}, {0xFF, 0x55, 0xFF}, {0xFF, 0xFF, 0x55}, {0xFF, 0xFF, 0xFF},
+};
+static uint32_t vga_palette[16];
+
+/* Every glyph expanded to one all-ones/all-zeros mask per pixel, so a
+ * row of a cell is two selects: (mask & fg) | (~mask & bg) */
+static uint32_t glyph_cache[FONT_GLYPHS][FONT_HEIGHT][FONT_WIDTH] __attribute__((aligned(16)));
+
+/* Areas of the back buffer the framebuffer does not have yet */
+static gfx_rect_t dirty[GFX_MAX_DIRTY];
+static int dirty_count = 0;
+
+static void enable_sse(void) {
+    uint64_t cr0, cr4;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~CR0_EM) | CR0_MP;
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+    
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+static inline v4u splat(uint32_t value) {
+    return (v4u){value, value, value, value};
+}
+
+/* Span helpers: four pixels per store, scalar tail */
+static inline void fill_span(uint32_t* dst, int count, uint32_t color) {
+    v4u c = splat(color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        *(v4u_u*)(dst + i) = c;
+    }
+    for (; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+static inline void copy_span(uint32_t* dst, const uint32_t* src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        v4u a = *(const v4u_u*)(src + i);
+        v4u b = *(const v4u_u*)(src + i + 4);
+        *(v4u_u*)(dst + i) = a;
+        *(v4u_u*)(dst + i + 4) = b;
+    }
+    for (; i + 4 <= count; i += 4) {
+        *(v4u_u*)(dst + i) = *(const v4u_u*)(src + i);
+    }
+    for (; i < count; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/* Per-channel mix of four pixels: (src * a + dst * (256 - a)) >> 8.
+ * Even and odd bytes are split into 16-bit lanes so pmullw does the
+ * multiplies without overflowing (255 * 256 fits). */
+static inline v4u blend4(v4u src, v4u dst, v8w a, v8w inv_a) {
+    v4u low_bytes = splat(0x00FF00FF);
+    v8w src_even = (v8w)(src & low_bytes);
+    v8w dst_even = (v8w)(dst & low_bytes);
+    v8w src_odd = (v8w)((src >> 8) & low_bytes);
+    v8w dst_odd = (v8w)((dst >> 8) & low_bytes);
+    
+    v8w even = (src_even * a + dst_even * inv_a) >> 8;
+    v8w odd = (src_odd * a + dst_odd * inv_a) >> 8;
+    return (v4u)even | ((v4u)odd << 8);
+}
+
+/* Clip a rectangle to the screen (returns 0 if nothing is left) */
+static int clip(int* x, int* y, int* w, int* h) {
+    if (*x < 0) { *w += *x; *x = 0; }
+    if (*y < 0) { *h += *y; *y = 0; }
+    if (*x + *w > width) *w = width - *x;
+    if (*y + *h > height) *h = height - *y;
+    return *w > 0 && *h > 0;
+}
+
+/* Record a clipped area for the next present. Touching or overlapping
+ * rectangles are merged; a full list collapses to its bounding box. */
+static void add_dirty(int x, int y, int w, int h) {
+    for (int i = 0; i < dirty_count; i++) {
+        gfx_rect_t* r = &dirty[i];
+        if (x <= r->x + r->w && r->x <= x + w && y <= r->y + r->h && r->y <= y + h) {
+            int x1 = (x + w > r->x + r->w) ? x + w : r->x + r->w;
+            int y1 = (y + h > r->y + r->h) ? y + h : r->y + r->h;
+            r->x = (x < r->x) ? x : r->x;
+            r->y = (y < r->y) ? y : r->y;
+            r->w = x1 - r->x;
+            r->h = y1 - r->y;
+            return;
+        }
+    }
+    
+    if (dirty_count == GFX_MAX_DIRTY) {
+        int x0 = x, y0 = y, x1 = x + w, y1 = y + h;
+        for (int i = 0; i < dirty_count; i++) {
+            gfx_rect_t* r = &dirty[i];
+            if (r->x < x0) x0 = r->x;
+            if (r->y < y0) y0 = r->y;
+            if (r->x + r->w > x1) x1 = r->x + r->w;
+            if (r->y + r->h > y1) y1 = r->y + r->h;
+        }
+        dirty[0] = (gfx_rect_t){x0, y0, x1 - x0, y1 - y0};
+        dirty_count = 1;
+        return;
+    }
+    
+    dirty[dirty_count++] = (gfx_rect_t){x, y, w, h};
+}
+
+static void build_glyph_cache(void) {
+    for (int g = 0; g < FONT_GLYPHS; g++) {
+        for (int row = 0; row < FONT_HEIGHT; row++) {
+            uint8_t bits = font8x16[g][row];
+            for (int col = 0; col < FONT_WIDTH; col++) {
+                glyph_cache[g][row][col] = (bits & (0x80 >> col)) ? 0xFFFFFFFF : 0;
+            }
+        }
+    }
+}
+
+int gfx_init(const multiboot_fb_t* info) {
+    if (!info) {
+        kprint_info("GFX: No framebuffer, staying in text mode");
+        return 0;
+    }
+    if (info->type != MULTIBOOT_FB_RGB || info->bpp != 32 ||
+        info->red_size != 8 || info->green_size != 8 || info->blue_size != 8) {
+        kprint_info("GFX: Unsupported framebuffer format, staying in text mode");
+        return 0;
+    }
+    
+    /* Pixel rows are kept 16-byte aligned in the back buffer */
+    width = (int)info->width & ~3;
+    height = (int)info->height;
+    
+    uint64_t back_pages = ((uint64_t)width * height * 4 + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t back_phys = pmm_alloc_pages(back_pages);
+    if (!back_phys) {
+        kprint_error("GFX: No memory for the back buffer");
+        return 0;
+    }
+    
+    uint64_t fb_virt = paging_map_io(info->addr, (uint64_t)info->pitch * height, 0);
+    if (!fb_virt) {
+        for (uint64_t i = 0; i < back_pages; i++) {
+            pmm_free_page(back_phys + i * PAGE_SIZE);
+        }
+        kprint_error("GFX: Cannot map the framebuffer");
+        return 0;
+    }
+    
+    fb = (uint8_t*)fb_virt;
+    fb_pitch = info->pitch;
+    back = (uint32_t*)back_phys;
+    red_shift = info->red_pos;
+    green_shift = info->green_pos;
+    blue_shift = info->blue_pos;
+    
+    enable_sse();
+    
+    for (int i = 0; i < 16; i++) {
+        vga_palette[i] = gfx_rgb(vga_palette_rgb[i][0], vga_palette_rgb[i][1],
+                                 vga_palette_rgb[i][2]);
+    }
+    build_glyph_cache();
+    
+    active = 1;
+    gfx_fill_rect(0, 0, width, height, vga_palette[0]);
+    gfx_present();
+    
+    kprint_ok("GFX: Linear framebuffer enabled");
+    return 1;
+}
+
+int gfx_active(void) {
+    return active;
+}
+
+int gfx_width(void) {
+    return width;
+}
+
+int gfx_height(void) {
+    return height;
+}
+
+uint32_t gfx_rgb(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t)r << red_shift) | ((uint32_t)g << green_shift) |
+           ((uint32_t)b << blue_shift);
+}
+
+uint32_t gfx_vga_color(uint8_t index) {
+    return vga_palette[index & 0xF];
+}
+
+void gfx_fill_rect(int x, int y, int w, int h, uint32_t color) {
+    if (!active || !clip(&x, &y, &w, &h)) return;
+    
+    uint64_t flags = irq_save();
+    for (int row = 0; row < h; row++) {
+        fill_span(back + (y + row) * width + x, w, color);
+    }
+    add_dirty(x, y, w, h);
+    irq_restore(flags);
+}
+
+void gfx_frame_rect(int x, int y, int w, int h, int thickness, uint32_t color) {
+    if (thickness * 2 >= w || thickness * 2 >= h) {
+        gfx_fill_rect(x, y, w, h, color);
+        return;
+    }
+    gfx_fill_rect(x, y, w, thickness, color);
+    gfx_fill_rect(x, y + h - thickness, w, thickness, color);
+    gfx_fill_rect(x, y + thickness, thickness, h - 2 * thickness, color);
+    gfx_fill_rect(x + w - thickness, y + thickness, thickness, h - 2 * thickness, color);
+}
+
+void gfx_blend_rect(int x, int y, int w, int h, uint32_t color, uint8_t alpha) {
+    if (!active || !clip(&x, &y, &w, &h)) return;
+    
+    /* Scale 0..255 to 0..256 so 255 is fully opaque */
+    uint16_t a = alpha + (alpha >> 7);
+    uint16_t inv_a = 256 - a;
+    
+    /* No XMM register before interrupts are off */
+    uint64_t flags = irq_save();
+    v8w va = {a, a, a, a, a, a, a, a};
+    v8w vinv = {inv_a, inv_a, inv_a, inv_a, inv_a, inv_a, inv_a, inv_a};
+    v4u src = splat(color);
+    for (int row = 0; row < h; row++) {
+        uint32_t* dst = back + (y + row) * width + x;
+        int i = 0;
+        for (; i + 4 <= w; i += 4) {
+            v4u_u* p = (v4u_u*)(dst + i);
+            *p = blend4(src, *p, va, vinv);
+        }
+        for (; i < w; i++) {
+            v4u one = blend4(src, splat(dst[i]), va, vinv);
+            dst[i] = one[0];
+        }
+    }
+    add_dirty(x, y, w, h);
+    irq_restore(flags);
+}
+
+void gfx_blit(int x, int y, int w, int h, const uint32_t* src, int stride) {
+    int src_x = 0, src_y = 0;
+    if (x < 0) src_x = -x;
+    if (y < 0) src_y = -y;
+    if (!active || !clip(&x, &y, &w, &h)) return;
+    
+    uint64_t flags = irq_save();
+    for (int row = 0; row < h; row++) {
+        copy_span(back + (y + row) * width + x,
+                  src + (src_y + row) * stride + src_x, w);
+    }
+    add_dirty(x, y, w, h);
+    irq_restore(flags);
+}
+
+void gfx_copy_rect(int dst_x, int dst_y, int src_x, int src_y, int w, int h) {
+    if (!active) return;
+    
+    /* Clip the source, then the destination, keeping them in step */
+    int x = src_x, y = src_y;
+    if (!clip(&x, &y, &w, &h)) return;
+    dst_x += x - src_x;
+    dst_y += y - src_y;
+    src_x = x;
+    src_y = y;
+    
+    x = dst_x;
+    y = dst_y;
+    if (!clip(&x, &y, &w, &h)) return;
+    src_x += x - dst_x;
+    src_y += y - dst_y;
+    dst_x = x;
+    dst_y = y;
+    
+    uint64_t flags = irq_save();
+    if (dst_y < src_y || (dst_y == src_y && dst_x <= src_x)) {
+        /* Forward: rows top-down, each row left to right */
+        for (int row = 0; row < h; row++) {
+            copy_span(back + (dst_y + row) * width + dst_x,
+                      back + (src_y + row) * width + src_x, w);
+        }
+    } else if (dst_y > src_y) {
+        /* Backward rows; a row never overlaps itself */
+        for (int row = h - 1; row >= 0; row--) {
+            copy_span(back + (dst_y + row) * width + dst_x,
+                      back + (src_y + row) * width + src_x, w);
+        }
+    } else {
+        /* Same rows, moving right: copy each row from its end */
+        for (int row = 0; row < h; row++) {
+            uint32_t* line = back + (dst_y + row) * width;
+            for (int i = w - 1; i >= 0; i--) {
+                line[dst_x + i] = line[src_x + i];
+            }
+        }
+    }
+    add_dirty(dst_x, dst_y, w, h);
+    irq_restore(flags);
+}
+
+void gfx_draw_glyph(int x, int y, char c, uint32_t fg, uint32_t bg) {
+    if (!active || x < 0 || y < 0 || x + FONT_WIDTH > width || y + FONT_HEIGHT > height) {
+        return;
+    }
+    
+    /* Anything unprintable draws as a blank cell */
+    uint8_t code = (uint8_t)c;
+    int glyph = (code >= FONT_FIRST && code < FONT_FIRST + FONT_GLYPHS) ? code - FONT_FIRST : 0;
+    
+    uint64_t flags = irq_save();
+    v4u vfg = splat(fg);
+    v4u vbg = splat(bg);
+    uint32_t* dst = back + y * width + x;
+    for (int row = 0; row < FONT_HEIGHT; row++) {
+        const v4u* mask = (const v4u*)glyph_cache[glyph][row];
+        v4u m0 = mask[0];
+        v4u m1 = mask[1];
+        *(v4u_u*)dst = (m0 & vfg) | (~m0 & vbg);
+        *(v4u_u*)(dst + 4) = (m1 & vfg) | (~m1 & vbg);
+        dst += width;
+    }
+    add_dirty(x, y, FONT_WIDTH, FONT_HEIGHT);
+    irq_restore(flags);
+}
+
+void gfx_present(void) {
+    if (!active) return;
+    
+    /* Take the list; whatever is drawn meanwhile goes to the next present */
+    gfx_rect_t rects[GFX_MAX_DIRTY];
+    uint64_t flags = irq_save();
+    int count = dirty_count;
+    for (int i = 0; i < count; i++) {
+        rects[i] = dirty[i];
+    }
+    dirty_count = 0;
+    irq_restore(flags);
+    
+    /* A full screen is over a megabyte of uncached writes: interrupts
+     * are only held off for one row at a time */
+    for (int i = 0; i < count; i++) {
+        gfx_rect_t* r = &rects[i];
+        for (int row = r->y; row < r->y + r->h; row++) {
+            flags = irq_save();
+            copy_span((uint32_t*)(fb + (uint64_t)row * fb_pitch) + r->x,
+                      back + row * width + r->x, r->w);
+            irq_restore(flags);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef GFX_H
+#define GFX_H
+
+#include <stdint.h>
+
+#include "multiboot.h"
+
+/* Linear Framebuffer Graphics
+ * Everything draws into a back buffer in RAM; gfx_present() copies the
+ * rectangles touched since the last present to the framebuffer. Only
+ * 32bpp direct-color modes are driven (what QEMU's standard VGA gives).
+ *
+ * The primitives use SSE2 and run with interrupts disabled: XMM state is
+ * not saved on a context switch, so no other thread may run in between.
+ * This file is the only one built with SSE enabled.
+ */
+
+/* Rectangles dirtied before they get merged into one bounding box */
+#define GFX_MAX_DIRTY 16
+
+typedef struct {
+    int x, y;
+    int w, h;
+} gfx_rect_t;
+
+/* Map the framebuffer and allocate the back buffer (returns 0 if the
+ * mode is unusable or there is no framebuffer, leaving text mode) */
+int gfx_init(const multiboot_fb_t* fb);
+
+/* Nonzero once gfx_init() succeeded */
+int gfx_active(void);
+
+/* Screen size in pixels */
+int gfx_width(void);
+int gfx_height(void);
+
+/* Pixel value for an RGB color, and for a VGA text palette index */
+uint32_t gfx_rgb(uint8_t r, uint8_t g, uint8_t b);
+uint32_t gfx_vga_color(uint8_t index);
+
+/* Drawing (clipped to the screen) */
+void gfx_fill_rect(int x, int y, int w, int h, uint32_t color);
+void gfx_frame_rect(int x, int y, int w, int h, int thickness, uint32_t color);
+
+/* Mix color over the rectangle, alpha 0 (no change) to 255 (opaque) */
+void gfx_blend_rect(int x, int y, int w, int h, uint32_t color, uint8_t alpha);
+
+/* Copy w*h pixels from src (stride in pixels) to (x, y) */
+void gfx_blit(int x, int y, int w, int h, const uint32_t* src, int stride);
+
+/* Move a region of the back buffer, overlapping or not */
+void gfx_copy_rect(int dst_x, int dst_y, int src_x, int src_y, int w, int h);
+
+/* Draw one FONT_WIDTH x FONT_HEIGHT character cell (skipped if it does
+ * not fit entirely on screen) */
+void gfx_draw_glyph(int x, int y, char c, uint32_t fg, uint32_t bg);
+
+/* Copy the dirty rectangles to the framebuffer */
+void gfx_present(void);
+
+#endif
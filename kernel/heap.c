@@ -1,13 +1,18 @@
 #include "heap.h"
 #include "pmm.h"
 #include "paging.h"
+#include "reclaim.h"
 #include "panic.h"
 #include "kprint.h"
+#include "counter.h"
+#include "irqtrace.h"
+#include "scheduler.h"
+#include "initcall.h"
 
 #define HEAP_MAGIC 0xDEADBEEF
 #define HEAP_START 0x10000000  /* 256MB virtual address */
 #define HEAP_MAX_SIZE 0x1000000 /* 16MB max heap */
-#define PAGE_SIZE 4096
+#define HEAP_INITIAL_SIZE 0x100000 /* 1MB mapped at boot (never trimmed) */
 
 /* Block header for allocated memory */
 typedef struct block_header {
@@ -17,12 +22,36 @@ typedef struct block_header {
     struct block_header* next;
 } block_header_t;
 
+/* The block list and heap_size only change with interrupts off. Growing
+ * has to allocate pages, which can sleep or reclaim, so it is marked by
+ * a flag instead: one grower at a time, and the shrinker stays out. */
 static block_header_t* heap_start = NULL;
 static uint64_t heap_size = 0;
+static volatile int growing = 0;
+
+static shrinker_t heap_shrinker;
+
+static uint64_t read_heap_used(void* ctx);
+
+static counter_t heap_allocs = {
+    .name = "heap.allocs",
+    .kind = COUNTER_EVENT,
+};
+
+static counter_t heap_frees = {
+    .name = "heap.frees",
+    .kind = COUNTER_EVENT,
+};
+
+static counter_t heap_used = {
+    .name = "heap.used_bytes",
+    .kind = COUNTER_GAUGE,
+    .read = read_heap_used,
+};
 
 void heap_init(void) {
     /* Map initial heap pages (1MB) */
-    for (uint64_t vaddr = HEAP_START; vaddr < HEAP_START + 0x100000; vaddr += PAGE_SIZE) {
+    for (uint64_t vaddr = HEAP_START; vaddr < HEAP_START + HEAP_INITIAL_SIZE; vaddr += PAGE_SIZE) {
         uint64_t paddr = pmm_alloc_page();
         paging_map_page(vaddr, paddr, PAGE_PRESENT | PAGE_WRITE);
     }
@@ -30,22 +59,142 @@ void heap_init(void) {
     /* Initialize first block */
     heap_start = (block_header_t*)HEAP_START;
     heap_start->magic = HEAP_MAGIC;
-    heap_start->size = 0x100000 - sizeof(block_header_t);
+    heap_start->size = HEAP_INITIAL_SIZE - sizeof(block_header_t);
     heap_start->is_free = 1;
     heap_start->next = NULL;
     
-    heap_size = 0x100000;
+    heap_size = HEAP_INITIAL_SIZE;
+    shrinker_register(&heap_shrinker);
+    counter_register(&heap_allocs);
+    counter_register(&heap_frees);
+    counter_register(&heap_used);
     
     kprint_ok("Heap allocator initialized (1MB at 0x10000000)");
 }
+INITCALL(INIT_MEMORY, heap_init, "paging_enable");
 
-void* heap_alloc(size_t size) {
-    if (size == 0) return NULL;
+static block_header_t* last_block(void) {
+    block_header_t* block = heap_start;
+    while (block->next) {
+        block = block->next;
+    }
+    return block;
+}
+
+/* Map more pages at the end of the heap (returns 0 if none were mapped;
+ * 1 also when another grower finished first, so search again) */
+static int heap_grow(uint64_t bytes, uint32_t flags) {
+    uint64_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
     
-    /* Align size to 16 bytes */
-    size = (size + 15) & ~15;
+    uint64_t irq = irq_save();
+    if (growing) {
+        irq_restore(irq);
+        if (!(flags & (ALLOC_WAIT | ALLOC_NOFAIL)) || (flags & ALLOC_ATOMIC)) {
+            return 0;
+        }
+        while (growing) {
+            scheduler_yield();
+        }
+        return 1;
+    }
+    if (heap_size + pages * PAGE_SIZE > HEAP_MAX_SIZE) {
+        irq_restore(irq);
+        return 0;
+    }
+    growing = 1;
+    uint64_t start = HEAP_START + heap_size;
+    irq_restore(irq);
+    
+    /* The pages past heap_size are ours until they are added below */
+    uint64_t added = 0;
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t paddr = pmm_alloc_page_flags(flags & ~ALLOC_NOFAIL);
+        if (!paddr) break;
+        paging_map_page(start + added, paddr, PAGE_PRESENT | PAGE_WRITE);
+        added += PAGE_SIZE;
+    }
+    if (added == 0) {
+        growing = 0;
+        return 0;
+    }
+    
+    /* Extend a free tail block, or start a new one */
+    irq = irq_save();
+    block_header_t* last = last_block();
+    if (last->is_free) {
+        last->size += added;
+    } else {
+        block_header_t* block = (block_header_t*)start;
+        block->magic = HEAP_MAGIC;
+        block->size = added - sizeof(block_header_t);
+        block->is_free = 1;
+        block->next = NULL;
+        last->next = block;
+    }
+    heap_size += added;
+    growing = 0;
+    irq_restore(irq);
+    return 1;
+}
+
+/* First address of the free tail that could be unmapped (heap end if none) */
+static uint64_t trim_start(void) {
+    uint64_t heap_end = HEAP_START + heap_size;
+    block_header_t* last = last_block();
+    if (!last->is_free) {
+        return heap_end;
+    }
+    
+    /* Keep the header and a minimal block */
+    uint64_t start = ((uint64_t)last + sizeof(block_header_t) + 16 + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+    if (start < HEAP_START + HEAP_INITIAL_SIZE) {
+        start = HEAP_START + HEAP_INITIAL_SIZE;
+    }
+    return start < heap_end ? start : heap_end;
+}
+
+/* Shrinker callbacks run with interrupts off, so no list walk or free is
+ * in progress; a grower may be, holding pages past heap_size */
+static uint64_t heap_shrink_count(void) {
+    if (growing) {
+        return 0;
+    }
+    return (HEAP_START + heap_size - trim_start()) / PAGE_SIZE;
+}
+
+static uint64_t heap_shrink_scan(uint64_t target) {
+    if (growing) {
+        return 0;
+    }
+    uint64_t heap_end = HEAP_START + heap_size;
+    uint64_t start = trim_start();
+    if (start + target * PAGE_SIZE < heap_end) {
+        start = heap_end - target * PAGE_SIZE;
+    }
+    if (start >= heap_end) {
+        return 0;
+    }
     
-    /* Find free block */
+    block_header_t* last = last_block();
+    last->size = start - ((uint64_t)last + sizeof(block_header_t));
+    heap_size = start - HEAP_START;
+    
+    tlb_gather_t g;
+    tlb_gather_init(&g, paging_kernel_root());
+    uint64_t freed = paging_unmap_range_in(paging_kernel_root(), start, heap_end,
+                                           PAGING_UNMAP_RELEASE, &g);
+    tlb_gather_flush(&g);
+    return freed;
+}
+
+static shrinker_t heap_shrinker = {
+    .name = "heap",
+    .count = heap_shrink_count,
+    .scan = heap_shrink_scan,
+};
+
+/* Find a free block and split it (NULL if none fits) */
+static void* heap_find(size_t size) {
     block_header_t* current = heap_start;
     while (current) {
         if (current->magic != HEAP_MAGIC) {
@@ -73,11 +222,37 @@ void* heap_alloc(size_t size) {
         current = current->next;
     }
     
-    /* No suitable block found */
-    panic("Heap: Out of memory");
     return NULL;
 }
 
+void* heap_alloc_flags(size_t size, uint32_t flags) {
+    if (size == 0) return NULL;
+    
+    /* Align size to 16 bytes */
+    size = (size + 15) & ~15;
+    
+    uint64_t irq = irq_save();
+    void* ptr = heap_find(size);
+    irq_restore(irq);
+    while (!ptr && heap_grow(size + sizeof(block_header_t), flags)) {
+        irq = irq_save();
+        ptr = heap_find(size);
+        irq_restore(irq);
+    }
+    
+    if (!ptr && (flags & ALLOC_NOFAIL)) {
+        panic("Heap: Out of memory");
+    }
+    if (ptr) {
+        counter_inc(&heap_allocs);
+    }
+    return ptr;
+}
+
+void* heap_alloc(size_t size) {
+    return heap_alloc_flags(size, ALLOC_WAIT);
+}
+
 void heap_free(void* ptr) {
     if (!ptr) return;
     
@@ -91,7 +266,9 @@ void heap_free(void* ptr) {
         panic("Heap: Double free detected");
     }
     
+    uint64_t irq = irq_save();
     block->is_free = 1;
+    counter_inc(&heap_frees);
     
     /* Coalesce with next block if free */
     if (block->next && block->next->is_free) {
@@ -109,9 +286,18 @@ void heap_free(void* ptr) {
         current->size += sizeof(block_header_t) + block->size;
         current->next = block->next;
     }
+    irq_restore(irq);
+}
+
+static uint64_t read_heap_used(void* ctx) {
+    (void)ctx;
+    uint64_t total, used, free;
+    heap_stats(&total, &used, &free);
+    return used;
 }
 
 void heap_stats(uint64_t* total, uint64_t* used, uint64_t* free) {
+    uint64_t irq = irq_save();
     *total = heap_size;
     *used = 0;
     *free = 0;
@@ -125,4 +311,5 @@ void heap_stats(uint64_t* total, uint64_t* used, uint64_t* free) {
         }
         current = current->next;
     }
+    irq_restore(irq);
 }
@@ -5,15 +5,21 @@
 #include <stdint.h>
 
 /* Improved heap allocator with free() support
- * Uses a linked list of free blocks
+ * Uses a linked list of free blocks. The heap starts at 1MB and grows
+ * up to 16MB; a shrinker gives free pages at the tail back under
+ * memory pressure.
  */
 
 /* Initialize heap allocator */
 void heap_init(void);
 
-/* Allocate memory from heap */
+/* Allocate memory from heap (NULL if memory ran out even after reclaim)
+ * Same as heap_alloc_flags(size, ALLOC_WAIT) */
 void* heap_alloc(size_t size);
 
+/* Allocate with ALLOC_* flags from pmm.h; the heap grows on demand */
+void* heap_alloc_flags(size_t size, uint32_t flags);
+
 /* Free memory back to heap */
 void heap_free(void* ptr);
 
@@ -1,5 +1,7 @@
 #include "idt.h"
 #include "kprint.h"
+#include "gdt.h"
+#include "initcall.h"
 
 static struct idt_entry idt[IDT_ENTRIES];
 static struct idt_ptr idt_descriptor;
@@ -69,6 +71,14 @@ static void idt_set_entry(int vector, uint64_t handler, uint8_t type_attr) {
     idt[vector].zero        = 0;
 }
 
+void idt_set_handler(int vector, void (*handler)(void)) {
+    idt_set_entry(vector, (uint64_t)handler, 0x8E);
+}
+
+void idt_set_ist(int vector, uint8_t ist) {
+    idt[vector].ist = ist & 0x7;
+}
+
 void idt_init(void) {
     /* Zero out the entire IDT */
     for (int i = 0; i < IDT_ENTRIES; i++) {
@@ -109,6 +119,11 @@ void idt_init(void) {
     idt_set_entry(30, (uint64_t)isr30, 0x8E);
     idt_set_entry(31, (uint64_t)isr31, 0x8E);
 
+    /* Critical exceptions run on their own stacks (see gdt.c), so a
+     * kernel stack overflow is still reported instead of triple faulting */
+    idt_set_ist(8, IST_DOUBLE_FAULT);
+    idt_set_ist(14, IST_PAGE_FAULT);
+
     /* Install IRQ handlers (32-47) */
     idt_set_entry(32, (uint64_t)irq0_handler, 0x8E);   // Timer
     idt_set_entry(33, (uint64_t)irq1_handler, 0x8E);   // Keyboard
@@ -132,3 +147,4 @@ void idt_init(void) {
     idt_descriptor.base  = (uint64_t)&idt;
     idt_load(&idt_descriptor);
 }
+INITCALL(INIT_EARLY, idt_init, "gdt_init");
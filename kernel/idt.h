@@ -22,4 +22,10 @@ struct idt_ptr {
 
 void idt_init(void);
 
+/* Install a kernel interrupt gate for a vector */
+void idt_set_handler(int vector, void (*handler)(void));
+
+/* Run an interrupt vector on an Interrupt Stack Table slot (1-7) */
+void idt_set_ist(int vector, uint8_t ist);
+
 #endif
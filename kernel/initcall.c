@@ -0,0 +1,204 @@
+#include "initcall.h"
+#include "clock.h"
+#include "klog.h"
+#include "panic.h"
+#include "process.h"
+#include "scheduler.h"
+#include "irqtrace.h"
+
+#define INITCALL_MAX        64
+#define BOOT_MAX_STAGES     80
+#define DEFERRED_STACK_SIZE 8192
+
+#define STAGE_MARK          0xFF    /* A point in time, not an initcall */
+
+/* Linker script: every INITCALL() record, sorted by level */
+extern const initcall_t initcall_start[];
+extern const initcall_t initcall_end[];
+
+typedef struct {
+    const char* name;
+    uint32_t level;
+    uint64_t start;             /* TSC */
+    uint64_t end;
+} boot_stage_t;
+
+static boot_stage_t stages[BOOT_MAX_STAGES];
+static uint32_t stage_count = 0;
+
+static uint8_t done[INITCALL_MAX];
+
+static process_t* deferred_proc = NULL;
+static volatile int ui_ready = 0;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static int names_equal(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static void record_stage(const char* name, uint32_t level, uint64_t start, uint64_t end) {
+    uint64_t flags = irq_save();
+    if (stage_count < BOOT_MAX_STAGES) {
+        boot_stage_t* stage = &stages[stage_count++];
+        stage->name = name;
+        stage->level = level;
+        stage->start = start;
+        stage->end = end;
+    }
+    irq_restore(flags);
+}
+
+void initcall_mark(const char* event) {
+    uint64_t now = rdtsc();
+    record_stage(event, STAGE_MARK, now, now);
+}
+
+static uint32_t initcall_count(void) {
+    return (uint32_t)(initcall_end - initcall_start);
+}
+
+static const initcall_t* find_initcall(const char* name) {
+    for (const initcall_t* call = initcall_start; call < initcall_end; call++) {
+        if (names_equal(call->name, name)) {
+            return call;
+        }
+    }
+    return NULL;
+}
+
+/* Nonzero once every dependency of call has run */
+static int deps_done(const initcall_t* call) {
+    for (const char* const* dep = call->deps; *dep; dep++) {
+        const initcall_t* target = find_initcall(*dep);
+        if (!target) {
+            klog(LOG_ERROR, "initcall %s: unknown dependency %s", call->name, *dep);
+            panic("Initcall depends on a missing initcall");
+        }
+        if (target->level > call->level) {
+            klog(LOG_ERROR, "initcall %s: %s runs at a later level", call->name, *dep);
+            panic("Initcall depends on a later level");
+        }
+        if (!done[target - initcall_start]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Run one level: each pass runs whatever is ready, until all have run */
+static void run_level(uint32_t level) {
+    uint32_t count = initcall_count();
+    if (count > INITCALL_MAX) {
+        panic("Too many initcalls");
+    }
+    
+    int progress = 1;
+    while (progress) {
+        progress = 0;
+        int pending = 0;
+        
+        for (uint32_t i = 0; i < count; i++) {
+            const initcall_t* call = &initcall_start[i];
+            if (call->level != level || done[i]) {
+                continue;
+            }
+            if (!deps_done(call)) {
+                pending = 1;
+                continue;
+            }
+            
+            uint64_t start = rdtsc();
+            call->fn();
+            record_stage(call->name, level, start, rdtsc());
+            done[i] = 1;
+            progress = 1;
+        }
+        
+        if (pending && !progress) {
+            klog(LOG_ERROR, "initcall level %u: dependency cycle", level);
+            panic("Initcall dependency cycle");
+        }
+    }
+}
+
+void initcall_run_boot(void) {
+    for (uint32_t level = INIT_EARLY; level <= INIT_DEVICE; level++) {
+        run_level(level);
+    }
+}
+
+/* Log the timeline relative to the first stage */
+static void report_timeline(void) {
+    uint64_t hz = clock_tsc_hz();
+    uint64_t base = stages[0].start;
+    const char* unit = "ms";
+    const char* small_unit = "us";
+    
+    /* Uncalibrated: the same figures count thousands of cycles */
+    if (!hz) {
+        hz = 1000000000ULL;
+        unit = "Mc";
+        small_unit = "kc";
+    }
+    
+    for (uint32_t i = 0; i < stage_count; i++) {
+        boot_stage_t* stage = &stages[i];
+        uint64_t at = (stage->start - base) * 1000000 / hz;
+        if (stage->level == STAGE_MARK) {
+            klog(LOG_INFO, "boot %6lu.%03lu %s            %s",
+                 at / 1000, at % 1000, unit, stage->name);
+        } else {
+            uint64_t took = (stage->end - stage->start) * 1000000 / hz;
+            klog(LOG_INFO, "boot %6lu.%03lu %s %6lu %s L%u %s",
+                 at / 1000, at % 1000, unit, took, small_unit, stage->level, stage->name);
+        }
+    }
+}
+
+/* Waits for the first frame, runs INIT_DEFERRED, reports, exits */
+static void deferred_task(void) {
+    uint64_t flags = irq_save();
+    while (!ui_ready) {
+        scheduler_block();
+    }
+    irq_restore(flags);
+    
+    run_level(INIT_DEFERRED);
+    initcall_mark("deferred done");
+    report_timeline();
+    process_exit();
+}
+
+void initcall_start_deferred(void) {
+    deferred_proc = process_create(deferred_task, DEFERRED_STACK_SIZE);
+    if (!deferred_proc) {
+        /* Still run them, just not in the background */
+        klog(LOG_WARN, "No deferred init task, running deferred initcalls now");
+        run_level(INIT_DEFERRED);
+        return;
+    }
+    scheduler_add(deferred_proc);
+}
+
+void initcall_ui_ready(void) {
+    if (ui_ready) {
+        return;
+    }
+    initcall_mark("first frame");
+    
+    uint64_t flags = irq_save();
+    ui_ready = 1;
+    if (deferred_proc) {
+        scheduler_wake(deferred_proc);
+    }
+    irq_restore(flags);
+}
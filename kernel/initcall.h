@@ -0,0 +1,68 @@
+#ifndef INITCALL_H
+#define INITCALL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Initcalls and Boot Timeline
+ * Subsystems register their setup function next to its definition
+ * instead of kernel_main() calling each one in a fixed sequence:
+ *
+ *   INITCALL(INIT_MEMORY, heap_init, "paging_enable");
+ *
+ * Each registration is a record in the .initcall.<level> linker
+ * section. Levels run in order; inside a level an initcall runs once
+ * every named dependency has (a dependency may also be an initcall of
+ * an earlier level). Levels up to INIT_DEVICE run at boot with
+ * interrupts off. INIT_DEFERRED runs in a background task once the UI
+ * has shown its first frame, so it does not delay the first screen.
+ *
+ * Every initcall is timed with the TSC; the timeline is logged once the
+ * deferred work is done.
+ */
+
+#define INIT_EARLY      0   /* CPU tables, legacy PIC */
+#define INIT_MEMORY     1   /* Physical memory, paging, heap */
+#define INIT_PLATFORM   2   /* Console, interrupt controller, clocks */
+#define INIT_CORE       3   /* Processes, scheduler, fibers */
+#define INIT_DEVICE     4   /* Interrupt sources (enabled right after) */
+#define INIT_DEFERRED   5   /* Background, after the first frame */
+#define INIT_LEVELS     6
+
+typedef struct {
+    const char* name;
+    void (*fn)(void);
+    uint32_t level;
+    const char* const* deps;    /* NULL-terminated initcall names */
+} initcall_t;
+
+#define INITCALL_STR(x)     #x
+#define INITCALL_XSTR(x)    INITCALL_STR(x)
+
+/* Register func at level lvl, after the initcalls named in the rest */
+#define INITCALL(lvl, func, ...)                                            \
+    static const char* const initcall_deps_##func[] = {                     \
+        __VA_OPT__(__VA_ARGS__,) NULL                                       \
+    };                                                                      \
+    static const initcall_t initcall_##func                                 \
+        __attribute__((used, aligned(8),                                    \
+                       section(".initcall." INITCALL_XSTR(lvl)))) = {       \
+        .name = #func,                                                      \
+        .fn = func,                                                         \
+        .level = lvl,                                                       \
+        .deps = initcall_deps_##func,                                       \
+    }
+
+/* Run every level up to INIT_DEVICE (interrupts still off) */
+void initcall_run_boot(void);
+
+/* Start the task that runs INIT_DEFERRED once the UI is up */
+void initcall_start_deferred(void);
+
+/* The UI has drawn its first frame: release the deferred initcalls */
+void initcall_ui_ready(void);
+
+/* Record a point in the boot timeline */
+void initcall_mark(const char* event);
+
+#endif
@@ -0,0 +1,429 @@
+#include "ipc.h"
+#include "process.h"
+#include "scheduler.h"
+#include "vmspace.h"
+#include "vma.h"
+#include "pmm.h"
+#include "heap.h"
+#include "kprint.h"
+#include "irqtrace.h"
+#include "initcall.h"
+
+#include <stddef.h>
+
+#define SLOT_MASK (IPC_PORT_SLOTS - 1)
+
+/* Ring slot: seq == position when free, position + 1 when filled */
+typedef struct {
+    volatile uint64_t seq;
+    ipc_msg_t msg;
+    uint64_t* frames;           /* Detached frames travelling with msg */
+} ipc_slot_t;
+
+typedef struct {
+    int used;
+    uint32_t owner;             /* PID allowed to receive */
+    volatile uint64_t head;     /* Next position to dequeue */
+    volatile uint64_t tail;     /* Next position to enqueue */
+    process_t* waiter;          /* Owner blocked in ipc_receive() */
+    ipc_slot_t slots[IPC_PORT_SLOTS];
+} ipc_port_t;
+
+/* Outstanding call (lives on the caller's kernel stack) */
+typedef struct ipc_call {
+    int port;
+    volatile int done;
+    int status;
+    ipc_msg_t reply;
+    uint64_t* frames;
+} ipc_call_t;
+
+static ipc_port_t ports[IPC_MAX_PORTS];
+
+static void msg_copy(ipc_msg_t* dst, const ipc_msg_t* src) {
+    const uint64_t* s = (const uint64_t*)src;
+    uint64_t* d = (uint64_t*)dst;
+    for (uint64_t i = 0; i < sizeof(ipc_msg_t) / 8; i++) {
+        d[i] = s[i];
+    }
+}
+
+static ipc_port_t* port_get(int port) {
+    if (port < 0 || port >= IPC_MAX_PORTS || !ports[port].used) {
+        return NULL;
+    }
+    return &ports[port];
+}
+
+/* ---- Lock-free bounded ring (multi-producer) ---- */
+
+static int ring_push(ipc_port_t* port, const ipc_msg_t* msg, uint64_t* frames) {
+    uint64_t pos = __atomic_load_n(&port->tail, __ATOMIC_RELAXED);
+    ipc_slot_t* slot;
+
+    for (;;) {
+        slot = &port->slots[pos & SLOT_MASK];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&port->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;  /* Full */
+        } else {
+            pos = __atomic_load_n(&port->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    msg_copy(&slot->msg, msg);
+    slot->frames = frames;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int ring_pop(ipc_port_t* port, ipc_msg_t* msg, uint64_t** frames) {
+    uint64_t pos = __atomic_load_n(&port->head, __ATOMIC_RELAXED);
+    ipc_slot_t* slot;
+
+    for (;;) {
+        slot = &port->slots[pos & SLOT_MASK];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - (pos + 1));
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&port->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;  /* Empty */
+        } else {
+            pos = __atomic_load_n(&port->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    msg_copy(msg, &slot->msg);
+    *frames = slot->frames;
+    __atomic_store_n(&slot->seq, pos + IPC_PORT_SLOTS, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* ---- Page transfer ---- */
+
+/* Take the sender's pages for a message bound to receiver */
+static int pages_take(ipc_msg_t* msg, process_t* receiver, uint64_t** frames) {
+    process_t* sender = process_current();
+    *frames = NULL;
+
+    if (msg->page_count == 0) {
+        msg->page_addr = 0;
+        return IPC_OK;
+    }
+    if (msg->page_count > IPC_MAX_PAGES || !receiver) {
+        return IPC_ERR_INVALID;
+    }
+
+    /* Both sides must be user processes, or both kernel processes */
+    if (!sender->vm != !receiver->vm) {
+        return IPC_ERR_INVALID;
+    }
+    if (!sender->vm) {
+        return IPC_OK;  /* Shared kernel mappings: pass the address through */
+    }
+
+    uint64_t* list = heap_alloc(msg->page_count * sizeof(uint64_t));
+    if (!list) {
+        return IPC_ERR_INVALID;
+    }
+    if (!vm_detach_pages(sender->vm, msg->page_addr, msg->page_count, list)) {
+        heap_free(list);
+        return IPC_ERR_INVALID;
+    }
+    *frames = list;
+    return IPC_OK;
+}
+
+/* Give pages back to the sender after a failed send */
+static void pages_return(ipc_msg_t* msg, uint64_t* frames) {
+    if (!frames) {
+        return;
+    }
+    vm_attach_pages(process_current()->vm, msg->page_addr, frames, msg->page_count,
+                    VM_PROT_READ | VM_PROT_WRITE, VM_MAP_FIXED);
+    heap_free(frames);
+}
+
+/* Map received pages into the current process */
+static void pages_deliver(ipc_msg_t* msg, uint64_t* frames) {
+    if (!frames) {
+        return;
+    }
+
+    msg->page_addr = vm_attach_pages(process_current()->vm, 0, frames, msg->page_count,
+                                     VM_PROT_READ | VM_PROT_WRITE, 0);
+    if (!msg->page_addr) {
+        /* No room in the receiver: the payload is lost */
+        for (uint32_t i = 0; i < msg->page_count; i++) {
+            pmm_page_unref(frames[i]);
+        }
+        msg->page_count = 0;
+    }
+    heap_free(frames);
+}
+
+/* Drop pages of a message that will never be received */
+static void pages_drop(ipc_msg_t* msg, uint64_t* frames) {
+    if (!frames) {
+        return;
+    }
+    for (uint32_t i = 0; i < msg->page_count; i++) {
+        pmm_page_unref(frames[i]);
+    }
+    heap_free(frames);
+}
+
+/* Complete a call without a reply */
+static void call_fail(uint32_t pid, int status) {
+    process_t* caller = process_get(pid);
+    if (!caller || !caller->ipc_call) {
+        return;
+    }
+
+    ipc_call_t* call = caller->ipc_call;
+    caller->ipc_call = NULL;
+    call->status = status;
+    call->frames = NULL;
+    call->done = 1;
+    scheduler_wake(caller);
+}
+
+/* ---- Public API ---- */
+
+void ipc_init(void) {
+    for (int i = 0; i < IPC_MAX_PORTS; i++) {
+        ports[i].used = 0;
+    }
+    kprint_ok("IPC ports initialized");
+}
+INITCALL(INIT_DEFERRED, ipc_init);
+
+int ipc_port_create(void) {
+    uint64_t flags = irq_save();
+
+    for (int i = 0; i < IPC_MAX_PORTS; i++) {
+        ipc_port_t* port = &ports[i];
+        if (port->used) {
+            continue;
+        }
+
+        port->used = 1;
+        port->owner = process_current()->pid;
+        port->head = 0;
+        port->tail = 0;
+        port->waiter = NULL;
+        for (uint64_t s = 0; s < IPC_PORT_SLOTS; s++) {
+            port->slots[s].seq = s;
+            port->slots[s].frames = NULL;
+        }
+
+        irq_restore(flags);
+        return i;
+    }
+
+    irq_restore(flags);
+    return -1;
+}
+
+void ipc_port_destroy(int id) {
+    uint64_t flags = irq_save();
+
+    ipc_port_t* port = port_get(id);
+    if (!port) {
+        irq_restore(flags);
+        return;
+    }
+    port->used = 0;
+
+    /* Drop queued messages; callers get an error instead of a reply */
+    ipc_msg_t msg;
+    uint64_t* frames;
+    while (ring_pop(port, &msg, &frames)) {
+        pages_drop(&msg, frames);
+        if (msg.flags & IPC_MSG_CALL) {
+            call_fail(msg.sender, IPC_ERR_INVALID);
+        }
+    }
+
+    /* Calls already received but never answered */
+    for (uint32_t pid = 0; pid < MAX_PROCESSES; pid++) {
+        process_t* proc = process_get(pid);
+        if (proc && proc->ipc_call && proc->ipc_call->port == id) {
+            call_fail(pid, IPC_ERR_INVALID);
+        }
+    }
+
+    if (port->waiter) {
+        scheduler_wake(port->waiter);
+        port->waiter = NULL;
+    }
+
+    irq_restore(flags);
+}
+
+int ipc_send(int id, ipc_msg_t* msg) {
+    ipc_port_t* port = port_get(id);
+    if (!port || msg->len > IPC_INLINE_MAX) {
+        return IPC_ERR_INVALID;
+    }
+
+    uint64_t* frames;
+    int status = pages_take(msg, process_get(port->owner), &frames);
+    if (status != IPC_OK) {
+        return status;
+    }
+
+    msg->sender = process_current()->pid;
+    msg->flags = 0;
+
+    uint64_t flags = irq_save();
+    if (!ring_push(port, msg, frames)) {
+        irq_restore(flags);
+        pages_return(msg, frames);
+        return IPC_ERR_FULL;
+    }
+
+    process_t* waiter = port->waiter;
+    if (waiter) {
+        port->waiter = NULL;
+        scheduler_wake(waiter);
+    }
+    irq_restore(flags);
+    return IPC_OK;
+}
+
+int ipc_receive(int id, ipc_msg_t* msg) {
+    process_t* current = process_current();
+    uint64_t* frames;
+
+    uint64_t flags = irq_save();
+    for (;;) {
+        ipc_port_t* port = port_get(id);
+        if (!port || port->owner != current->pid) {
+            irq_restore(flags);
+            return IPC_ERR_INVALID;
+        }
+        if (ring_pop(port, msg, &frames)) {
+            break;
+        }
+        port->waiter = current;
+        scheduler_block();
+        if (port->waiter == current) {
+            port->waiter = NULL;  /* Woke up early; registered again if still empty */
+        }
+    }
+    irq_restore(flags);
+
+    pages_deliver(msg, frames);
+    return IPC_OK;
+}
+
+int ipc_call(int id, ipc_msg_t* msg, ipc_msg_t* reply) {
+    process_t* current = process_current();
+    ipc_port_t* port = port_get(id);
+    if (!port || msg->len > IPC_INLINE_MAX || port->owner == current->pid) {
+        return IPC_ERR_INVALID;
+    }
+
+    uint64_t* frames;
+    int status = pages_take(msg, process_get(port->owner), &frames);
+    if (status != IPC_OK) {
+        return status;
+    }
+
+    msg->sender = current->pid;
+    msg->flags = IPC_MSG_CALL;
+
+    ipc_call_t call;
+    call.port = id;
+    call.done = 0;
+    call.status = IPC_OK;
+    call.frames = NULL;
+
+    uint64_t flags = irq_save();
+    current->ipc_call = &call;
+    if (!ring_push(port, msg, frames)) {
+        current->ipc_call = NULL;
+        irq_restore(flags);
+        pages_return(msg, frames);
+        return IPC_ERR_FULL;
+    }
+
+    /* Fast path: the server is waiting, run it right now */
+    process_t* server = port->waiter;
+    if (server && server->state == PROCESS_BLOCKED) {
+        port->waiter = NULL;
+        current->state = PROCESS_BLOCKED;
+        current->time_slice = 0;
+        scheduler_handoff(server);
+    }
+
+    while (!call.done) {
+        scheduler_block();
+    }
+    irq_restore(flags);
+
+    if (call.status == IPC_OK) {
+        msg_copy(reply, &call.reply);
+        pages_deliver(reply, call.frames);
+    }
+    return call.status;
+}
+
+int ipc_reply(uint32_t pid, ipc_msg_t* reply) {
+    process_t* current = process_current();
+    process_t* caller = process_get(pid);
+    if (!caller || !caller->ipc_call || reply->len > IPC_INLINE_MAX) {
+        return IPC_ERR_INVALID;
+    }
+
+    /* Only the owner of the called port may answer */
+    ipc_port_t* port = port_get(caller->ipc_call->port);
+    if (!port || port->owner != current->pid) {
+        return IPC_ERR_INVALID;
+    }
+
+    uint64_t* frames;
+    int status = pages_take(reply, caller, &frames);
+    if (status != IPC_OK) {
+        return status;
+    }
+
+    reply->sender = current->pid;
+    reply->flags = 0;
+
+    uint64_t flags = irq_save();
+    ipc_call_t* call = caller->ipc_call;
+    caller->ipc_call = NULL;
+    msg_copy(&call->reply, reply);
+    call->frames = frames;
+    call->status = IPC_OK;
+    call->done = 1;
+
+    /* Fast path: hand the CPU straight back to the caller */
+    if (caller->state == PROCESS_BLOCKED) {
+        scheduler_handoff(caller);
+    }
+    irq_restore(flags);
+    return IPC_OK;
+}
+
+void ipc_process_exit(uint32_t pid) {
+    for (int i = 0; i < IPC_MAX_PORTS; i++) {
+        if (ports[i].used && ports[i].owner == pid) {
+            ipc_port_destroy(i);
+        }
+    }
+}
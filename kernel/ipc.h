@@ -0,0 +1,68 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+
+/* Message Ports
+ * A port is a bounded lock-free ring of fixed-size messages owned by
+ * the process that created it; only the owner receives from it.
+ *
+ * Small payloads (up to IPC_INLINE_MAX bytes) are copied inline.
+ * Large payloads are transferred by page: the sender's pages are
+ * unmapped and the same frames are mapped into the receiver, so the
+ * data is never copied. Between kernel processes (which share one
+ * address space) page_addr is handed over unchanged.
+ *
+ * ipc_call() sends and waits for a reply. If the owner is already
+ * waiting in ipc_receive(), the caller switches straight to it, and
+ * ipc_reply() switches straight back, skipping the run queue.
+ */
+
+#define IPC_MAX_PORTS   32
+#define IPC_PORT_SLOTS  16      /* Ring capacity (power of two) */
+#define IPC_INLINE_MAX  64      /* Bytes copied inline */
+#define IPC_MAX_PAGES   256     /* Pages per transfer (1MB) */
+
+/* Message flags */
+#define IPC_MSG_CALL    0x1     /* Sender waits for ipc_reply() */
+
+/* Results */
+#define IPC_OK           0
+#define IPC_ERR_INVALID -1      /* Bad port, buffer or page range */
+#define IPC_ERR_FULL    -2      /* Port ring is full */
+
+typedef struct {
+    uint32_t sender;            /* PID (filled in by the kernel) */
+    uint32_t tag;               /* Free for the protocol */
+    uint16_t flags;             /* IPC_MSG_* (filled in by the kernel) */
+    uint16_t len;               /* Inline bytes used */
+    uint32_t page_count;        /* Pages transferred with the message */
+    uint64_t page_addr;         /* Sender: pages to give away; receiver: where they landed */
+    uint8_t data[IPC_INLINE_MAX];
+} ipc_msg_t;
+
+/* Initialize the port table */
+void ipc_init(void);
+
+/* Create a port owned by the current process (returns id, -1 if none free) */
+int ipc_port_create(void);
+
+/* Destroy a port; queued messages are dropped and their callers failed */
+void ipc_port_destroy(int port);
+
+/* Queue a message without waiting */
+int ipc_send(int port, ipc_msg_t* msg);
+
+/* Wait for the next message on a port owned by the current process */
+int ipc_receive(int port, ipc_msg_t* msg);
+
+/* Send a message and wait for its reply */
+int ipc_call(int port, ipc_msg_t* msg, ipc_msg_t* reply);
+
+/* Answer a call received from process pid */
+int ipc_reply(uint32_t pid, ipc_msg_t* reply);
+
+/* Release the ports of an exiting process */
+void ipc_process_exit(uint32_t pid);
+
+#endif
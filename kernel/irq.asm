@@ -1,18 +1,52 @@
 ; IRQ Handlers (IRQ 0-15 mapped to interrupts 32-47)
+; Each line pushes its number and joins one common stub, which hands a
+; register frame to irq_dispatch() in irq.c.
 
 global irq0_handler, irq1_handler, irq2_handler, irq3_handler
 global irq4_handler, irq5_handler, irq6_handler, irq7_handler
 global irq8_handler, irq9_handler, irq10_handler, irq11_handler
 global irq12_handler, irq13_handler, irq14_handler, irq15_handler
 
-extern timer_handler
-extern keyboard_handler
-extern pic_send_eoi
+extern irq_dispatch
 
-; Macro for IRQ handlers
-%macro IRQ_HANDLER 2
+global apic_spurious_handler
+
+; Macro for IRQ entry points
+; %1 = IRQ number
+%macro IRQ_HANDLER 1
 irq%1_handler:
-    ; Save all registers
+    push qword %1         ; IRQ number
+    jmp irq_common_stub
+%endmacro
+
+; IRQ Handlers
+IRQ_HANDLER 0       ; PIT Timer
+IRQ_HANDLER 1       ; Keyboard
+IRQ_HANDLER 2       ; Cascade (never raised)
+IRQ_HANDLER 3       ; COM2
+IRQ_HANDLER 4       ; COM1
+IRQ_HANDLER 5       ; LPT2
+IRQ_HANDLER 6       ; Floppy
+IRQ_HANDLER 7       ; LPT1
+IRQ_HANDLER 8       ; RTC
+IRQ_HANDLER 9       ; Peripherals
+IRQ_HANDLER 10      ; Peripherals
+IRQ_HANDLER 11      ; Peripherals
+IRQ_HANDLER 12      ; PS/2 Mouse
+IRQ_HANDLER 13      ; FPU
+IRQ_HANDLER 14      ; Primary ATA
+IRQ_HANDLER 15      ; Secondary ATA
+
+; Common IRQ stub
+; Stack layout at this point:
+;   [SS]
+;   [RSP]
+;   [RFLAGS]
+;   [CS]
+;   [RIP]
+;   [IRQ Number]
+irq_common_stub:
+    ; Save all general-purpose registers (the irq_frame_t layout)
     push rax
     push rbx
     push rcx
@@ -29,14 +63,22 @@ irq%1_handler:
     push r14
     push r15
 
-    ; Call the C handler
-    call %2
+    ; Entry timestamp for latency tracing
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
 
-    ; Send End of Interrupt to PIC
-    mov rdi, %1
-    call pic_send_eoi
+    ; Call the dispatcher with RDI = frame, RSI = entry TSC, on a
+    ; 16-byte aligned stack
+    mov rdi, rsp
+    mov rsi, rax
+    mov rbx, rsp
+    and rsp, -16
+    cld
+    call irq_dispatch
+    mov rsp, rbx
 
-    ; Restore all registers
+    ; Restore all general-purpose registers
     pop r15
     pop r14
     pop r13
@@ -53,28 +95,12 @@ irq%1_handler:
     pop rbx
     pop rax
 
+    ; Remove IRQ number from stack
+    add rsp, 8
+
     ; Return from interrupt
     iretq
-%endmacro
 
-; IRQ Handlers
-IRQ_HANDLER 0, timer_handler        ; PIT Timer
-IRQ_HANDLER 1, keyboard_handler     ; Keyboard
-IRQ_HANDLER 2, irq_default          ; Cascade (never raised)
-IRQ_HANDLER 3, irq_default          ; COM2
-IRQ_HANDLER 4, irq_default          ; COM1
-IRQ_HANDLER 5, irq_default          ; LPT2
-IRQ_HANDLER 6, irq_default          ; Floppy
-IRQ_HANDLER 7, irq_default          ; LPT1
-IRQ_HANDLER 8, irq_default          ; RTC
-IRQ_HANDLER 9, irq_default          ; Peripherals
-IRQ_HANDLER 10, irq_default         ; Peripherals
-IRQ_HANDLER 11, irq_default         ; Peripherals
-IRQ_HANDLER 12, irq_default         ; PS/2 Mouse
-IRQ_HANDLER 13, irq_default         ; FPU
-IRQ_HANDLER 14, irq_default         ; Primary ATA
-IRQ_HANDLER 15, irq_default         ; Secondary ATA
-
-; Default IRQ handler (does nothing)
-irq_default:
-    ret
+; Local APIC spurious interrupt: nothing is in service, so no EOI
+apic_spurious_handler:
+    iretq
@@ -0,0 +1,195 @@
+#include "irq.h"
+#include "irqtrace.h"
+#include "irqchip.h"
+#include "scheduler.h"
+#include "klog.h"
+#include "counter.h"
+#include "timer.h"
+#include "initcall.h"
+#include <stddef.h>
+
+/* One handler on a line */
+struct irq_action {
+    irq_handler_t handler;
+    void* ctx;
+    struct irq_action* next;
+};
+
+static struct irq_action action_pool[IRQ_MAX_ACTIONS];
+static struct irq_action* lines[IRQ_LINES];
+static irq_stats_t stats[IRQ_LINES];
+
+/* Interrupts per line, read from stats[] when sampled */
+static counter_t line_counters[IRQ_LINES];
+static const char* const line_names[IRQ_LINES] = {
+    "irq.0", "irq.1", "irq.2", "irq.3", "irq.4", "irq.5", "irq.6", "irq.7",
+    "irq.8", "irq.9", "irq.10", "irq.11", "irq.12", "irq.13", "irq.14", "irq.15"
+};
+
+/* The IRQ being dispatched interrupted irq_halt() */
+static int dispatch_from_idle = 0;
+
+/* Set by handlers that want the scheduler to run after the EOI */
+static volatile int resched_pending = 0;
+
+/* Unclaimed interrupts can storm: report a few per second at most */
+static klog_ratelimit_t unhandled_limit = KLOG_RATELIMIT_INIT(TIMER_HZ, 5);
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t read_line_count(void* ctx) {
+    return stats[(uint64_t)ctx].count;
+}
+
+void irq_init(void) {
+    for (uint64_t irq = 0; irq < IRQ_LINES; irq++) {
+        line_counters[irq].name = line_names[irq];
+        line_counters[irq].kind = COUNTER_EVENT;
+        line_counters[irq].read = read_line_count;
+        line_counters[irq].ctx = (void*)irq;
+        counter_register(&line_counters[irq]);
+    }
+}
+INITCALL(INIT_PLATFORM, irq_init, "irqchip_init");
+
+int irq_from_idle(void) {
+    return dispatch_from_idle;
+}
+
+int irq_register(uint8_t irq, irq_handler_t handler, void* ctx) {
+    if (irq >= IRQ_LINES || !handler) {
+        return -1;
+    }
+    
+    uint64_t flags = irq_save();
+    
+    struct irq_action* action = NULL;
+    for (int i = 0; i < IRQ_MAX_ACTIONS; i++) {
+        if (!action_pool[i].handler) {
+            action = &action_pool[i];
+            break;
+        }
+    }
+    if (!action) {
+        irq_restore(flags);
+        return -1;
+    }
+    
+    action->handler = handler;
+    action->ctx = ctx;
+    action->next = NULL;
+    
+    /* Append so earlier handlers keep being asked first */
+    struct irq_action** link = &lines[irq];
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = action;
+    
+    if (lines[irq] == action) {
+        irqchip_unmask(irq);
+    }
+    
+    irq_restore(flags);
+    return 0;
+}
+
+void irq_unregister(uint8_t irq, irq_handler_t handler, void* ctx) {
+    if (irq >= IRQ_LINES) {
+        return;
+    }
+    
+    uint64_t flags = irq_save();
+    
+    struct irq_action** link = &lines[irq];
+    while (*link) {
+        struct irq_action* action = *link;
+        if (action->handler == handler && action->ctx == ctx) {
+            *link = action->next;
+            action->handler = NULL;
+            action->next = NULL;
+            break;
+        }
+        link = &action->next;
+    }
+    
+    if (!lines[irq]) {
+        irqchip_mask(irq);
+    }
+    
+    irq_restore(flags);
+}
+
+void irq_enable(uint8_t irq) {
+    if (irq < IRQ_LINES) {
+        irqchip_unmask(irq);
+    }
+}
+
+void irq_disable(uint8_t irq) {
+    if (irq < IRQ_LINES) {
+        irqchip_mask(irq);
+    }
+}
+
+void irq_request_resched(void) {
+    resched_pending = 1;
+}
+
+void irq_get_stats(uint8_t irq, irq_stats_t* out) {
+    if (irq >= IRQ_LINES || !out) {
+        return;
+    }
+    
+    uint64_t flags = irq_save();
+    *out = stats[irq];
+    irq_restore(flags);
+}
+
+void irq_dispatch(irq_frame_t* frame, uint64_t entry_tsc) {
+    uint8_t irq = (uint8_t)frame->irq;
+    irq_stats_t* st = &stats[irq];
+    
+    irqtrace_irq_enter(irq, entry_tsc);
+    
+    /* Take the idle mark before a reschedule could carry it elsewhere */
+    dispatch_from_idle = irqtrace_halted;
+    irqtrace_halted = 0;
+    
+    /* A spurious 8259 interrupt has nothing in service to acknowledge */
+    if (irqchip_is_spurious(irq)) {
+        st->spurious++;
+        return;
+    }
+    
+    uint64_t start = rdtsc();
+    
+    int handled = IRQ_NONE;
+    for (struct irq_action* a = lines[irq]; a; a = a->next) {
+        handled |= a->handler(frame, a->ctx);
+    }
+    
+    uint64_t cycles = rdtsc() - start;
+    st->count++;
+    st->cycles += cycles;
+    irqtrace_irq_exit(irq, cycles);
+    if (handled == IRQ_NONE) {
+        st->unhandled++;
+        if (klog_ratelimit(&unhandled_limit)) {
+            klog(LOG_WARN, "IRQ %u: no handler claimed it", irq);
+        }
+    }
+    
+    /* Acknowledge before switching: a newly started process never
+     * returns through irq.asm, which would leave the controller waiting */
+    irqchip_eoi(irq);
+    
+    if (resched_pending) {
+        resched_pending = 0;
+        scheduler_switch();
+    }
+}
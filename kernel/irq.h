@@ -0,0 +1,64 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+
+/* IRQ Dispatch
+ * Every legacy IRQ (vectors 32-47) enters one assembly stub that saves
+ * the registers and calls irq_dispatch(). Drivers hook lines with
+ * irq_register(); several handlers may share a line, and each one
+ * reports whether its device raised the interrupt.
+ */
+
+#define IRQ_LINES       16
+#define IRQ_MAX_ACTIONS 32    /* Handlers across all lines */
+
+/* Handler results */
+#define IRQ_NONE    0         /* Not our device */
+#define IRQ_HANDLED 1
+
+/* Registers saved by the common stub, followed by the CPU frame */
+typedef struct {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t irq;
+    uint64_t rip, cs, rflags, rsp, ss;
+} irq_frame_t;
+
+typedef int (*irq_handler_t)(irq_frame_t* frame, void* ctx);
+
+/* Per-line statistics */
+typedef struct {
+    uint64_t count;           /* Interrupts delivered */
+    uint64_t cycles;          /* TSC cycles spent in handlers */
+    uint64_t unhandled;       /* No handler claimed it */
+    uint64_t spurious;        /* Spurious IRQ 7/15 from the PIC */
+} irq_stats_t;
+
+/* Attach a handler to a line (unmasks the line on first use)
+ * Returns 0 on success, -1 if the line is invalid or the table is full */
+int irq_register(uint8_t irq, irq_handler_t handler, void* ctx);
+
+/* Detach a handler (masks the line when the last one goes) */
+void irq_unregister(uint8_t irq, irq_handler_t handler, void* ctx);
+
+/* Mask or unmask a line without changing its handlers */
+void irq_enable(uint8_t irq);
+void irq_disable(uint8_t irq);
+
+/* Ask for a reschedule once the current IRQ has been acknowledged */
+void irq_request_resched(void);
+
+/* Register the per-line interrupt counters ("irq.N") */
+void irq_init(void);
+
+/* Nonzero if the IRQ being dispatched woke the CPU from irq_halt() */
+int irq_from_idle(void);
+
+/* Read the statistics of one line */
+void irq_get_stats(uint8_t irq, irq_stats_t* stats);
+
+/* Called from the common stub in irq.asm (entry_tsc: TSC at entry) */
+void irq_dispatch(irq_frame_t* frame, uint64_t entry_tsc);
+
+#endif
@@ -0,0 +1,63 @@
+#include "irqchip.h"
+#include "acpi.h"
+#include "apic.h"
+#include "pic.h"
+#include "kprint.h"
+#include "initcall.h"
+
+static irqchip_mode_t mode = IRQCHIP_PIC;
+
+void irqchip_init(void) {
+    if (acpi_init() && apic_init(acpi_get_madt())) {
+        /* The PIC stays remapped so stray 8259 interrupts hit IRQ vectors */
+        pic_disable();
+        mode = IRQCHIP_APIC;
+        return;
+    }
+
+    mode = IRQCHIP_PIC;
+    kprint_info("No APIC found, using the 8259 PIC");
+}
+INITCALL(INIT_PLATFORM, irqchip_init);
+
+void irqchip_mask(uint8_t irq) {
+    if (mode == IRQCHIP_APIC) {
+        apic_irq_mask(irq);
+    } else {
+        pic_mask(irq);
+    }
+}
+
+void irqchip_unmask(uint8_t irq) {
+    if (mode == IRQCHIP_APIC) {
+        apic_irq_unmask(irq);
+    } else {
+        pic_unmask(irq);
+    }
+}
+
+void irqchip_eoi(uint8_t irq) {
+    if (mode == IRQCHIP_APIC) {
+        apic_eoi();
+    } else {
+        pic_send_eoi(irq);
+    }
+}
+
+int irqchip_is_spurious(uint8_t irq) {
+    if (mode == IRQCHIP_APIC) {
+        return 0;
+    }
+    return pic_is_spurious(irq);
+}
+
+uint8_t irqchip_set_priority(uint8_t threshold) {
+    if (mode == IRQCHIP_APIC) {
+        return apic_set_priority(threshold);
+    }
+    return 0;
+}
+
+irqchip_mode_t irqchip_mode(void) {
+    return mode;
+}
@@ -0,0 +1,38 @@
+#ifndef IRQCHIP_H
+#define IRQCHIP_H
+
+#include <stdint.h>
+
+/* Interrupt Controller
+ * Uses the IOAPIC + Local APIC when the ACPI MADT describes them and
+ * falls back to the 8259 PIC otherwise. Legacy IRQ n is delivered on
+ * vector 32 + n in both modes, so handlers do not care which is active.
+ */
+
+typedef enum {
+    IRQCHIP_PIC,
+    IRQCHIP_APIC
+} irqchip_mode_t;
+
+/* Pick and program an interrupt controller (needs paging and the heap) */
+void irqchip_init(void);
+
+/* Mask or unmask a legacy IRQ */
+void irqchip_mask(uint8_t irq);
+void irqchip_unmask(uint8_t irq);
+
+/* Acknowledge an IRQ */
+void irqchip_eoi(uint8_t irq);
+
+/* Check for a spurious IRQ, which must not be acknowledged
+ * (the APIC reports those on its own vector instead) */
+int irqchip_is_spurious(uint8_t irq);
+
+/* Hold off interrupt priority classes up to threshold (APIC only)
+ * Returns the previous threshold */
+uint8_t irqchip_set_priority(uint8_t threshold);
+
+/* Active controller */
+irqchip_mode_t irqchip_mode(void);
+
+#endif
@@ -0,0 +1,132 @@
+#include "irqtrace.h"
+#include "irq.h"
+#include <stddef.h>
+
+static irqtrace_hist_t handler_hist[IRQ_LINES];
+static irqtrace_hist_t timer_hist;
+static irqtrace_hist_t off_hist;
+
+/* Open interrupts-off section (0 when interrupts are on) */
+static uint64_t off_since = 0;
+static uint64_t off_site = 0;
+static uint64_t worst_off_site = 0;
+
+volatile uint8_t irqtrace_halted = 0;
+
+/* Entry timestamp of the IRQ being dispatched */
+static uint64_t irq_entry_tsc = 0;
+
+/* Timer period, learned from the TSC */
+static uint64_t first_tick_tsc = 0;
+static uint64_t last_tick_tsc = 0;
+static uint64_t ticks_seen = 0;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static void hist_add(irqtrace_hist_t* h, uint64_t cycles) {
+    int bucket = cycles ? 63 - __builtin_clzll(cycles) : 0;
+    if (bucket >= IRQTRACE_BUCKETS) {
+        bucket = IRQTRACE_BUCKETS - 1;
+    }
+    
+    h->buckets[bucket]++;
+    h->count++;
+    if (cycles > h->max) {
+        h->max = cycles;
+    }
+}
+
+void irqtrace_irqs_off(void) {
+    off_since = rdtsc();
+    off_site = (uint64_t)__builtin_return_address(0);
+}
+
+void irqtrace_irqs_on(void) {
+    if (!off_since) {
+        return;
+    }
+    
+    uint64_t cycles = rdtsc() - off_since;
+    off_since = 0;
+    
+    if (cycles > off_hist.max) {
+        worst_off_site = off_site;
+    }
+    hist_add(&off_hist, cycles);
+}
+
+void irqtrace_irq_enter(uint8_t irq, uint64_t entry_tsc) {
+    (void)irq;
+    
+    /* The interrupt proves interrupts were on, so any open section was
+     * closed by an untraced STI (IRETQ, a fresh process) */
+    off_since = 0;
+    irq_entry_tsc = entry_tsc;
+}
+
+void irqtrace_irq_exit(uint8_t irq, uint64_t cycles) {
+    if (irq < IRQ_LINES) {
+        hist_add(&handler_hist[irq], cycles);
+    }
+}
+
+void irqtrace_timer_tick(void) {
+    uint64_t now = irq_entry_tsc;
+    
+    /* Lateness against the previous tick plus the average period */
+    if (ticks_seen >= 2) {
+        uint64_t period = (last_tick_tsc - first_tick_tsc) / (ticks_seen - 1);
+        uint64_t expected = last_tick_tsc + period;
+        hist_add(&timer_hist, now > expected ? now - expected : 0);
+    }
+    
+    if (!ticks_seen) {
+        first_tick_tsc = now;
+    }
+    last_tick_tsc = now;
+    ticks_seen++;
+}
+
+static void hist_copy(irqtrace_hist_t* out, const irqtrace_hist_t* h) {
+    uint64_t flags = irq_save();
+    *out = *h;
+    irq_restore(flags);
+}
+
+void irqtrace_get_handler(uint8_t irq, irqtrace_hist_t* out) {
+    if (irq < IRQ_LINES && out) {
+        hist_copy(out, &handler_hist[irq]);
+    }
+}
+
+void irqtrace_get_timer(irqtrace_hist_t* out) {
+    if (out) {
+        hist_copy(out, &timer_hist);
+    }
+}
+
+void irqtrace_get_irqs_off(irqtrace_hist_t* out, uint64_t* worst_site) {
+    if (out) {
+        hist_copy(out, &off_hist);
+    }
+    if (worst_site) {
+        *worst_site = worst_off_site;
+    }
+}
+
+void irqtrace_reset(void) {
+    uint64_t flags = irq_save();
+    
+    for (int i = 0; i < IRQ_LINES; i++) {
+        handler_hist[i] = (irqtrace_hist_t){0};
+    }
+    timer_hist = (irqtrace_hist_t){0};
+    off_hist = (irqtrace_hist_t){0};
+    worst_off_site = 0;
+    
+    irq_restore(flags);
+}
@@ -0,0 +1,71 @@
+#ifndef IRQTRACE_H
+#define IRQTRACE_H
+
+#include <stdint.h>
+
+/* Interrupt Latency Tracing
+ * TSC-based log2 histograms of IRQ handler time per line, timer tick
+ * lateness and interrupts-off sections. Code that masks interrupts goes
+ * through irq_save()/irq_restore() below so every section is timed and
+ * the longest one is pinned to the code that disabled interrupts.
+ */
+
+#define IRQTRACE_BUCKETS 32     /* Bucket n counts [2^n, 2^(n+1)) cycles */
+
+typedef struct {
+    uint64_t count;
+    uint64_t max;               /* Longest sample (cycles) */
+    uint64_t buckets[IRQTRACE_BUCKETS];
+} irqtrace_hist_t;
+
+/* Interrupts-off bookkeeping (call with interrupts disabled) */
+void irqtrace_irqs_off(void);
+void irqtrace_irqs_on(void);
+
+/* Called by the IRQ dispatcher around the handlers */
+void irqtrace_irq_enter(uint8_t irq, uint64_t entry_tsc);
+void irqtrace_irq_exit(uint8_t irq, uint64_t cycles);
+
+/* Record timer lateness for the IRQ being dispatched */
+void irqtrace_timer_tick(void);
+
+/* Copy out histograms */
+void irqtrace_get_handler(uint8_t irq, irqtrace_hist_t* out);
+void irqtrace_get_timer(irqtrace_hist_t* out);
+void irqtrace_get_irqs_off(irqtrace_hist_t* out, uint64_t* worst_site);
+
+/* Clear all histograms */
+void irqtrace_reset(void);
+
+/* Set while the CPU sits in irq_halt(); the IRQ dispatcher takes it to
+ * tell idle time from busy time */
+extern volatile uint8_t irqtrace_halted;
+
+/* Disable interrupts, returning the previous RFLAGS
+ * Always inlined so the traced site is the caller, not this helper. */
+static inline __attribute__((always_inline)) uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    if (flags & 0x200) {
+        irqtrace_irqs_off();
+    }
+    return flags;
+}
+
+/* Restore interrupt state saved by irq_save() */
+static inline __attribute__((always_inline)) void irq_restore(uint64_t flags) {
+    if (flags & 0x200) {
+        irqtrace_irqs_on();
+        __asm__ volatile("sti" : : : "memory");
+    }
+}
+
+/* Enable interrupts and wait for one (STI+HLT is atomic) */
+static inline __attribute__((always_inline)) void irq_halt(void) {
+    irqtrace_irqs_on();
+    irqtrace_halted = 1;
+    __asm__ volatile("sti; hlt" : : : "memory");
+    irqtrace_halted = 0;
+}
+
+#endif
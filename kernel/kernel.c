@@ -2,52 +2,32 @@
 #include <stddef.h>
 
 #include "kprint.h"
-#include "panic.h"
-#include "idt.h"
-#include "pic.h"
-#include "timer.h"
-#include "pmm.h"
-#include "paging.h"
-#include "heap.h"
-#include "process.h"
-#include "scheduler.h"
-#include "vga.h"
+#include "serial.h"
+#include "irqtrace.h"
+#include "multiboot.h"
+#include "initcall.h"
 #include "ui.h"
 
-void kernel_main(void) {
-    /* Initialize VGA */
-    kprint_init();
-    
-    /* Initialize IDT */
-    idt_init();
-    
-    /* Remap PIC */
-    pic_remap();
+void kernel_main(uint32_t magic, uint64_t mbi_addr) {
+    initcall_mark("kernel_main");
     
-    /* Initialize Memory Management */
-    pmm_init(32 * 1024 * 1024);
-    paging_init();
-    paging_enable();
-    heap_init();
-    
-    /* Initialize Process Management */
-    process_init();
-    scheduler_init();
+    /* Consoles first, so every later stage can report */
+    kprint_init();
+    serial_init();
     
-    /* Initialize UI */
-    ui_init();
+    /* Read the boot information before the PMM can reuse its memory */
+    multiboot_init(magic, mbi_addr);
     
-    /* Enable interrupts */
-    timer_init(100);
-    pic_unmask_irq0();
-    pic_unmask_irq1();
+    /* Every registered initcall up to the interrupt sources */
+    initcall_run_boot();
     __asm__ volatile("sti");
     
-    /* Show the main menu */
-    ui_draw_menu();
+    /* Start the UI on the main menu; the rest waits for its first frame */
+    ui_start();
+    initcall_start_deferred();
     
     /* Idle loop */
     while (1) {
-        __asm__ volatile("hlt");
+        irq_halt();
     }
 }
@@ -1,6 +1,9 @@
 #include <stdint.h>
-#include "ui.h"
-#include "vga.h"
+#include <stddef.h>
+#include "keyboard.h"
+#include "irq.h"
+#include "fiber.h"
+#include "initcall.h"
 
 #define KEYBOARD_DATA_PORT 0x60
 
@@ -10,18 +13,20 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
-void keyboard_handler(void) {
-    uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+void keyboard_post(uint8_t scancode) {
+    /* Queue for fibers; the UI fiber picks keys up on its next frame */
+    fiber_post_input(scancode);
+}
+
+static int keyboard_handler(irq_frame_t* frame, void* ctx) {
+    (void)frame;
+    (void)ctx;
     
-    /* Handle key press only (bit 7 is 0) */
-    if (!(scancode & 0x80)) {
-        /* ESC key (0x01) - return to menu */
-        if (scancode == 0x01) {
-            ui_draw_menu();
-            return;
-        }
-        
-        /* Pass to UI handler for menu navigation */
-        ui_handle_input(scancode);
-    }
+    keyboard_post(inb(KEYBOARD_DATA_PORT));
+    return IRQ_HANDLED;
+}
+
+void keyboard_init(void) {
+    irq_register(1, keyboard_handler, NULL);
 }
+INITCALL(INIT_DEVICE, keyboard_init);
@@ -0,0 +1,12 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <stdint.h>
+
+/* Hook the PS/2 keyboard on IRQ1 */
+void keyboard_init(void);
+
+/* Deliver a set 1 scancode as if typed (other input devices) */
+void keyboard_post(uint8_t scancode);
+
+#endif
@@ -0,0 +1,171 @@
+#include "klog.h"
+#include "kprintf.h"
+#include "irqtrace.h"
+#include "process.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "clock.h"
+#include "apic.h"
+#include "initcall.h"
+
+#define KLOG_MASK       (KLOG_RECORDS - 1)
+#define KLOG_BATCH      16        /* Records printed before yielding */
+#define KLOG_STACK_SIZE 8192
+
+static klog_record_t ring[KLOG_RECORDS];
+static volatile uint64_t tail = 0;        /* Next position to reserve */
+static uint64_t printed = 0;              /* Next position to print */
+static uint64_t lost = 0;
+
+static process_t* consumer = NULL;
+static volatile int deferred = 0;
+
+int klog_read(uint64_t pos, klog_record_t* out) {
+    klog_record_t* rec = &ring[pos & KLOG_MASK];
+    
+    uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    if (seq != pos + 1) {
+        return 0;
+    }
+    *out = *rec;
+    
+    /* A writer lapping us mid-copy changes the sequence first */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == pos + 1;
+}
+
+/* Print records up to max; returns how many were consumed */
+static int print_pending(int max) {
+    int done = 0;
+    klog_record_t rec;
+    
+    while (done < max && printed < tail) {
+        /* Fell a full lap behind: skip what was overwritten */
+        if (tail - printed > KLOG_RECORDS) {
+            lost += tail - printed - KLOG_RECORDS;
+            printed = tail - KLOG_RECORDS;
+        }
+        
+        if (!klog_read(printed, &rec)) {
+            uint64_t seq = __atomic_load_n(&ring[printed & KLOG_MASK].seq, __ATOMIC_ACQUIRE);
+            if (seq > printed + 1) {
+                lost++;
+                printed++;
+                continue;
+            }
+            break;  /* Still being written */
+        }
+        
+        uint8_t color;
+        const char* prefix = kprint_style((log_level_t)rec.level, &color);
+        kprintf_color(color, "%s%.*s\n", prefix, (int)rec.len, rec.text);
+        printed++;
+        done++;
+    }
+    return done;
+}
+
+/* Consumer: prints a batch, then yields or sleeps until new records */
+static void klog_task(void) {
+    while (1) {
+        uint64_t flags = irq_save();
+        int busy = printed < tail;
+        if (!busy) {
+            scheduler_block();
+        }
+        irq_restore(flags);
+        
+        /* Let everything else run between batches, and let a writer
+         * we caught mid-record finish it */
+        int done = print_pending(KLOG_BATCH);
+        if (done == 0 || done == KLOG_BATCH) {
+            scheduler_yield();
+        }
+    }
+}
+
+void klog_write(log_level_t level, const char* fmt, va_list args) {
+    uint64_t pos = __atomic_fetch_add(&tail, 1, __ATOMIC_RELAXED);
+    klog_record_t* rec = &ring[pos & KLOG_MASK];
+    
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    rec->time_ns = clock_monotonic_ns();
+    rec->level = (uint8_t)level;
+    rec->cpu = (uint8_t)apic_id();
+    int len = kvsnprintf(rec->text, KLOG_TEXT, fmt, args);
+    rec->len = len < KLOG_TEXT ? len : KLOG_TEXT - 1;
+    
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+    
+    if (!deferred) {
+        /* Early boot: there is no consumer yet */
+        uint64_t flags = irq_save();
+        print_pending(KLOG_RECORDS);
+        irq_restore(flags);
+        return;
+    }
+    
+    uint64_t flags = irq_save();
+    scheduler_wake(consumer);
+    irq_restore(flags);
+}
+
+void klog(log_level_t level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    klog_write(level, fmt, args);
+    va_end(args);
+}
+
+int klog_ratelimit(klog_ratelimit_t* rs) {
+    uint64_t now = timer_get_ticks();
+    
+    if (!rs->begin || now - rs->begin >= rs->interval) {
+        if (rs->missed) {
+            klog(LOG_WARN, "%u messages suppressed", rs->missed);
+        }
+        rs->begin = now ? now : 1;
+        rs->printed = 0;
+        rs->missed = 0;
+    }
+    
+    if (rs->printed < rs->burst) {
+        rs->printed++;
+        return 1;
+    }
+    rs->missed++;
+    return 0;
+}
+
+void klog_flush(void) {
+    uint64_t flags = irq_save();
+    deferred = 0;
+    print_pending(KLOG_RECORDS);
+    irq_restore(flags);
+}
+
+void klog_start(void) {
+    consumer = process_create(klog_task, KLOG_STACK_SIZE);
+    if (!consumer) {
+        kprint_error("Failed to start log consumer");
+        return;
+    }
+    scheduler_add(consumer);
+    deferred = 1;
+}
+INITCALL(INIT_CORE, klog_start, "scheduler_init");
+
+uint64_t klog_first(void) {
+    uint64_t next = tail;
+    return next > KLOG_RECORDS ? next - KLOG_RECORDS : 0;
+}
+
+uint64_t klog_next(void) {
+    return tail;
+}
+
+uint64_t klog_lost(void) {
+    return lost;
+}
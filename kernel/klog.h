@@ -0,0 +1,66 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include "kprint.h"
+
+/* Kernel Log Ring
+ * Fixed-size records in a lock-free ring. Writers reserve a slot with
+ * one atomic add, copy the message in and publish it; when the ring is
+ * full the oldest record is overwritten. A low-priority consumer task
+ * prints new records to the kprintf consoles, so logging never draws
+ * text on the caller's path. Before klog_start() (and after a panic)
+ * records are printed immediately.
+ */
+
+#define KLOG_RECORDS  256         /* Power of two */
+#define KLOG_TEXT     108         /* Message bytes per record */
+
+typedef struct {
+    uint64_t seq;                 /* Position + 1 once published, 0 while written */
+    uint64_t time_ns;             /* clock_monotonic_ns() at logging time */
+    uint8_t level;                /* log_level_t */
+    uint8_t cpu;                  /* Local APIC ID of the writer */
+    uint16_t len;
+    char text[KLOG_TEXT];
+} klog_record_t;
+
+/* Rate limit state for one call site: at most burst messages per
+ * interval ticks, reporting how many were suppressed */
+typedef struct {
+    uint64_t interval;
+    uint32_t burst;
+    uint32_t printed;
+    uint32_t missed;
+    uint64_t begin;
+} klog_ratelimit_t;
+
+#define KLOG_RATELIMIT_INIT(interval_ticks, burst_count) \
+    { (interval_ticks), (burst_count), 0, 0, 0 }
+
+/* Start the consumer task (deferred printing from then on) */
+void klog_start(void);
+
+/* Append a message */
+void klog(log_level_t level, const char* fmt, ...);
+void klog_write(log_level_t level, const char* fmt, va_list args);
+
+/* Check a call site's rate limit (1 = log it) */
+int klog_ratelimit(klog_ratelimit_t* rs);
+
+/* Print everything pending now, bypassing the consumer (panic paths) */
+void klog_flush(void);
+
+/* Oldest position still held by the ring, and the next one to be written */
+uint64_t klog_first(void);
+uint64_t klog_next(void);
+
+/* Copy out the record at pos; returns 0 if it was overwritten or is
+ * not published yet */
+int klog_read(uint64_t pos, klog_record_t* out);
+
+/* Records overwritten before the consumer printed them */
+uint64_t klog_lost(void);
+
+#endif
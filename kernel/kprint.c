@@ -1,43 +1,56 @@
 #include "kprint.h"
+#include "kprintf.h"
+#include "klog.h"
 #include "vga.h"
 
+static volatile int screen_enabled = 1;
+
+/* Screen output for kprintf() */
+static void vga_sink_write(const char* text, size_t len, uint8_t color) {
+    if (!screen_enabled) {
+        return;
+    }
+    vga_write(text, len, color);
+    vga_flush();
+}
+
+static kprintf_sink_t vga_sink = { vga_sink_write, NULL };
+
 /* Initialize kernel printing system */
 void kprint_init(void) {
     vga_init();
+    kprintf_add_sink(&vga_sink);
+}
+
+void kprint_set_screen(int enabled) {
+    screen_enabled = enabled;
 }
 
 /* Print a kernel message with specified log level */
 void kprint(log_level_t level, const char* message) {
-    uint8_t color;
-    const char* prefix;
-    
-    /* Determine color and prefix based on log level */
+    /* Recorded in the log ring, which prints it (at once during boot) */
+    klog(level, "%s", message);
+}
+
+/* Prefix and color used to show a message of a level */
+const char* kprint_style(log_level_t level, uint8_t* color) {
     switch (level) {
         case LOG_INFO:
-            color = VGA_COLOR_WHITE;
-            prefix = "[INFO] ";
-            break;
+            *color = VGA_COLOR_WHITE;
+            return "[INFO] ";
         case LOG_OK:
-            color = VGA_COLOR_LIGHT_GREEN;
-            prefix = "[OK]   ";
-            break;
+            *color = VGA_COLOR_LIGHT_GREEN;
+            return "[OK]   ";
         case LOG_WARN:
-            color = VGA_COLOR_YELLOW;
-            prefix = "[WARN] ";
-            break;
+            *color = VGA_COLOR_YELLOW;
+            return "[WARN] ";
         case LOG_ERROR:
-            color = VGA_COLOR_LIGHT_RED;
-            prefix = "[ERROR] ";
-            break;
+            *color = VGA_COLOR_LIGHT_RED;
+            return "[ERROR] ";
         default:
-            color = VGA_COLOR_LIGHT_GRAY;
-            prefix = "";
-            break;
+            *color = VGA_COLOR_LIGHT_GRAY;
+            return "";
     }
-    
-    /* Print prefix and message */
-    vga_print(prefix, color);
-    vga_println(message, color);
 }
 
 /* Convenience wrappers for different log levels */
@@ -58,11 +71,5 @@ void kprint_error(const char* message) {
 }
 
 void kprint_hex(uint8_t value) {
-    char hex[4] = "0x";
-    const char* digits = "0123456789ABCDEF";
-    hex[2] = digits[(value >> 4) & 0xF];
-    hex[3] = digits[value & 0xF];
-    
-    vga_print(hex, VGA_COLOR_CYAN);
-    vga_print(" ", VGA_COLOR_WHITE);
+    kprintf_color(VGA_COLOR_CYAN, "0x%02X ", value);
 }
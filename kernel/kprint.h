@@ -16,9 +16,17 @@ typedef enum {
 /* Initialize kernel printing system */
 void kprint_init(void);
 
-/* Print a kernel message with specified log level */
+/* Route kernel output to the screen or not (the UI owns the screen
+ * while it runs; other sinks and the log ring still get everything) */
+void kprint_set_screen(int enabled);
+
+/* Print a kernel message with specified log level
+ * (recorded in the kernel log, see klog.h) */
 void kprint(log_level_t level, const char* message);
 
+/* Prefix and VGA color for a log level */
+const char* kprint_style(log_level_t level, uint8_t* color);
+
 /* Convenience wrappers */
 void kprint_info(const char* message);
 void kprint_ok(const char* message);
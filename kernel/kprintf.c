@@ -0,0 +1,304 @@
+#include "kprintf.h"
+#include "vga.h"
+#include "irqtrace.h"
+
+static kprintf_sink_t* sinks = NULL;
+
+/* Output cursor for one kvsnprintf() call */
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;
+} out_t;
+
+static inline void put(out_t* out, char c) {
+    if (out->len + 1 < out->size) {
+        out->buf[out->len] = c;
+    }
+    out->len++;
+}
+
+static void put_padding(out_t* out, char c, int count) {
+    while (count-- > 0) {
+        put(out, c);
+    }
+}
+
+/* Emit a finished field with its padding */
+static void put_field(out_t* out, const char* prefix, const char* body, int body_len,
+                      int width, int left, int zero) {
+    int prefix_len = 0;
+    while (prefix[prefix_len]) {
+        prefix_len++;
+    }
+    
+    int pad = width - prefix_len - body_len;
+    if (!left && !zero) {
+        put_padding(out, ' ', pad);
+    }
+    for (int i = 0; i < prefix_len; i++) {
+        put(out, prefix[i]);
+    }
+    if (!left && zero) {
+        put_padding(out, '0', pad);
+    }
+    for (int i = 0; i < body_len; i++) {
+        put(out, body[i]);
+    }
+    if (left) {
+        put_padding(out, ' ', pad);
+    }
+}
+
+/* Digits of value in base, written backwards ending at end */
+static int format_digits(char* end, uint64_t value, unsigned base, int upper) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int n = 0;
+    do {
+        *--end = digits[value % base];
+        value /= base;
+        n++;
+    } while (value);
+    return n;
+}
+
+static void format_number(out_t* out, uint64_t value, int negative, unsigned base,
+                          int upper, const char* prefix, int width, int precision,
+                          int left, int zero) {
+    char tmp[72];
+    char* end = tmp + sizeof(tmp);
+    int n = 0;
+    
+    /* Precision 0 with value 0 prints no digits, as in C */
+    if (value || precision != 0) {
+        n = format_digits(end, value, base, upper);
+    }
+    while (n < precision && n < (int)sizeof(tmp)) {
+        *(end - ++n) = '0';
+    }
+    
+    const char* sign = negative ? "-" : prefix;
+    
+    /* An explicit precision turns off zero padding */
+    put_field(out, sign, end - n, n, width, left, zero && precision < 0);
+}
+
+/* Byte count with the largest binary unit that keeps it >= 1 */
+static void format_size(out_t* out, uint64_t bytes, int width, int left) {
+    static const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    int unit = 0;
+    uint64_t whole = bytes;
+    uint64_t rem = 0;
+    
+    while (whole >= 1024 && unit < 4) {
+        rem = whole % 1024;
+        whole /= 1024;
+        unit++;
+    }
+    
+    /* One decimal place unless the value is exact */
+    char tmp[32];
+    int n = 0;
+    char digits[24];
+    int d = format_digits(digits + sizeof(digits), whole, 10, 0);
+    for (int i = 0; i < d; i++) {
+        tmp[n++] = digits[sizeof(digits) - d + i];
+    }
+    uint64_t tenth = rem * 10 / 1024;
+    if (tenth) {
+        tmp[n++] = '.';
+        tmp[n++] = (char)('0' + tenth);
+    }
+    for (const char* u = units[unit]; *u; u++) {
+        tmp[n++] = *u;
+    }
+    
+    put_field(out, "", tmp, n, width, left, 0);
+}
+
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    out_t out = { buf, size, 0 };
+    
+    while (*fmt) {
+        if (*fmt != '%') {
+            put(&out, *fmt++);
+            continue;
+        }
+        fmt++;
+        
+        /* Flags */
+        int left = 0, zero = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') left = 1;
+            else if (*fmt == '0') zero = 1;
+            else break;
+        }
+        
+        /* Width */
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                left = 1;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                width = width * 10 + (*fmt++ - '0');
+            }
+        }
+        
+        /* Precision */
+        int precision = -1;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(args, int);
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    precision = precision * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+        
+        /* Length: 0 = int, 1 = long / long long / size_t, -1 = short, -2 = char */
+        int length = 0;
+        if (*fmt == 'h') {
+            length = -1;
+            if (*++fmt == 'h') {
+                length = -2;
+                fmt++;
+            }
+        } else if (*fmt == 'l') {
+            length = 1;
+            if (*++fmt == 'l') {
+                fmt++;
+            }
+        } else if (*fmt == 'z') {
+            length = 1;
+            fmt++;
+        }
+        
+        char conv = *fmt;
+        if (!conv) {
+            break;
+        }
+        fmt++;
+        
+        switch (conv) {
+            case 'd':
+            case 'i': {
+                int64_t v = length == 1 ? va_arg(args, int64_t) : va_arg(args, int);
+                if (length == -1) v = (int16_t)v;
+                if (length == -2) v = (int8_t)v;
+                uint64_t mag = v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+                format_number(&out, mag, v < 0, 10, 0, "", width, precision, left, zero);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'b': {
+                uint64_t v = length == 1 ? va_arg(args, uint64_t) : va_arg(args, unsigned int);
+                if (length == -1) v = (uint16_t)v;
+                if (length == -2) v = (uint8_t)v;
+                unsigned base = conv == 'u' ? 10 : conv == 'o' ? 8 : conv == 'b' ? 2 : 16;
+                format_number(&out, v, 0, base, conv == 'X', "", width, precision, left, zero);
+                break;
+            }
+            case 'p': {
+                uint64_t v = (uint64_t)va_arg(args, void*);
+                format_number(&out, v, 0, 16, 0, "0x", width, 16, left, 0);
+                break;
+            }
+            case 'M':
+                format_size(&out, va_arg(args, uint64_t), width, left);
+                break;
+            case 'c': {
+                char c = (char)va_arg(args, int);
+                put_field(&out, "", &c, 1, width, left, 0);
+                break;
+            }
+            case 's': {
+                const char* s = va_arg(args, const char*);
+                if (!s) {
+                    s = "(null)";
+                }
+                int n = 0;
+                while (s[n] && (precision < 0 || n < precision)) {
+                    n++;
+                }
+                put_field(&out, "", s, n, width, left, 0);
+                break;
+            }
+            case '%':
+                put(&out, '%');
+                break;
+            default:
+                /* Unknown conversion: show it as written */
+                put(&out, '%');
+                put(&out, conv);
+                break;
+        }
+    }
+    
+    if (size) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return (int)out.len;
+}
+
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
+
+void kprintf_write(const char* text, size_t len, uint8_t color) {
+    for (kprintf_sink_t* s = sinks; s; s = s->next) {
+        s->write(text, len, color);
+    }
+}
+
+void kvprintf_color(uint8_t color, const char* fmt, va_list args) {
+    char buf[KPRINTF_BUFFER];
+    int len = kvsnprintf(buf, sizeof(buf), fmt, args);
+    if (len >= (int)sizeof(buf)) {
+        len = sizeof(buf) - 1;
+    }
+    kprintf_write(buf, len, color);
+}
+
+void kprintf_color(uint8_t color, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    kvprintf_color(color, fmt, args);
+    va_end(args);
+}
+
+void kprintf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    kvprintf_color(VGA_COLOR_LIGHT_GRAY, fmt, args);
+    va_end(args);
+}
+
+void kprintf_add_sink(kprintf_sink_t* sink) {
+    uint64_t flags = irq_save();
+    
+    /* Append so output order across sinks stays registration order */
+    sink->next = NULL;
+    kprintf_sink_t** link = &sinks;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = sink;
+    
+    irq_restore(flags);
+}
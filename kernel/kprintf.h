@@ -0,0 +1,44 @@
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+/* Formatted Output
+ * Freestanding printf-style formatting. Output is built in a stack
+ * buffer and handed to every registered sink in a single write.
+ *
+ * Conversions: %d %i %u %x %X %o %b %c %s %p %%, plus %M for a byte
+ * count printed with a B/KiB/MiB/GiB suffix (takes a uint64_t).
+ * Flags '-' and '0', a width and a precision (either may be '*'),
+ * and the length modifiers h, hh, l, ll and z are accepted. (No printf
+ * format attribute: the compiler would reject %M.)
+ */
+
+#define KPRINTF_BUFFER 256      /* Longest single kprintf() output */
+
+/* Output sink (VGA, serial, log ring...) */
+typedef struct kprintf_sink {
+    /* color is a VGA attribute; sinks without colors ignore it */
+    void (*write)(const char* text, size_t len, uint8_t color);
+    struct kprintf_sink* next;
+} kprintf_sink_t;
+
+/* Format into buf (always NUL-terminated when size > 0)
+ * Returns the length the full output would have had */
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+int ksnprintf(char* buf, size_t size, const char* fmt, ...);
+
+/* Format and send to every sink */
+void kprintf(const char* fmt, ...);
+void kprintf_color(uint8_t color, const char* fmt, ...);
+void kvprintf_color(uint8_t color, const char* fmt, va_list args);
+
+/* Send raw text to every sink */
+void kprintf_write(const char* text, size_t len, uint8_t color);
+
+/* Attach an output sink (the sink must stay valid) */
+void kprintf_add_sink(kprintf_sink_t* sink);
+
+#endif
@@ -0,0 +1,221 @@
+#include "kstack.h"
+#include "paging.h"
+#include "pmm.h"
+#include "reclaim.h"
+#include "panic.h"
+#include "kprint.h"
+#include "initcall.h"
+
+#include <stddef.h>
+
+/* Per-slot bookkeeping */
+typedef struct kstack_slot {
+    uint64_t size;                  /* Usable stack size (0 = never used) */
+    uint8_t in_use;                 /* Owned by a process */
+    struct kstack_slot* next_free;  /* Link in the ready pool */
+} kstack_slot_t;
+
+static kstack_slot_t slots[KSTACK_MAX_STACKS];
+
+/* Released stacks that still have their pages mapped */
+static kstack_slot_t* pool_head = NULL;
+static uint64_t pool_count = 0;
+
+static uint64_t resident_pages = 0;
+
+static inline uint64_t slot_top(kstack_slot_t* slot) {
+    return KSTACK_REGION_START + (uint64_t)(slot - slots + 1) * KSTACK_SLOT_SIZE;
+}
+
+static inline uint64_t slot_bottom(kstack_slot_t* slot) {
+    return slot_top(slot) - slot->size;
+}
+
+static kstack_slot_t* slot_for(uint64_t addr) {
+    if (addr < KSTACK_REGION_START || addr >= KSTACK_REGION_END) {
+        return NULL;
+    }
+    return &slots[(addr - KSTACK_REGION_START) / KSTACK_SLOT_SIZE];
+}
+
+/* Back one stack page with a fresh, zeroed physical page */
+static void map_stack_page(uint64_t vaddr) {
+    uint64_t paddr = pmm_alloc_page();
+    paging_map_page(vaddr, paddr, PAGE_PRESENT | PAGE_WRITE);
+
+    uint64_t* page = (uint64_t*)vaddr;
+    for (int i = 0; i < PAGE_SIZE / 8; i++) {
+        page[i] = 0;
+    }
+    resident_pages++;
+}
+
+/* Release mapped pages of a slot in [start, end) */
+static void unmap_stack_pages(uint64_t start, uint64_t end) {
+    tlb_gather_t g;
+    tlb_gather_init(&g, paging_kernel_root());
+    resident_pages -= paging_unmap_range_in(paging_kernel_root(), start, end,
+                                            PAGING_UNMAP_RELEASE, &g);
+    tlb_gather_flush(&g);
+}
+
+/* Remove a slot from the ready pool */
+static void pool_remove(kstack_slot_t* slot) {
+    kstack_slot_t** link = &pool_head;
+    while (*link) {
+        if (*link == slot) {
+            *link = slot->next_free;
+            slot->next_free = NULL;
+            pool_count--;
+            return;
+        }
+        link = &(*link)->next_free;
+    }
+}
+
+/* Shrinker: give back the pages of pooled stacks */
+static uint64_t pool_shrink_count(void) {
+    uint64_t pages = 0;
+    for (kstack_slot_t* slot = pool_head; slot; slot = slot->next_free) {
+        pages += slot->size / PAGE_SIZE;
+    }
+    return pages;
+}
+
+static uint64_t pool_shrink_scan(uint64_t target) {
+    uint64_t rsp;
+    __asm__ volatile("mov %%rsp, %0" : "=r"(rsp));
+
+    uint64_t before = resident_pages;
+    kstack_slot_t* slot = pool_head;
+    while (slot && before - resident_pages < target) {
+        kstack_slot_t* next = slot->next_free;
+
+        /* An exiting process may still be running on its pooled stack */
+        if (slot_for(rsp) != slot) {
+            pool_remove(slot);
+            unmap_stack_pages(slot_bottom(slot), slot_top(slot));
+            slot->size = 0;
+        }
+        slot = next;
+    }
+    return before - resident_pages;
+}
+
+static shrinker_t pool_shrinker = {
+    .name = "kstack-pool",
+    .count = pool_shrink_count,
+    .scan = pool_shrink_scan,
+};
+
+void kstack_init(void) {
+    for (int i = 0; i < KSTACK_MAX_STACKS; i++) {
+        slots[i].size = 0;
+        slots[i].in_use = 0;
+        slots[i].next_free = NULL;
+    }
+    pool_head = NULL;
+    pool_count = 0;
+    resident_pages = 0;
+    shrinker_register(&pool_shrinker);
+
+    kprint_ok("Kernel stacks initialized (guard-paged, 64 slots at 0x20000000)");
+}
+INITCALL(INIT_MEMORY, kstack_init, "heap_init");
+
+void* kstack_alloc(uint64_t size) {
+    if (size == 0 || size > KSTACK_MAX_SIZE) {
+        return NULL;
+    }
+
+    /* Round up to whole pages */
+    size = (size + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+
+    /* Prefer a pooled stack: its pages are already resident */
+    kstack_slot_t* slot = pool_head;
+    if (slot) {
+        pool_remove(slot);
+
+        /* Shrinking moves the guard up: drop pages that now fall below it */
+        if (size < slot->size) {
+            unmap_stack_pages(slot_top(slot) - slot->size, slot_top(slot) - size);
+        }
+    } else {
+        for (int i = 0; i < KSTACK_MAX_STACKS; i++) {
+            if (!slots[i].in_use && slots[i].size == 0) {
+                slot = &slots[i];
+                break;
+            }
+        }
+        if (!slot) {
+            return NULL;
+        }
+    }
+
+    slot->size = size;
+    slot->in_use = 1;
+
+    /* Back the top page now; deeper pages are faulted in on demand */
+    uint64_t top_page = slot_top(slot) - PAGE_SIZE;
+    if (!paging_get_physical(top_page)) {
+        map_stack_page(top_page);
+    }
+
+    return (void*)slot_bottom(slot);
+}
+
+void kstack_free(void* stack) {
+    kstack_slot_t* slot = slot_for((uint64_t)stack);
+    if (!slot || !slot->in_use || (uint64_t)stack != slot_bottom(slot)) {
+        panic("kstack: Invalid free");
+    }
+
+    /* A pooled stack is handed out again at once: it must not be live */
+    uint64_t rsp;
+    __asm__ volatile("mov %%rsp, %0" : "=r"(rsp));
+    if (slot_for(rsp) == slot) {
+        panic("kstack: Freeing the stack in use");
+    }
+
+    slot->in_use = 0;
+
+    if (pool_count < KSTACK_POOL_MAX) {
+        slot->next_free = pool_head;
+        pool_head = slot;
+        pool_count++;
+        return;
+    }
+
+    unmap_stack_pages(slot_bottom(slot), slot_top(slot));
+    slot->size = 0;
+}
+
+kstack_fault_t kstack_handle_fault(uint64_t fault_addr) {
+    kstack_slot_t* slot = slot_for(fault_addr);
+    if (!slot || !slot->in_use) {
+        return KSTACK_FAULT_NONE;
+    }
+
+    if (fault_addr < slot_bottom(slot)) {
+        return KSTACK_FAULT_OVERFLOW;
+    }
+
+    map_stack_page(fault_addr & ~((uint64_t)PAGE_SIZE - 1));
+    return KSTACK_FAULT_HANDLED;
+}
+
+int kstack_is_guard(uint64_t addr) {
+    kstack_slot_t* slot = slot_for(addr);
+    return slot && slot->in_use && addr < slot_bottom(slot);
+}
+
+void kstack_stats(uint64_t* in_use, uint64_t* pooled, uint64_t* resident) {
+    *in_use = 0;
+    for (int i = 0; i < KSTACK_MAX_STACKS; i++) {
+        if (slots[i].in_use) {
+            (*in_use)++;
+        }
+    }
+    *pooled = pool_count;
+    *resident = resident_pages;
+}
@@ -0,0 +1,54 @@
+#ifndef KSTACK_H
+#define KSTACK_H
+
+#include <stdint.h>
+
+/* Kernel Stack Allocator
+ * Stacks live in a dedicated virtual region, one fixed-size slot each.
+ * The page just below every stack is left unmapped as a guard page, so
+ * an overflow faults immediately instead of corrupting the heap.
+ * Stack pages are backed lazily on first touch, and released stacks are
+ * kept mapped in a small pool for fast reuse.
+ *
+ * Slot layout (grows down):
+ *   [unused ...][guard page][stack pages ...] <- slot top
+ */
+
+#define KSTACK_REGION_START 0x20000000   /* 512MB virtual address */
+#define KSTACK_SLOT_SIZE    0x10000      /* 64KB per slot */
+#define KSTACK_MAX_STACKS   64
+#define KSTACK_REGION_END   (KSTACK_REGION_START + KSTACK_MAX_STACKS * KSTACK_SLOT_SIZE)
+
+/* Largest stack that fits in a slot (one page reserved for the guard) */
+#define KSTACK_MAX_SIZE     (KSTACK_SLOT_SIZE - 4096)
+
+/* Number of released stacks kept mapped for reuse */
+#define KSTACK_POOL_MAX     8
+
+/* Result of kstack_handle_fault() */
+typedef enum {
+    KSTACK_FAULT_NONE,      /* Address is not a kernel stack */
+    KSTACK_FAULT_HANDLED,   /* Stack page was backed, retry the access */
+    KSTACK_FAULT_OVERFLOW   /* Access hit the guard page */
+} kstack_fault_t;
+
+/* Initialize the stack region */
+void kstack_init(void);
+
+/* Allocate a stack (returns lowest usable address, NULL if none left) */
+void* kstack_alloc(uint64_t size);
+
+/* Release a stack returned by kstack_alloc() (not the one in use:
+ * an exiting process's stack is freed by the scheduler) */
+void kstack_free(void* stack);
+
+/* Handle a page fault inside the stack region */
+kstack_fault_t kstack_handle_fault(uint64_t fault_addr);
+
+/* Check whether an address lies below a live stack (guard area) */
+int kstack_is_guard(uint64_t addr);
+
+/* Get stack statistics */
+void kstack_stats(uint64_t* in_use, uint64_t* pooled, uint64_t* resident_pages);
+
+#endif
@@ -0,0 +1,135 @@
+#include "multiboot.h"
+#include "kprint.h"
+
+#include <stddef.h>
+
+/* Tag types */
+#define TAG_END          0
+#define TAG_MODULE       3
+#define TAG_FRAMEBUFFER  8
+
+/* Only the boot page tables' identity map is up when this runs */
+#define BOOT_MAPPED_LIMIT (64ULL * 1024 * 1024)
+
+typedef struct {
+    uint32_t total_size;
+    uint32_t reserved;
+} __attribute__((packed)) mb_info_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} __attribute__((packed)) mb_tag_t;
+
+typedef struct {
+    mb_tag_t tag;
+    uint64_t addr;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t type;
+    uint16_t reserved;
+    /* Color layout for MULTIBOOT_FB_RGB */
+    uint8_t red_pos, red_size;
+    uint8_t green_pos, green_size;
+    uint8_t blue_pos, blue_size;
+} __attribute__((packed)) mb_tag_fb_t;
+
+typedef struct {
+    mb_tag_t tag;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];             /* NUL-terminated */
+} __attribute__((packed)) mb_tag_module_t;
+
+static multiboot_fb_t framebuffer;
+static int fb_found = 0;
+
+static multiboot_module_t modules[MULTIBOOT_MAX_MODULES];
+static uint32_t module_count = 0;
+
+static void parse_framebuffer(const mb_tag_fb_t* tag) {
+    framebuffer.addr = tag->addr;
+    framebuffer.pitch = tag->pitch;
+    framebuffer.width = tag->width;
+    framebuffer.height = tag->height;
+    framebuffer.bpp = tag->bpp;
+    framebuffer.type = tag->type;
+    if (tag->type == MULTIBOOT_FB_RGB) {
+        framebuffer.red_pos = tag->red_pos;
+        framebuffer.red_size = tag->red_size;
+        framebuffer.green_pos = tag->green_pos;
+        framebuffer.green_size = tag->green_size;
+        framebuffer.blue_pos = tag->blue_pos;
+        framebuffer.blue_size = tag->blue_size;
+    }
+    fb_found = 1;
+}
+
+static void parse_module(const mb_tag_module_t* tag) {
+    if (module_count == MULTIBOOT_MAX_MODULES) {
+        kprint_info("Multiboot: Too many modules, ignoring the rest");
+        return;
+    }
+    
+    multiboot_module_t* mod = &modules[module_count++];
+    mod->start = tag->mod_start;
+    mod->end = tag->mod_end;
+    
+    /* Bounded by the tag as well as our buffer */
+    uint32_t max = tag->tag.size - sizeof(mb_tag_module_t);
+    uint32_t i = 0;
+    while (i < max && i < MULTIBOOT_CMDLINE_MAX - 1 && tag->cmdline[i]) {
+        mod->cmdline[i] = tag->cmdline[i];
+        i++;
+    }
+    mod->cmdline[i] = '\0';
+}
+
+void multiboot_init(uint32_t magic, uint64_t info_addr) {
+    if (magic != MULTIBOOT2_BOOTLOADER_MAGIC) {
+        kprint_info("Multiboot: Not loaded by a Multiboot2 loader");
+        return;
+    }
+    if (info_addr == 0 || info_addr >= BOOT_MAPPED_LIMIT) {
+        kprint_info("Multiboot: Boot information out of reach");
+        return;
+    }
+    
+    const mb_info_t* info = (const mb_info_t*)info_addr;
+    uint64_t end = info_addr + info->total_size;
+    
+    /* Tags start after the header and are 8-byte aligned */
+    uint64_t pos = info_addr + sizeof(mb_info_t);
+    while (pos + sizeof(mb_tag_t) <= end) {
+        const mb_tag_t* tag = (const mb_tag_t*)pos;
+        if (tag->type == TAG_END || tag->size < sizeof(mb_tag_t)) {
+            break;
+        }
+        
+        switch (tag->type) {
+            case TAG_MODULE:
+                parse_module((const mb_tag_module_t*)tag);
+                break;
+            case TAG_FRAMEBUFFER:
+                parse_framebuffer((const mb_tag_fb_t*)tag);
+                break;
+        }
+        pos = (pos + tag->size + 7) & ~7ULL;
+    }
+    
+    kprint_ok("Multiboot information parsed");
+}
+
+const multiboot_fb_t* multiboot_framebuffer(void) {
+    return fb_found ? &framebuffer : NULL;
+}
+
+uint32_t multiboot_module_count(void) {
+    return module_count;
+}
+
+const multiboot_module_t* multiboot_module(uint32_t index) {
+    return index < module_count ? &modules[index] : NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+/* Multiboot2 Boot Information
+ * GRUB leaves a tag list in memory and its address in EBX. The tags are
+ * copied out in kernel_main before the PMM starts handing out pages,
+ * since nothing reserves the memory they live in. Boot modules stay
+ * where GRUB loaded them: the PMM reserves their pages instead.
+ */
+
+#define MULTIBOOT2_BOOTLOADER_MAGIC 0x36D76289
+
+/* Framebuffer types */
+#define MULTIBOOT_FB_INDEXED 0
+#define MULTIBOOT_FB_RGB     1
+#define MULTIBOOT_FB_TEXT    2
+
+#define MULTIBOOT_MAX_MODULES 8
+#define MULTIBOOT_CMDLINE_MAX 64
+
+typedef struct {
+    uint64_t start;             /* Physical address of the first byte */
+    uint64_t end;               /* Physical address past the last byte */
+    char cmdline[MULTIBOOT_CMDLINE_MAX];    /* Text after the path in grub.cfg */
+} multiboot_module_t;
+
+typedef struct {
+    uint64_t addr;              /* Physical address of pixel (0, 0) */
+    uint32_t pitch;             /* Bytes per row */
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t type;               /* MULTIBOOT_FB_* */
+    /* Channel layout (MULTIBOOT_FB_RGB only) */
+    uint8_t red_pos, red_size;
+    uint8_t green_pos, green_size;
+    uint8_t blue_pos, blue_size;
+} multiboot_fb_t;
+
+/* Read the boot information GRUB passed (magic from EAX, address from EBX) */
+void multiboot_init(uint32_t magic, uint64_t info_addr);
+
+/* Framebuffer GRUB set up, NULL if none was reported */
+const multiboot_fb_t* multiboot_framebuffer(void);
+
+/* Modules GRUB loaded (module2 lines), in grub.cfg order */
+uint32_t multiboot_module_count(void);
+const multiboot_module_t* multiboot_module(uint32_t index);
+
+#endif
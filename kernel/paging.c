@@ -1,15 +1,34 @@
 #include "paging.h"
 #include "pmm.h"
+#include "reclaim.h"
 #include "panic.h"
 #include "kprint.h"
+#include "initcall.h"
 
 #define ENTRIES_PER_TABLE 512
 #define PAGE_TABLE_MASK 0x1FF
-#define PAGE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+#define PT_COVERAGE     0x200000ULL  /* Bytes mapped by one page table */
 
-/* Root page table (PML4) */
+#define CR0_WP (1ULL << 16)  /* Honour read-only pages in ring 0 (needed for COW) */
+
+#define PT_CACHE_MAX   32   /* Zeroed table pages kept ready */
+#define PT_CACHE_BATCH 8    /* Pages taken from the PMM per refill */
+
+/* Kernel root page table (PML4) */
 static pte_t* pml4_table = NULL;
 
+/* Present entries per page-table page, indexed by page frame number */
+static uint16_t* table_live = NULL;
+
+/* Cache of zeroed table pages (free list threaded through entry 0) */
+static uint64_t pt_cache_head = 0;
+static uint64_t pt_cache_count = 0;
+
+static paging_stats_t stats;
+
+/* Next free address in the I/O window (mappings are never removed) */
+static uint64_t io_next = PAGING_IO_BASE;
+
 /* Extract page table indices from virtual address */
 static inline uint64_t pml4_index(uint64_t vaddr) {
     return (vaddr >> 39) & PAGE_TABLE_MASK;
@@ -27,46 +46,177 @@ static inline uint64_t pt_index(uint64_t vaddr) {
     return (vaddr >> 12) & PAGE_TABLE_MASK;
 }
 
-/* Get or create a page table */
-static pte_t* get_or_create_table(pte_t* parent_table, uint64_t index) {
+/* Root table currently loaded in CR3 */
+static inline pte_t* active_root(void) {
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    return (pte_t*)(cr3 & PAGE_ADDR_MASK);
+}
+
+/* Kernel addresses always live in the kernel tables (shared by every
+ * address space); user addresses belong to the active address space */
+static inline pte_t* root_for(uint64_t vaddr) {
+    return vaddr < USER_SPACE_START ? pml4_table : active_root();
+}
+
+static inline uint16_t* live_count(pte_t* table) {
+    return &table_live[(uint64_t)table / PAGE_SIZE];
+}
+
+static void zero_table(pte_t* table) {
+    for (int i = 0; i < ENTRIES_PER_TABLE; i++) {
+        table[i] = 0;
+    }
+}
+
+/* Refill the table cache with one contiguous batch (one bitmap scan) */
+static void cache_refill(void) {
+    uint64_t count = PT_CACHE_BATCH;
+    uint64_t batch = pmm_alloc_pages(count);
+    if (!batch) {
+        count = 1;
+        batch = pmm_alloc_page();
+    }
+    
+    for (uint64_t i = 0; i < count; i++) {
+        pte_t* table = (pte_t*)(batch + i * PAGE_SIZE);
+        zero_table(table);
+        table[0] = pt_cache_head;
+        pt_cache_head = (uint64_t)table;
+        pt_cache_count++;
+    }
+}
+
+uint64_t paging_alloc_table(void) {
+    if (!pt_cache_head) {
+        stats.cache_misses++;
+        cache_refill();
+    } else {
+        stats.cache_hits++;
+    }
+    
+    pte_t* table = (pte_t*)pt_cache_head;
+    pt_cache_head = table[0];
+    pt_cache_count--;
+    table[0] = 0;
+    
+    *live_count(table) = 0;
+    stats.tables++;
+    return (uint64_t)table;
+}
+
+void paging_free_table(uint64_t table_phys) {
+    pte_t* table = (pte_t*)table_phys;
+    
+    /* Tables torn down whole still hold entries */
+    if (*live_count(table)) {
+        zero_table(table);
+        *live_count(table) = 0;
+    }
+    stats.tables--;
+    
+    if (pt_cache_count >= PT_CACHE_MAX) {
+        pmm_free_page(table_phys);
+        return;
+    }
+    table[0] = pt_cache_head;
+    pt_cache_head = table_phys;
+    pt_cache_count++;
+}
+
+void paging_table_set_live(uint64_t table_phys, uint16_t count) {
+    *live_count((pte_t*)table_phys) = count;
+}
+
+/* Shrinker: return cached table pages to the PMM */
+static uint64_t cache_shrink_count(void) {
+    return pt_cache_count;
+}
+
+static uint64_t cache_shrink_scan(uint64_t target) {
+    uint64_t freed = 0;
+    while (pt_cache_head && freed < target) {
+        pte_t* table = (pte_t*)pt_cache_head;
+        pt_cache_head = table[0];
+        pt_cache_count--;
+        pmm_free_page((uint64_t)table);
+        freed++;
+    }
+    return freed;
+}
+
+static shrinker_t cache_shrinker = {
+    .name = "pt-cache",
+    .count = cache_shrink_count,
+    .scan = cache_shrink_scan,
+};
+
+/* Get or create a page table
+ * user_flag (PAGE_USER or 0) must be set on every level for ring 3 access */
+static pte_t* get_or_create_table(pte_t* parent_table, uint64_t index, uint64_t user_flag) {
     if (parent_table[index] & PAGE_PRESENT) {
         /* Table exists, return it */
+        parent_table[index] |= user_flag;
         return (pte_t*)(parent_table[index] & PAGE_ADDR_MASK);
     }
     
-    /* Allocate new table */
-    uint64_t new_table_phys = pmm_alloc_page();
-    pte_t* new_table = (pte_t*)new_table_phys;
+    /* Install a zeroed table from the cache */
+    uint64_t new_table_phys = paging_alloc_table();
+    parent_table[index] = new_table_phys | PAGE_PRESENT | PAGE_WRITE | user_flag;
+    (*live_count(parent_table))++;
     
-    /* Zero out the new table */
-    for (int i = 0; i < ENTRIES_PER_TABLE; i++) {
-        new_table[i] = 0;
-    }
+    return (pte_t*)new_table_phys;
+}
+
+/* Walk to the leaf entry for a virtual address (NULL if a table is missing) */
+static pte_t* lookup_pte(pte_t* root, uint64_t virt_addr) {
+    uint64_t pml4_i = pml4_index(virt_addr);
+    uint64_t pdpt_i = pdpt_index(virt_addr);
+    uint64_t pd_i = pd_index(virt_addr);
     
-    /* Install in parent */
-    parent_table[index] = new_table_phys | PAGE_PRESENT | PAGE_WRITE;
+    if (!(root[pml4_i] & PAGE_PRESENT)) return NULL;
+    pte_t* pdpt = (pte_t*)(root[pml4_i] & PAGE_ADDR_MASK);
     
-    return new_table;
+    if (!(pdpt[pdpt_i] & PAGE_PRESENT)) return NULL;
+    pte_t* pd = (pte_t*)(pdpt[pdpt_i] & PAGE_ADDR_MASK);
+    
+    if (!(pd[pd_i] & PAGE_PRESENT)) return NULL;
+    pte_t* pt = (pte_t*)(pd[pd_i] & PAGE_ADDR_MASK);
+    
+    return &pt[pt_index(virt_addr)];
 }
 
 void paging_init(void) {
-    /* Allocate PML4 table */
-    pml4_table = (pte_t*)pmm_alloc_page();
-    
-    /* Zero out PML4 */
-    for (int i = 0; i < ENTRIES_PER_TABLE; i++) {
-        pml4_table[i] = 0;
+    /* Live-entry counts: one 16-bit counter per physical page */
+    uint64_t frames = pmm_get_total_memory() / PAGE_SIZE;
+    uint64_t count_pages = (frames * sizeof(uint16_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    table_live = (uint16_t*)pmm_alloc_pages(count_pages);
+    if (!table_live) {
+        panic("Paging: No memory for table counters");
     }
+    for (uint64_t i = 0; i < frames; i++) {
+        table_live[i] = 0;
+    }
+    
+    shrinker_register(&cache_shrinker);
+    
+    /* Allocate PML4 table */
+    pml4_table = (pte_t*)paging_alloc_table();
     
-    /* Identity map first 4MB (kernel space) */
-    for (uint64_t addr = 0; addr < 0x400000; addr += PAGE_SIZE) {
+    /* Identity map all managed physical memory: page tables and frames
+     * are accessed through their physical address (e.g. COW copies) */
+    uint64_t phys_end = pmm_get_total_memory();
+    for (uint64_t addr = 0; addr < phys_end; addr += PAGE_SIZE) {
         paging_map_page(addr, addr, PAGE_PRESENT | PAGE_WRITE);
     }
     
-    kprint_info("Paging initialized (identity mapped 4MB)");
+    kprint_info("Paging initialized (identity mapped physical memory)");
 }
+INITCALL(INIT_MEMORY, paging_init, "pmm_setup");
 
-void paging_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
+void paging_map_page_in(uint64_t root, uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
+    pte_t* root_table = (pte_t*)(root & PAGE_ADDR_MASK);
+    
     /* Get indices */
     uint64_t pml4_i = pml4_index(virt_addr);
     uint64_t pdpt_i = pdpt_index(virt_addr);
@@ -74,59 +224,170 @@ void paging_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
     uint64_t pt_i = pt_index(virt_addr);
     
     /* Walk page tables, creating as needed */
-    pte_t* pdpt = get_or_create_table(pml4_table, pml4_i);
-    pte_t* pd = get_or_create_table(pdpt, pdpt_i);
-    pte_t* pt = get_or_create_table(pd, pd_i);
+    uint64_t user_flag = flags & PAGE_USER;
+    pte_t* pdpt = get_or_create_table(root_table, pml4_i, user_flag);
+    pte_t* pd = get_or_create_table(pdpt, pdpt_i, user_flag);
+    pte_t* pt = get_or_create_table(pd, pd_i, user_flag);
     
     /* Map the page */
+    if (!pte_mapped(pt[pt_i]) && pte_mapped(flags)) {
+        (*live_count(pt))++;
+    } else if (pte_mapped(pt[pt_i]) && !pte_mapped(flags)) {
+        (*live_count(pt))--;
+    }
     pt[pt_i] = (phys_addr & PAGE_ADDR_MASK) | flags;
 }
 
+void paging_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
+    paging_map_page_in((uint64_t)root_for(virt_addr), virt_addr, phys_addr, flags);
+    
+    /* Replacing an existing mapping must not leave a stale translation */
+    __asm__ volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+}
+
 void paging_unmap_page(uint64_t virt_addr) {
-    uint64_t pml4_i = pml4_index(virt_addr);
-    uint64_t pdpt_i = pdpt_index(virt_addr);
-    uint64_t pd_i = pd_index(virt_addr);
-    uint64_t pt_i = pt_index(virt_addr);
+    /* Also frees the page table if this was its last entry */
+    paging_unmap_range(virt_addr, virt_addr + PAGE_SIZE);
+}
+
+pte_t paging_take_page_in(uint64_t root, uint64_t virt_addr) {
+    pte_t* pte = lookup_pte((pte_t*)(root & PAGE_ADDR_MASK), virt_addr);
+    if (!pte || !pte_mapped(*pte)) return 0;
     
-    /* Walk to page table */
-    if (!(pml4_table[pml4_i] & PAGE_PRESENT)) return;
-    pte_t* pdpt = (pte_t*)(pml4_table[pml4_i] & PAGE_ADDR_MASK);
+    /* The table is reclaimed by the caller's unmap of the range */
+    pte_t* pt = (pte_t*)((uint64_t)pte & PAGE_ADDR_MASK);
+    (*live_count(pt))--;
     
-    if (!(pdpt[pdpt_i] & PAGE_PRESENT)) return;
-    pte_t* pd = (pte_t*)(pdpt[pdpt_i] & PAGE_ADDR_MASK);
+    pte_t old = *pte;
+    *pte = 0;
+    return old;
+}
+
+uint64_t paging_map_io(uint64_t phys_addr, uint64_t size, uint64_t flags) {
+    uint64_t first = phys_addr & ~((uint64_t)PAGE_SIZE - 1);
+    uint64_t last = (phys_addr + size + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+    uint64_t span = last - first;
     
-    if (!(pd[pd_i] & PAGE_PRESENT)) return;
-    pte_t* pt = (pte_t*)(pd[pd_i] & PAGE_ADDR_MASK);
+    if (span > PAGING_IO_END - io_next) {
+        return 0;
+    }
     
-    /* Unmap */
-    pt[pt_i] = 0;
+    uint64_t virt = io_next;
+    io_next += span;
+    for (uint64_t off = 0; off < span; off += PAGE_SIZE) {
+        paging_map_page(virt + off, first + off, PAGE_PRESENT | PAGE_WRITE | flags);
+    }
     
-    /* Invalidate TLB entry */
-    __asm__ volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+    return virt + (phys_addr - first);
 }
 
-uint64_t paging_get_physical(uint64_t virt_addr) {
-    uint64_t pml4_i = pml4_index(virt_addr);
-    uint64_t pdpt_i = pdpt_index(virt_addr);
-    uint64_t pd_i = pd_index(virt_addr);
-    uint64_t pt_i = pt_index(virt_addr);
+/* Walk to the page table covering an address (NULL if missing) */
+static pte_t* lookup_pt(pte_t* root, uint64_t virt_addr, pte_t** pdpt_entry, pte_t** pd_entry) {
+    if (!(root[pml4_index(virt_addr)] & PAGE_PRESENT)) return NULL;
+    pte_t* pdpt = (pte_t*)(root[pml4_index(virt_addr)] & PAGE_ADDR_MASK);
     
-    if (!(pml4_table[pml4_i] & PAGE_PRESENT)) return 0;
-    pte_t* pdpt = (pte_t*)(pml4_table[pml4_i] & PAGE_ADDR_MASK);
+    *pdpt_entry = &pdpt[pdpt_index(virt_addr)];
+    if (!(**pdpt_entry & PAGE_PRESENT)) return NULL;
+    pte_t* pd = (pte_t*)(**pdpt_entry & PAGE_ADDR_MASK);
     
-    if (!(pdpt[pdpt_i] & PAGE_PRESENT)) return 0;
-    pte_t* pd = (pte_t*)(pdpt[pdpt_i] & PAGE_ADDR_MASK);
+    *pd_entry = &pd[pd_index(virt_addr)];
+    if (!(**pd_entry & PAGE_PRESENT)) return NULL;
+    return (pte_t*)(**pd_entry & PAGE_ADDR_MASK);
+}
+
+uint64_t paging_unmap_range_in(uint64_t root, uint64_t start, uint64_t end,
+                               uint32_t flags, tlb_gather_t* g) {
+    pte_t* root_table = (pte_t*)(root & PAGE_ADDR_MASK);
+    uint64_t unmapped = 0;
     
-    if (!(pd[pd_i] & PAGE_PRESENT)) return 0;
-    pte_t* pt = (pte_t*)(pd[pd_i] & PAGE_ADDR_MASK);
+    /* One page table (2MB) at a time */
+    for (uint64_t chunk = start; chunk < end; ) {
+        uint64_t chunk_end = (chunk | (PT_COVERAGE - 1)) + 1;
+        if (chunk_end > end || chunk_end < chunk) chunk_end = end;
+        
+        pte_t* pdpt_entry;
+        pte_t* pd_entry;
+        pte_t* pt = lookup_pt(root_table, chunk, &pdpt_entry, &pd_entry);
+        if (pt) {
+            for (uint64_t va = chunk; va < chunk_end && *live_count(pt); va += PAGE_SIZE) {
+                pte_t* pte = &pt[pt_index(va)];
+                if (!pte_mapped(*pte)) continue;
+                
+                if (flags & PAGING_UNMAP_RELEASE) {
+                    tlb_gather_release_page(g, *pte & PAGE_ADDR_MASK);
+                }
+                *pte = 0;
+                (*live_count(pt))--;
+                tlb_gather_add(g, va);
+                unmapped++;
+            }
+            
+            /* Reclaim the page table, and its directory, once empty */
+            if (*live_count(pt) == 0) {
+                pte_t* pd = (pte_t*)((uint64_t)pd_entry & PAGE_ADDR_MASK);
+                *pd_entry = 0;
+                tlb_gather_add(g, chunk);  /* Also drops cached upper-level entries */
+                tlb_gather_release_table(g, (uint64_t)pt);
+                stats.reclaimed++;
+                
+                if (--(*live_count(pd)) == 0) {
+                    *pdpt_entry = 0;
+                    tlb_gather_release_table(g, (uint64_t)pd);
+                    stats.reclaimed++;
+                }
+            }
+        }
+        chunk = chunk_end;
+    }
+    
+    return unmapped;
+}
+
+void paging_unmap_range(uint64_t start, uint64_t end) {
+    tlb_gather_t g;
+    tlb_gather_init(&g, (uint64_t)root_for(start));
+    paging_unmap_range_in(g.root, start, end, 0, &g);
+    tlb_gather_flush(&g);
+}
+
+uint64_t paging_get_physical(uint64_t virt_addr) {
+    pte_t* pte = lookup_pte(root_for(virt_addr), virt_addr);
     
-    if (!(pt[pt_i] & PAGE_PRESENT)) return 0;
+    if (!pte || !(*pte & PAGE_PRESENT)) return 0;
     
-    return (pt[pt_i] & PAGE_ADDR_MASK) | (virt_addr & 0xFFF);
+    return (*pte & PAGE_ADDR_MASK) | (virt_addr & 0xFFF);
+}
+
+void paging_get_stats(paging_stats_t* out) {
+    *out = stats;
+    out->cached = pt_cache_count;
+}
+
+pte_t* paging_get_pte(uint64_t root, uint64_t virt_addr) {
+    return lookup_pte((pte_t*)(root & PAGE_ADDR_MASK), virt_addr);
+}
+
+uint64_t paging_kernel_root(void) {
+    return (uint64_t)pml4_table;
+}
+
+uint64_t paging_current_root(void) {
+    return (uint64_t)active_root();
+}
+
+void paging_switch_root(uint64_t root) {
+    __asm__ volatile("mov %0, %%cr3" : : "r"(root) : "memory");
 }
 
 void paging_enable(void) {
     /* Load PML4 into CR3 */
     __asm__ volatile("mov %0, %%cr3" : : "r"(pml4_table));
+    
+    /* Make read-only pages read-only for the kernel too */
+    uint64_t cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_WP));
+    
     kprint_ok("Paging enabled (CR3 loaded)");
 }
+INITCALL(INIT_MEMORY, paging_enable, "paging_init");
@@ -2,6 +2,7 @@
 #define PAGING_H
 
 #include <stdint.h>
+#include "tlb.h"
 
 /* x86_64 Paging Structures
  * 4-level paging: PML4 -> PDPT -> PD -> PT
@@ -11,20 +12,103 @@
 #define PAGE_PRESENT    (1ULL << 0)
 #define PAGE_WRITE      (1ULL << 1)
 #define PAGE_USER       (1ULL << 2)
+#define PAGE_WRITE_THROUGH (1ULL << 3)
+#define PAGE_CACHE_DISABLE (1ULL << 4)
 #define PAGE_SIZE_FLAG  (1ULL << 7)
+#define PAGE_COW        (1ULL << 9)   /* Software: copy-on-write (read-only until written) */
+#define PAGE_SHARED     (1ULL << 10)  /* Software: shared memory page (never COW) */
+#define PAGE_PROTNONE   (1ULL << 11)  /* Software: populated but inaccessible (not present) */
+
+#define PAGE_ADDR_MASK  0x000FFFFFFFFFF000ULL
+
+/* User address space: starts at the second PML4 entry so the first
+ * one (kernel identity map, heap, stacks) is not writable from ring 3
+ * (only the read-only shared clock page there is user-visible).
+ * The last page is never mapped, keeping SYSRET's RIP canonical. */
+#define USER_SPACE_START 0x0000008000000000ULL
+#define USER_SPACE_END   0x00007FFFFFFFF000ULL
+
+/* Kernel window for device registers and firmware tables */
+#define PAGING_IO_BASE   0x40000000ULL
+#define PAGING_IO_END    0x50000000ULL
 
 /* Page table entry */
 typedef uint64_t pte_t;
 
+/* A leaf entry that holds a frame, whether or not it is accessible */
+static inline int pte_mapped(pte_t pte) {
+    return (pte & (PAGE_PRESENT | PAGE_PROTNONE)) != 0;
+}
+
+/* Page-table memory statistics */
+typedef struct {
+    uint64_t tables;            /* Table pages in use (tables * PAGE_SIZE bytes) */
+    uint64_t cached;            /* Zeroed table pages waiting in the cache */
+    uint64_t cache_hits;        /* Tables served from the cache */
+    uint64_t cache_misses;      /* Cache refills from the PMM */
+    uint64_t reclaimed;         /* Empty PT/PD pages freed on unmap */
+} paging_stats_t;
+
 /* Initialize paging system */
 void paging_init(void);
 
-/* Map a virtual address to a physical address */
+/* Map a virtual address to a physical address
+ * Kernel addresses go to the shared kernel tables, user addresses to the
+ * address space currently loaded in CR3 */
 void paging_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags);
 
+/* Map a page in a specific page table root (no TLB flush) */
+void paging_map_page_in(uint64_t root, uint64_t virt_addr, uint64_t phys_addr, uint64_t flags);
+
+/* Remove a mapping from a root and return the old entry (no TLB flush)
+ * Used to move a page between spaces without copying it */
+pte_t paging_take_page_in(uint64_t root, uint64_t virt_addr);
+
+/* Page-table pages come zeroed from a small cache; every table tracks its
+ * number of present entries so that empty PT/PD pages can be reclaimed */
+uint64_t paging_alloc_table(void);
+
+/* Return a table page to the cache */
+void paging_free_table(uint64_t table_phys);
+
+/* Set the present-entry count of a table filled in directly */
+void paging_table_set_live(uint64_t table_phys, uint16_t count);
+
+/* Get page-table memory statistics */
+void paging_get_stats(paging_stats_t* out);
+
+/* Get the leaf entry for an address in a root (NULL if no page table) */
+pte_t* paging_get_pte(uint64_t root, uint64_t virt_addr);
+
+/* Kernel page table root (physical address) */
+uint64_t paging_kernel_root(void);
+
+/* Page table root currently loaded in CR3 */
+uint64_t paging_current_root(void);
+
+/* Load a page table root into CR3 */
+void paging_switch_root(uint64_t root);
+
 /* Unmap a virtual address */
 void paging_unmap_page(uint64_t virt_addr);
 
+/* Map physical memory outside RAM (MMIO, ACPI tables) into the I/O window
+ * Returns the virtual address of phys_addr, 0 if the window is full.
+ * flags adds caching bits, e.g. PAGE_CACHE_DISABLE for registers */
+uint64_t paging_map_io(uint64_t phys_addr, uint64_t size, uint64_t flags);
+
+/* paging_unmap_range_in() flags */
+#define PAGING_UNMAP_RELEASE 0x1    /* Drop a reference to every unmapped frame */
+
+/* Unmap [start, end) in a root, recording invalidations in g (the caller
+ * flushes). Page tables left empty by the range are freed after the flush.
+ * Returns the number of pages that were mapped */
+uint64_t paging_unmap_range_in(uint64_t root, uint64_t start, uint64_t end,
+                               uint32_t flags, tlb_gather_t* g);
+
+/* Unmap [start, end) with a single batched invalidation */
+void paging_unmap_range(uint64_t start, uint64_t end);
+
 /* Get physical address from virtual address */
 uint64_t paging_get_physical(uint64_t virt_addr);
 
@@ -1,5 +1,8 @@
 #include "panic.h"
 #include "vga.h"
+#include "kprintf.h"
+#include "serial.h"
+#include "klog.h"
 
 /* Halt the CPU safely in an infinite loop */
 static inline void halt(void) {
@@ -18,20 +21,24 @@ static inline void halt(void) {
  * which helps with optimization and prevents warnings.
  */
 void panic(const char* message) {
+    /* Serial output must not wait on an interrupt that will never come */
+    serial_set_polled();
+    
+    /* Get out what was logged but not printed yet */
+    klog_flush();
+    
     /* Clear screen and display panic message */
+    kprint_set_screen(1);
     vga_clear();
     
     /* Print panic header in red */
-    vga_println("", VGA_COLOR_LIGHT_RED);
-    vga_println("*** KERNEL PANIC ***", VGA_COLOR_LIGHT_RED);
-    vga_println("", VGA_COLOR_LIGHT_RED);
+    kprintf_color(VGA_COLOR_LIGHT_RED, "\n*** KERNEL PANIC ***\n\n");
     
     /* Print the error message */
-    vga_print("Fatal error: ", VGA_COLOR_WHITE);
-    vga_println(message, VGA_COLOR_YELLOW);
+    kprintf_color(VGA_COLOR_WHITE, "Fatal error: ");
+    kprintf_color(VGA_COLOR_YELLOW, "%s\n", message);
     
-    vga_println("", VGA_COLOR_WHITE);
-    vga_println("System halted. Please reboot.", VGA_COLOR_LIGHT_GRAY);
+    kprintf_color(VGA_COLOR_LIGHT_GRAY, "\nSystem halted. Please reboot.\n");
     
     /* Halt the CPU - never returns */
     halt();
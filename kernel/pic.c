@@ -1,4 +1,5 @@
 #include "pic.h"
+#include "initcall.h"
 #include <stdint.h>
 
 #define PIC1_COMMAND 0x20
@@ -11,6 +12,10 @@
 #define ICW4_8086 0x01
 
 #define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0B
+
+/* Current mask of each PIC (IMR reads are slow port I/O) */
+static uint8_t cached_mask[2] = { 0xFF, 0xFF };
 
 static inline void outb(uint16_t port, uint8_t val) {
     __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
@@ -48,26 +53,44 @@ void pic_remap(void) {
     /* Restore saved masks */
     outb(PIC1_DATA, mask1);
     outb(PIC2_DATA, mask2);
+    cached_mask[0] = mask1;
+    cached_mask[1] = mask2;
 }
+INITCALL(INIT_EARLY, pic_remap);
 
 void pic_disable(void) {
     /* Mask all IRQs */
     outb(PIC1_DATA, 0xFF);
     outb(PIC2_DATA, 0xFF);
+    cached_mask[0] = 0xFF;
+    cached_mask[1] = 0xFF;
+}
+
+static void write_mask(uint8_t irq, uint8_t masked) {
+    uint8_t chip = irq >= 8;
+    uint8_t bit = 1 << (irq & 7);
+    uint8_t mask = masked ? (cached_mask[chip] | bit) : (cached_mask[chip] & ~bit);
+    
+    if (mask != cached_mask[chip]) {
+        cached_mask[chip] = mask;
+        outb(chip ? PIC2_DATA : PIC1_DATA, mask);
+    }
 }
 
-void pic_unmask_irq1(void) {
-    /* Enable IRQ1 (keyboard) only */
-    uint8_t mask = inb(PIC1_DATA);
-    mask &= ~(1 << 1);  // Clear bit 1 (IRQ1)
-    outb(PIC1_DATA, mask);
+void pic_mask(uint8_t irq) {
+    if (irq < 16) {
+        write_mask(irq, 1);
+    }
 }
 
-void pic_unmask_irq0(void) {
-    /* Enable IRQ0 (timer) */
-    uint8_t mask = inb(PIC1_DATA);
-    mask &= ~(1 << 0);  // Clear bit 0 (IRQ0)
-    outb(PIC1_DATA, mask);
+void pic_unmask(uint8_t irq) {
+    if (irq >= 16) return;
+    
+    /* Lines on the slave need the cascade input open as well */
+    if (irq >= 8) {
+        write_mask(2, 0);
+    }
+    write_mask(irq, 0);
 }
 
 void pic_send_eoi(uint8_t irq) {
@@ -78,3 +101,22 @@ void pic_send_eoi(uint8_t irq) {
     /* Always send EOI to master PIC */
     outb(PIC1_COMMAND, PIC_EOI);
 }
+
+int pic_is_spurious(uint8_t irq) {
+    if (irq != 7 && irq != 15) {
+        return 0;
+    }
+    
+    /* A real interrupt has its in-service bit set */
+    uint16_t port = irq == 15 ? PIC2_COMMAND : PIC1_COMMAND;
+    outb(port, PIC_READ_ISR);
+    if (inb(port) & 0x80) {
+        return 0;
+    }
+    
+    /* The master did see the cascade line, so it still needs its EOI */
+    if (irq == 15) {
+        outb(PIC1_COMMAND, PIC_EOI);
+    }
+    return 1;
+}
@@ -9,11 +9,16 @@ void pic_remap(void);
 /* Disable all IRQs */
 void pic_disable(void);
 
-/* Enable specific IRQs */
-void pic_unmask_irq0(void);  // Timer
-void pic_unmask_irq1(void);  // Keyboard
+/* Mask or unmask one IRQ line (0-15) */
+void pic_mask(uint8_t irq);
+void pic_unmask(uint8_t irq);
 
 /* Send End of Interrupt signal */
 void pic_send_eoi(uint8_t irq);
 
+/* Check whether IRQ 7 or 15 was spurious (not in service)
+ * A spurious IRQ 15 still needs an EOI to the master, which is sent here.
+ */
+int pic_is_spurious(uint8_t irq);
+
 #endif
@@ -1,12 +1,38 @@
 #include "pmm.h"
+#include "reclaim.h"
 #include "panic.h"
 #include "kprint.h"
+#include "counter.h"
+#include "initcall.h"
+#include "multiboot.h"
+
+/* Pages reclaimed up front when an allocation finds memory below min */
+#define RECLAIM_DIRECT_BATCH 16
 
 /* Bitmap to track page allocation status */
 static uint8_t* page_bitmap = NULL;
+static uint16_t* page_refcounts = NULL;  /* Follows the bitmap */
 static uint64_t total_pages = 0;
 static uint64_t used_pages = 0;
 
+static uint64_t read_used_pages(void* ctx);
+
+static counter_t page_allocs = {
+    .name = "pmm.page_allocs",
+    .kind = COUNTER_EVENT,
+};
+
+static counter_t page_frees = {
+    .name = "pmm.page_frees",
+    .kind = COUNTER_EVENT,
+};
+
+static counter_t pages_used = {
+    .name = "pmm.used_pages",
+    .kind = COUNTER_GAUGE,
+    .read = read_used_pages,
+};
+
 /* Memory region after kernel and heap */
 extern uint8_t heap_end;
 #define BITMAP_START ((uint64_t)&heap_end)
@@ -32,6 +58,38 @@ static inline uint8_t bitmap_test(uint64_t page) {
     return (page_bitmap[byte] & (1 << bit)) != 0;
 }
 
+/* First address at or after start where size bytes miss every boot
+ * module (GRUB may load one right behind the kernel) */
+static uint64_t place_metadata(uint64_t start, uint64_t size) {
+    int moved = 1;
+    while (moved) {
+        moved = 0;
+        for (uint32_t i = 0; i < multiboot_module_count(); i++) {
+            const multiboot_module_t* mod = multiboot_module(i);
+            if (start < mod->end && mod->start < start + size) {
+                start = (mod->end + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+                moved = 1;
+            }
+        }
+    }
+    return start;
+}
+
+/* Keep boot module pages out of the allocator for good */
+static void reserve_modules(void) {
+    for (uint32_t i = 0; i < multiboot_module_count(); i++) {
+        const multiboot_module_t* mod = multiboot_module(i);
+        uint64_t first = mod->start / PAGE_SIZE;
+        uint64_t last = (mod->end + PAGE_SIZE - 1) / PAGE_SIZE;
+        for (uint64_t page = first; page < last && page < total_pages; page++) {
+            if (!bitmap_test(page)) {
+                bitmap_set(page);
+                used_pages++;
+            }
+        }
+    }
+}
+
 void pmm_init(uint64_t mem_size) {
     /* Calculate number of pages */
     total_pages = mem_size / PAGE_SIZE;
@@ -39,36 +97,122 @@ void pmm_init(uint64_t mem_size) {
     /* Calculate bitmap size (1 bit per page) */
     uint64_t bitmap_size = (total_pages + PAGES_PER_BYTE - 1) / PAGES_PER_BYTE;
     
-    /* Place bitmap right after heap */
-    page_bitmap = (uint8_t*)BITMAP_START;
+    uint64_t refcounts_size = total_pages * sizeof(uint16_t);
+    uint64_t metadata_size = bitmap_size + 1 + refcounts_size;
+    
+    /* Place bitmap right after heap, or past a module in the way */
+    uint64_t metadata_start = place_metadata(BITMAP_START, metadata_size);
+    if (metadata_start + metadata_size > mem_size) {
+        panic("PMM: Boot modules leave no room for the page bitmap");
+    }
+    page_bitmap = (uint8_t*)metadata_start;
     
     /* Initialize bitmap - mark all pages as free */
     for (uint64_t i = 0; i < bitmap_size; i++) {
         page_bitmap[i] = 0;
     }
     
-    /* Mark first 2MB as used (kernel, heap, bitmap) */
-    uint64_t reserved_pages = (0x200000 + bitmap_size) / PAGE_SIZE + 1;
+    /* Reference counts right after the bitmap (2-byte aligned) */
+    page_refcounts = (uint16_t*)((metadata_start + bitmap_size + 1) & ~1ULL);
+    for (uint64_t i = 0; i < total_pages; i++) {
+        page_refcounts[i] = 0;
+    }
+    
+    /* Mark first 2MB as used (kernel, heap, bitmap, refcounts), or up to
+     * the end of metadata that had to move further up */
+    uint64_t reserved_end = 0x200000 + metadata_size;
+    if (metadata_start + metadata_size > reserved_end) {
+        reserved_end = metadata_start + metadata_size;
+    }
+    uint64_t reserved_pages = reserved_end / PAGE_SIZE + 1;
     for (uint64_t i = 0; i < reserved_pages; i++) {
         bitmap_set(i);
         used_pages++;
     }
+    reserve_modules();
+    
+    counter_register(&page_allocs);
+    counter_register(&page_frees);
+    counter_register(&pages_used);
     
     kprint_info("Physical Memory Manager initialized");
 }
 
-uint64_t pmm_alloc_page(void) {
-    /* Find first free page */
+/* Boot setup: the kernel assumes PMM_BOOT_MEMORY of RAM */
+static void pmm_setup(void) {
+    pmm_init(PMM_BOOT_MEMORY);
+}
+INITCALL(INIT_MEMORY, pmm_setup);
+
+static uint64_t read_used_pages(void* ctx) {
+    (void)ctx;
+    return used_pages;
+}
+
+/* Take the first free page (0 if none) */
+static uint64_t take_free_page(void) {
     for (uint64_t i = 0; i < total_pages; i++) {
         if (!bitmap_test(i)) {
             bitmap_set(i);
+            page_refcounts[i] = 1;
             used_pages++;
+            counter_inc(&page_allocs);
             return i * PAGE_SIZE;
         }
     }
+    return 0;
+}
+
+uint64_t pmm_alloc_page_flags(uint32_t flags) {
+    int may_wait = (flags & (ALLOC_WAIT | ALLOC_NOFAIL)) && !(flags & ALLOC_ATOMIC);
+    
+    /* Leave the reserve below min to atomic allocations */
+    if (may_wait && reclaim_below_min()) {
+        reclaim_direct(RECLAIM_DIRECT_BATCH);
+    }
+    
+    uint64_t page = take_free_page();
+    while (!page && may_wait && reclaim_direct(1)) {
+        page = take_free_page();
+    }
+    
+    if (page) {
+        reclaim_notify();
+        return page;
+    }
+    
+    reclaim_note_failure();
+    if (flags & ALLOC_NOFAIL) {
+        panic("PMM: Out of physical memory");
+    }
+    return 0;
+}
+
+uint64_t pmm_alloc_page(void) {
+    return pmm_alloc_page_flags(ALLOC_WAIT | ALLOC_NOFAIL);
+}
+
+uint64_t pmm_alloc_pages(uint64_t count) {
+    uint64_t run = 0;
+    
+    /* First fit: find count free pages in a row */
+    for (uint64_t i = 0; i < total_pages; i++) {
+        if (bitmap_test(i)) {
+            run = 0;
+            continue;
+        }
+        if (++run == count) {
+            uint64_t first = i + 1 - count;
+            for (uint64_t page = first; page <= i; page++) {
+                bitmap_set(page);
+                page_refcounts[page] = 1;
+            }
+            used_pages += count;
+            counter_add(&page_allocs, count);
+            return first * PAGE_SIZE;
+        }
+    }
     
-    /* Out of memory */
-    panic("PMM: Out of physical memory");
     return 0;
 }
 
@@ -84,7 +228,45 @@ void pmm_free_page(uint64_t page_addr) {
     }
     
     bitmap_clear(page);
+    page_refcounts[page] = 0;
     used_pages--;
+    counter_inc(&page_frees);
+}
+
+void pmm_page_ref(uint64_t page_addr) {
+    uint64_t page = page_addr / PAGE_SIZE;
+    
+    if (page >= total_pages || !bitmap_test(page)) {
+        panic("PMM: Reference to free page");
+    }
+    
+    page_refcounts[page]++;
+}
+
+uint16_t pmm_page_unref(uint64_t page_addr) {
+    uint64_t page = page_addr / PAGE_SIZE;
+    
+    if (page >= total_pages || page_refcounts[page] == 0) {
+        panic("PMM: Unbalanced page unref");
+    }
+    
+    if (--page_refcounts[page] == 0) {
+        bitmap_clear(page);
+        used_pages--;
+        counter_inc(&page_frees);
+    }
+    
+    return page_refcounts[page];
+}
+
+uint16_t pmm_page_refcount(uint64_t page_addr) {
+    uint64_t page = page_addr / PAGE_SIZE;
+    
+    if (page >= total_pages) {
+        return 0;
+    }
+    
+    return page_refcounts[page];
 }
 
 uint64_t pmm_get_free_memory(void) {
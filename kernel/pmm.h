@@ -11,16 +11,39 @@
 
 #define PAGE_SIZE 4096
 #define PAGES_PER_BYTE 8
+#define PMM_BOOT_MEMORY (32 * 1024 * 1024)   /* RAM managed from boot */
+
+/* Allocation flags (see reclaim.h) */
+#define ALLOC_ATOMIC 0x1    /* Never reclaim, fail fast (may dip into the reserve) */
+#define ALLOC_WAIT   0x2    /* Reclaim synchronously before giving up */
+#define ALLOC_NOFAIL 0x4    /* Panic instead of returning 0 */
 
 /* Initialize physical memory manager */
 void pmm_init(uint64_t mem_size);
 
-/* Allocate a physical page (returns physical address) */
+/* Allocate a physical page (returns physical address)
+ * Same as pmm_alloc_page_flags(ALLOC_WAIT | ALLOC_NOFAIL) */
 uint64_t pmm_alloc_page(void);
 
+/* Allocate a physical page with ALLOC_* flags (returns 0 on failure) */
+uint64_t pmm_alloc_page_flags(uint32_t flags);
+
+/* Allocate count physically contiguous pages (returns 0 if no run is free) */
+uint64_t pmm_alloc_pages(uint64_t count);
+
 /* Free a physical page */
 void pmm_free_page(uint64_t page_addr);
 
+/* Per-page reference counts (for pages shared between address spaces)
+ * A freshly allocated page has a count of 1 */
+void pmm_page_ref(uint64_t page_addr);
+
+/* Drop a reference, freeing the page when it reaches 0 (returns new count) */
+uint16_t pmm_page_unref(uint64_t page_addr);
+
+/* Get the reference count of a page */
+uint16_t pmm_page_refcount(uint64_t page_addr);
+
 /* Get memory statistics */
 uint64_t pmm_get_free_memory(void);
 uint64_t pmm_get_used_memory(void);
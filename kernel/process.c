@@ -1,10 +1,26 @@
 #include "process.h"
 #include "heap.h"
+#include "kstack.h"
+#include "paging.h"
+#include "pmm.h"
+#include "vmspace.h"
+#include "vma.h"
+#include "ipc.h"
 #include "panic.h"
 #include "kprint.h"
+#include "klog.h"
+#include "scheduler.h"
+#include "irqtrace.h"
+#include "ramdisk.h"
+#include "syscall.h"
+#include "initcall.h"
 
-#define MAX_PROCESSES 64
 #define DEFAULT_STACK_SIZE 8192  /* 8KB stack per process */
+#define INIT_PATH          "bin/init"
+
+/* Enter ring 3 (syscall_entry.asm) */
+extern void usermode_enter(uint64_t rip, uint64_t rsp);
+extern void syscall_fork_return(void);
 
 static process_t* process_table[MAX_PROCESSES];
 static process_t* current_process = NULL;
@@ -17,18 +33,23 @@ void process_init(void) {
     }
     
     /* Create idle process (PID 0) */
-    current_process = heap_alloc(sizeof(process_t));
+    current_process = heap_alloc_flags(sizeof(process_t), ALLOC_NOFAIL);
     current_process->pid = 0;
     current_process->state = PROCESS_RUNNING;
     current_process->stack = NULL;  /* Kernel uses its own stack */
     current_process->stack_size = 0;
     current_process->time_slice = 0;
+    current_process->cpu_ticks = 0;
+    current_process->is_user = 0;
+    current_process->vm = NULL;
+    current_process->ipc_call = NULL;
     current_process->next = NULL;
     
     process_table[0] = current_process;
     
     kprint_ok("Process management initialized");
 }
+INITCALL(INIT_CORE, process_init);
 
 process_t* process_create(void (*entry_point)(void), uint64_t stack_size) {
     if (next_pid >= MAX_PROCESSES) {
@@ -42,11 +63,12 @@ process_t* process_create(void (*entry_point)(void), uint64_t stack_size) {
         panic("Failed to allocate PCB");
     }
     
-    /* Allocate stack */
-    proc->stack = heap_alloc(stack_size);
+    /* Allocate guard-paged stack */
+    proc->stack = kstack_alloc(stack_size);
     if (!proc->stack) {
         heap_free(proc);
-        panic("Failed to allocate process stack");
+        kprint_error("Failed to allocate process stack");
+        return NULL;
     }
     
     /* Initialize PCB */
@@ -54,6 +76,12 @@ process_t* process_create(void (*entry_point)(void), uint64_t stack_size) {
     proc->state = PROCESS_READY;
     proc->stack_size = stack_size;
     proc->time_slice = 10;  /* 10 timer ticks */
+    proc->cpu_ticks = 0;
+    proc->is_user = 0;
+    proc->vm = NULL;
+    proc->user_entry = 0;
+    proc->user_stack_top = 0;
+    proc->ipc_call = NULL;
     proc->next = NULL;
     
     /* Set up initial context */
@@ -62,6 +90,9 @@ process_t* process_create(void (*entry_point)(void), uint64_t stack_size) {
     proc->context.rbp = proc->context.rsp;
     proc->context.rflags = 0x202;  /* Interrupts enabled */
     
+    /* Kernel processes run on the kernel page tables (context_switch loads CR3) */
+    proc->context.cr3 = paging_kernel_root();
+    
     /* Zero out other registers */
     proc->context.rax = proc->context.rbx = proc->context.rcx = proc->context.rdx = 0;
     proc->context.rsi = proc->context.rdi = 0;
@@ -74,27 +105,175 @@ process_t* process_create(void (*entry_point)(void), uint64_t stack_size) {
     return proc;
 }
 
+/* Map zeroed user pages into a space; pages are filled from src
+ * (physical memory is identity mapped, so the space need not be active).
+ * Returns 0 if memory ran out; destroying the space frees what was mapped */
+static int load_user_pages(vm_space_t* vm, uint64_t vaddr, uint64_t pages,
+                           const uint8_t* src, uint64_t src_size) {
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t phys = pmm_alloc_page_flags(ALLOC_WAIT);
+        if (!phys) {
+            return 0;
+        }
+        uint8_t* dst = (uint8_t*)phys;
+        
+        for (uint64_t b = 0; b < PAGE_SIZE; b++) {
+            uint64_t offset = i * PAGE_SIZE + b;
+            dst[b] = offset < src_size ? src[offset] : 0;
+        }
+        
+        vm_space_map(vm, vaddr + i * PAGE_SIZE, phys, PAGE_PRESENT | PAGE_WRITE | PAGE_USER);
+    }
+    return 1;
+}
+
+/* Kernel-side entry of a user process: drop to ring 3 */
+static void user_process_start(void) {
+    process_t* proc = process_current();
+    usermode_enter(proc->user_entry, proc->user_stack_top);
+}
+
+process_t* process_create_user(const void* image, uint64_t image_size) {
+    if (image_size == 0 || image_size > USER_STACK_TOP - USER_STACK_SIZE - USER_CODE_BASE) {
+        return NULL;
+    }
+    
+    vm_space_t* vm = vm_space_create();
+    if (!vm) {
+        return NULL;
+    }
+    
+    /* Code pages are copied in now; stack pages are populated on first touch */
+    uint64_t code_size = (image_size + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+    vm_map_anon(vm, USER_CODE_BASE, code_size,
+                VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXEC, VM_MAP_FIXED);
+    vm_map_anon(vm, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_SIZE,
+                VM_PROT_READ | VM_PROT_WRITE, VM_MAP_FIXED);
+    if (!load_user_pages(vm, USER_CODE_BASE, code_size / PAGE_SIZE,
+                         (const uint8_t*)image, image_size)) {
+        vm_space_destroy(vm);
+        return NULL;
+    }
+    
+    process_t* proc = process_create(user_process_start, DEFAULT_STACK_SIZE);
+    if (!proc) {
+        vm_space_destroy(vm);
+        return NULL;
+    }
+    
+    proc->is_user = 1;
+    proc->vm = vm;
+    proc->user_entry = USER_CODE_BASE;
+    proc->user_stack_top = USER_STACK_TOP;
+    proc->context.cr3 = vm->pml4_phys;
+    
+    return proc;
+}
+
+process_t* process_fork(void) {
+    process_t* parent = current_process;
+    if (!parent || !parent->vm) {
+        return NULL;
+    }
+    
+    vm_space_t* vm = vm_space_clone(parent->vm);
+    if (!vm) {
+        return NULL;
+    }
+    
+    process_t* child = process_create(syscall_fork_return, DEFAULT_STACK_SIZE);
+    if (!child) {
+        vm_space_destroy(vm);
+        return NULL;
+    }
+    
+    child->is_user = 1;
+    child->vm = vm;
+    child->user_entry = parent->user_entry;
+    child->user_stack_top = parent->user_stack_top;
+    child->context.cr3 = vm->pml4_phys;
+    
+    /* The child starts on a copy of the parent's syscall frame, so it
+     * leaves the syscall with the parent's registers */
+    const syscall_frame_t* frame =
+        (const syscall_frame_t*)(process_kernel_stack_top(parent) - sizeof(syscall_frame_t));
+    syscall_frame_t* copy =
+        (syscall_frame_t*)(process_kernel_stack_top(child) - sizeof(syscall_frame_t));
+    *copy = *frame;
+    child->context.rsp = (uint64_t)copy;
+    child->context.rbp = 0;
+    
+    return child;
+}
+
+/* Start the first user process from the ramdisk, if it has one */
+void process_start_init(void) {
+    const ramdisk_file_t* image = ramdisk_lookup(INIT_PATH);
+    if (!image) {
+        klog(LOG_WARN, "No /%s on the ramdisk, no user process started", INIT_PATH);
+        return;
+    }
+    
+    process_t* proc = process_create_user(image->data, image->size);
+    if (!proc) {
+        klog(LOG_ERROR, "Failed to create /%s", INIT_PATH);
+        return;
+    }
+    scheduler_add(proc);
+    klog(LOG_OK, "Started /%s as pid %u", INIT_PATH, proc->pid);
+}
+INITCALL(INIT_DEFERRED, process_start_init, "syscall_init", "ipc_init", "ramdisk_init");
+
+uint64_t process_kernel_stack_top(process_t* proc) {
+    if (!proc->stack) {
+        return 0;
+    }
+    return (uint64_t)proc->stack + proc->stack_size;
+}
+
 void process_exit(void) {
     if (!current_process || current_process->pid == 0) {
         panic("Cannot exit idle process");
     }
     
+    /* No preemption from here: a process switched away while marked
+     * terminated is never resumed */
+    irq_save();
     current_process->state = PROCESS_TERMINATED;
     
     /* Free resources */
-    if (current_process->stack) {
-        heap_free(current_process->stack);
+    ipc_process_exit(current_process->pid);
+    
+    if (current_process->vm) {
+        /* Leave the space before tearing it down (we run on a kernel stack,
+         * which every space maps) */
+        paging_switch_root(paging_kernel_root());
+        vm_space_destroy(current_process->vm);
+        current_process->vm = NULL;
+        current_process->is_user = 0;
     }
     
+    /* The kernel stack is still in use here: the scheduler frees it
+     * after switching away */
     process_table[current_process->pid] = NULL;
     
-    /* Switch to next process (scheduler will handle this) */
+    /* A terminated process is never queued again, so this does not come
+     * back; the loop only covers a yield with nothing else to run */
+    while (1) {
+        scheduler_yield();
+        irq_halt();
+        irq_save();
+    }
 }
 
 process_t* process_current(void) {
     return current_process;
 }
 
+void process_set_current(process_t* proc) {
+    current_process = proc;
+}
+
 process_t* process_get(uint32_t pid) {
     if (pid >= MAX_PROCESSES) {
         return NULL;
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+struct vm_space;
+struct ipc_call;
+
 /* Process states */
 typedef enum {
     PROCESS_READY,      /* Ready to run */
@@ -30,21 +33,52 @@ typedef struct process {
     uint64_t* stack;                /* Kernel stack */
     uint64_t stack_size;            /* Stack size */
     uint64_t time_slice;            /* Remaining time slice */
+    uint64_t cpu_ticks;             /* Busy timer ticks spent running */
+    uint8_t is_user;                /* Runs in ring 3 */
+    struct vm_space* vm;            /* Address space (NULL = kernel tables) */
+    uint64_t user_entry;            /* Ring 3 entry point */
+    uint64_t user_stack_top;        /* Initial ring 3 stack pointer */
+    struct ipc_call* ipc_call;      /* Outstanding ipc_call() awaiting a reply */
     struct process* next;           /* Next process in queue */
 } process_t;
 
+#define MAX_PROCESSES 64
+
+/* User process layout (same addresses in every address space) */
+#define USER_CODE_BASE    0x0000008000000000ULL   /* USER_SPACE_START */
+#define USER_STACK_TOP    0x0000008040000000ULL   /* 1GB above the code */
+#define USER_STACK_SIZE   0x4000                  /* 16KB user stack */
+
 /* Initialize process management */
 void process_init(void);
 
 /* Create a new process */
 process_t* process_create(void (*entry_point)(void), uint64_t stack_size);
 
-/* Terminate current process */
-void process_exit(void);
+/* Create a ring 3 process from a flat, position-independent image
+ * (execution starts at the first byte) */
+process_t* process_create_user(const void* image, uint64_t image_size);
+
+/* Copy the current user process from inside a system call: the child
+ * shares its memory copy-on-write and returns 0 from the same syscall.
+ * Not queued yet; NULL on failure */
+process_t* process_fork(void);
+
+/* Start /bin/init from the ramdisk in ring 3 (deferred initcall) */
+void process_start_init(void);
+
+/* Top of a process's kernel stack (TSS RSP0 / syscall stack) */
+uint64_t process_kernel_stack_top(process_t* proc);
+
+/* Terminate current process and switch away (never returns) */
+void process_exit(void) __attribute__((noreturn));
 
 /* Get current running process */
 process_t* process_current(void);
 
+/* Set current running process (called by the scheduler on a switch) */
+void process_set_current(process_t* proc);
+
 /* Get process by PID */
 process_t* process_get(uint32_t pid);
 
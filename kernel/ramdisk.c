@@ -0,0 +1,208 @@
+#include "ramdisk.h"
+#include "multiboot.h"
+#include "paging.h"
+#include "pmm.h"
+#include "klog.h"
+#include "initcall.h"
+
+#include <stddef.h>
+
+#define CPIO_HEADER_SIZE  110
+#define CPIO_FIELD_SIZE   8
+#define CPIO_MODE         14        /* Field offsets in the header */
+#define CPIO_FILESIZE     54
+#define CPIO_NAMESIZE     94
+
+#define HASH_SLOTS        (RAMDISK_MAX_FILES * 2)   /* Power of two */
+
+static ramdisk_file_t files[RAMDISK_MAX_FILES];
+static uint32_t file_count = 0;
+
+/* Open addressing over files[]: slot holds index + 1, 0 = empty */
+static uint16_t slots[HASH_SLOTS];
+
+/* Skip "./" and "/" prefixes so every spelling of a path matches */
+static const char* normalize(const char* path) {
+    while (1) {
+        if (path[0] == '.' && path[1] == '/') {
+            path += 2;
+        } else if (path[0] == '/') {
+            path++;
+        } else if (path[0] == '.' && path[1] == '\0') {
+            return path + 1;    /* The archive root */
+        } else {
+            return path;
+        }
+    }
+}
+
+static int names_equal(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+/* FNV-1a */
+static uint32_t hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void add_file(const char* name, const uint8_t* data, uint64_t size, uint32_t mode) {
+    name = normalize(name);
+    if (!*name || ramdisk_lookup(name)) {
+        return;     /* The archive root, or shadowed by an earlier module */
+    }
+    if (file_count == RAMDISK_MAX_FILES) {
+        klog(LOG_WARN, "Ramdisk: more than %u files, skipping %s", RAMDISK_MAX_FILES, name);
+        return;
+    }
+    
+    ramdisk_file_t* file = &files[file_count++];
+    file->name = name;
+    file->data = data;
+    file->size = size;
+    file->mode = mode;
+    
+    uint32_t slot = hash_name(name) & (HASH_SLOTS - 1);
+    while (slots[slot]) {
+        slot = (slot + 1) & (HASH_SLOTS - 1);
+    }
+    slots[slot] = (uint16_t)file_count;
+}
+
+/* Fixed-width hex field of a newc header */
+static uint32_t cpio_field(const uint8_t* header, uint32_t offset) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < CPIO_FIELD_SIZE; i++) {
+        uint8_t c = header[offset + i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return 0;
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+static int is_cpio(const uint8_t* image, uint64_t size) {
+    const char* magic = "070701";
+    if (size < CPIO_HEADER_SIZE) {
+        return 0;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (image[i] != (uint8_t)magic[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline uint64_t align4(uint64_t offset) {
+    return (offset + 3) & ~3ULL;
+}
+
+/* Index a cpio archive in place (header and name are padded to 4 bytes,
+ * and so is the data) */
+static void index_cpio(const uint8_t* image, uint64_t size) {
+    uint64_t pos = 0;
+    while (pos + CPIO_HEADER_SIZE <= size && is_cpio(image + pos, size - pos)) {
+        const uint8_t* header = image + pos;
+        uint32_t mode = cpio_field(header, CPIO_MODE);
+        uint32_t filesize = cpio_field(header, CPIO_FILESIZE);
+        uint32_t namesize = cpio_field(header, CPIO_NAMESIZE);
+        
+        uint64_t name_pos = pos + CPIO_HEADER_SIZE;
+        uint64_t data_pos = align4(name_pos + namesize);
+        if (namesize == 0 || data_pos + filesize > size) {
+            klog(LOG_WARN, "Ramdisk: truncated cpio entry at offset %lu", pos);
+            return;
+        }
+        
+        /* The name is stored with its NUL, so it can be used in place */
+        const char* name = (const char*)(image + name_pos);
+        if (name[namesize - 1] != '\0') {
+            klog(LOG_WARN, "Ramdisk: bad cpio name at offset %lu", pos);
+            return;
+        }
+        if (names_equal(name, "TRAILER!!!")) {
+            return;
+        }
+        
+        add_file(name, image + data_pos, filesize, mode);
+        pos = align4(data_pos + filesize);
+    }
+}
+
+/* Module contents through the identity map if it covers them, else a
+ * fresh mapping */
+static const uint8_t* map_module(const multiboot_module_t* mod) {
+    if (mod->end <= pmm_get_total_memory()) {
+        return (const uint8_t*)mod->start;
+    }
+    return (const uint8_t*)paging_map_io(mod->start, mod->end - mod->start, 0);
+}
+
+void ramdisk_init(void) {
+    uint64_t bytes = 0;
+    
+    for (uint32_t i = 0; i < multiboot_module_count(); i++) {
+        const multiboot_module_t* mod = multiboot_module(i);
+        const uint8_t* image = mod->end >= mod->start ? map_module(mod) : NULL;
+        if (!image) {
+            klog(LOG_WARN, "Ramdisk: cannot map module %u", i);
+            continue;
+        }
+        uint64_t size = mod->end - mod->start;
+        
+        if (is_cpio(image, size)) {
+            index_cpio(image, size);
+        } else if (mod->cmdline[0]) {
+            add_file(mod->cmdline, image, size, RAMDISK_TYPE_FILE | 0444);
+        } else {
+            klog(LOG_WARN, "Ramdisk: module %u is no archive and has no name", i);
+            continue;
+        }
+        bytes += size;
+    }
+    
+    if (file_count) {
+        klog(LOG_OK, "Ramdisk: %u files from %u modules (%M)",
+             file_count, multiboot_module_count(), bytes);
+    }
+}
+INITCALL(INIT_PLATFORM, ramdisk_init);
+
+const ramdisk_file_t* ramdisk_lookup(const char* path) {
+    path = normalize(path);
+    
+    uint32_t slot = hash_name(path) & (HASH_SLOTS - 1);
+    while (slots[slot]) {
+        const ramdisk_file_t* file = &files[slots[slot] - 1];
+        if (names_equal(file->name, path)) {
+            return file;
+        }
+        slot = (slot + 1) & (HASH_SLOTS - 1);
+    }
+    return NULL;
+}
+
+uint32_t ramdisk_count(void) {
+    return file_count;
+}
+
+const ramdisk_file_t* ramdisk_file(uint32_t index) {
+    return index < file_count ? &files[index] : NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+
+/* Boot Module Ramdisk
+ * Read-only files from the Multiboot2 modules GRUB loaded. A module
+ * holding a cpio archive ("newc" format, as written by
+ * `find . | cpio -o -H newc`) contributes every file in it; any other
+ * module becomes one file named by its grub.cfg command line.
+ *
+ * Nothing is copied: the index built at boot points straight into the
+ * module images, whose pages the PMM keeps reserved, so names and data
+ * returned here stay valid forever and must not be written.
+ */
+
+#define RAMDISK_MAX_FILES 256
+
+/* cpio mode bits */
+#define RAMDISK_TYPE_MASK 0170000
+#define RAMDISK_TYPE_DIR  0040000
+#define RAMDISK_TYPE_FILE 0100000
+
+typedef struct {
+    const char* name;           /* NUL-terminated path, no leading "./" or "/" */
+    const uint8_t* data;
+    uint64_t size;
+    uint32_t mode;              /* cpio mode (type and permission bits) */
+} ramdisk_file_t;
+
+/* Index the boot modules */
+void ramdisk_init(void);
+
+/* Find a file by path ("etc/motd", "/etc/motd" and "./etc/motd" are the
+ * same); NULL if there is none */
+const ramdisk_file_t* ramdisk_lookup(const char* path);
+
+/* Every indexed file, in archive order */
+uint32_t ramdisk_count(void);
+const ramdisk_file_t* ramdisk_file(uint32_t index);
+
+#endif
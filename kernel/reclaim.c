@@ -0,0 +1,142 @@
+#include "reclaim.h"
+#include "pmm.h"
+#include "process.h"
+#include "scheduler.h"
+#include "kprint.h"
+#include "irqtrace.h"
+#include "initcall.h"
+
+#include <stddef.h>
+
+#define RECLAIM_BATCH      16      /* Pages asked from the shrinkers per pass */
+#define RECLAIM_MIN_FLOOR  16      /* Smallest min watermark (pages) */
+#define RECLAIM_STACK_SIZE 8192
+
+static shrinker_t* shrinkers = NULL;
+static reclaim_stats_t stats;
+static process_t* reclaimer = NULL;
+static volatile int in_scan = 0;     /* A shrinker is running */
+
+static inline uint64_t free_pages(void) {
+    return pmm_get_free_memory() / PAGE_SIZE;
+}
+
+/* One pass over every shrinker, most reclaimable first */
+static uint64_t shrink_all(uint64_t target) {
+    uint64_t freed = 0;
+
+    while (freed < target) {
+        shrinker_t* best = NULL;
+        uint64_t best_count = 0;
+        for (shrinker_t* s = shrinkers; s; s = s->next) {
+            uint64_t count = s->count();
+            if (count > best_count) {
+                best = s;
+                best_count = count;
+            }
+        }
+        if (!best) {
+            break;  /* Nothing left to give back */
+        }
+
+        /* Caches are not otherwise locked: keep other processes out */
+        uint64_t flags = irq_save();
+        in_scan = 1;
+        uint64_t got = best->scan(target - freed);
+        in_scan = 0;
+        irq_restore(flags);
+        best->freed += got;
+        freed += got;
+        if (got == 0) {
+            break;
+        }
+    }
+
+    stats.pages_reclaimed += freed;
+    return freed;
+}
+
+/* Background reclaimer: sleeps until woken below low, refills to high */
+static void reclaim_task(void) {
+    while (1) {
+        uint64_t freed = 1;
+        while (freed && free_pages() < stats.high_pages) {
+            freed = shrink_all(RECLAIM_BATCH);
+            stats.background_runs++;
+        }
+
+        /* Checked with interrupts off, so a reclaim_notify() after the
+         * check finds this task blocked and wakes it. With the caches
+         * empty there is nothing to do until the next wakeup. */
+        uint64_t flags = irq_save();
+        if (!freed || free_pages() >= stats.low_pages) {
+            scheduler_block();
+        }
+        irq_restore(flags);
+    }
+}
+
+void reclaim_init(void) {
+    uint64_t total = pmm_get_total_memory() / PAGE_SIZE;
+
+    stats.min_pages = total / 128;
+    if (stats.min_pages < RECLAIM_MIN_FLOOR) {
+        stats.min_pages = RECLAIM_MIN_FLOOR;
+    }
+    stats.low_pages = stats.min_pages * 2;
+    stats.high_pages = stats.min_pages * 3;
+
+    kprint_ok("Memory reclaim initialized (min/low/high watermarks)");
+}
+INITCALL(INIT_MEMORY, reclaim_init, "pmm_setup");
+
+void reclaim_start(void) {
+    reclaimer = process_create(reclaim_task, RECLAIM_STACK_SIZE);
+    if (!reclaimer) {
+        kprint_error("Failed to start reclaim process");
+        return;
+    }
+    scheduler_add(reclaimer);
+}
+INITCALL(INIT_DEFERRED, reclaim_start, "reclaim_init", "scheduler_init");
+
+void shrinker_register(shrinker_t* shrinker) {
+    uint64_t flags = irq_save();
+    shrinker->freed = 0;
+    shrinker->next = shrinkers;
+    shrinkers = shrinker;
+    irq_restore(flags);
+}
+
+uint64_t reclaim_direct(uint64_t target) {
+    /* Shrinkers free memory; they must never re-enter reclaim. A
+     * preempted background pass is no reason to give up, though */
+    if (in_scan) {
+        return 0;
+    }
+    uint64_t freed = shrink_all(target);
+
+    stats.direct_runs++;
+    return freed;
+}
+
+int reclaim_below_min(void) {
+    return free_pages() < stats.min_pages;
+}
+
+void reclaim_notify(void) {
+    if (!reclaimer || free_pages() >= stats.low_pages) {
+        return;
+    }
+    uint64_t flags = irq_save();
+    scheduler_wake(reclaimer);
+    irq_restore(flags);
+}
+
+void reclaim_note_failure(void) {
+    stats.failed_allocs++;
+}
+
+void reclaim_get_stats(reclaim_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,60 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+#include <stdint.h>
+
+/* Memory Reclaim
+ * Caches that hold on to memory they could give back (the page-table
+ * page cache, pooled kernel stacks, the heap tail) register a shrinker.
+ *
+ * Watermarks on free physical pages drive reclaim:
+ *   below low  - the background reclaimer is woken and shrinks caches
+ *                until free memory is back above high
+ *   below min  - allocations that may wait reclaim directly first
+ * ALLOC_ATOMIC allocations never reclaim and may use the reserve below
+ * min, so interrupt handlers keep working under pressure.
+ */
+
+typedef struct shrinker {
+    const char* name;
+    uint64_t (*count)(void);            /* Pages that could be freed right now */
+    uint64_t (*scan)(uint64_t target);  /* Free up to target pages, return pages freed */
+    uint64_t freed;                     /* Total pages freed by this shrinker */
+    struct shrinker* next;
+} shrinker_t;
+
+typedef struct {
+    uint64_t min_pages;         /* Watermarks (free pages) */
+    uint64_t low_pages;
+    uint64_t high_pages;
+    uint64_t direct_runs;       /* Reclaim done by a waiting allocation */
+    uint64_t background_runs;   /* Reclaim done by the background process */
+    uint64_t pages_reclaimed;
+    uint64_t failed_allocs;     /* Allocations that returned nothing */
+} reclaim_stats_t;
+
+/* Compute watermarks from the physical memory size */
+void reclaim_init(void);
+
+/* Start the background reclaim process (needs the scheduler) */
+void reclaim_start(void);
+
+/* Add a shrinker (may be called before reclaim_init) */
+void shrinker_register(shrinker_t* shrinker);
+
+/* Shrink caches until target pages were freed (returns pages freed) */
+uint64_t reclaim_direct(uint64_t target);
+
+/* True if free memory is below the min watermark */
+int reclaim_below_min(void);
+
+/* Called after an allocation: wakes background reclaim below low */
+void reclaim_notify(void);
+
+/* Count an allocation that failed */
+void reclaim_note_failure(void);
+
+/* Get watermarks and counters */
+void reclaim_get_stats(reclaim_stats_t* out);
+
+#endif
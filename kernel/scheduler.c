@@ -2,22 +2,37 @@
 #include "process.h"
 #include "panic.h"
 #include "kprint.h"
+#include "gdt.h"
+#include "syscall.h"
+#include "irqtrace.h"
+#include "counter.h"
+#include "kstack.h"
+#include "initcall.h"
 
 #include <stddef.h>
 
 /* Ready queue (circular linked list) */
-static process_t* current_process = NULL;
 static process_t* ready_queue_head = NULL;
 static process_t* ready_queue_tail = NULL;
 
+/* Exited processes whose kernel stack is still to be freed */
+static process_t* dead_list = NULL;
+
+static counter_t context_switches = {
+    .name = "sched.switches",
+    .kind = COUNTER_EVENT,
+};
+
 /* Context switch assembly function */
 extern void context_switch(cpu_context_t* old_ctx, cpu_context_t* new_ctx);
 
 void scheduler_init(void) {
     ready_queue_head = NULL;
     ready_queue_tail = NULL;
+    counter_register(&context_switches);
     kprint_ok("Scheduler initialized (round-robin)");
 }
+INITCALL(INIT_CORE, scheduler_init, "process_init");
 
 void scheduler_add(process_t* proc) {
     if (!proc) return;
@@ -71,15 +86,71 @@ void scheduler_remove(process_t* proc) {
     } while (current != ready_queue_head);
 }
 
+/* Free the stacks of exited processes (never the one we run on: a
+ * process is only listed once it has switched away for good) */
+static void reap_dead(void) {
+    while (dead_list) {
+        process_t* proc = dead_list;
+        dead_list = proc->next;
+        proc->next = NULL;
+        kstack_free(proc->stack);
+        proc->stack = NULL;
+    }
+}
+
+/* Switch from current to next (next must not be on the ready queue) */
+static void switch_to(process_t* current, process_t* next) {
+    /* Save current process state */
+    if (current && current->state == PROCESS_RUNNING) {
+        current->state = PROCESS_READY;
+        current->time_slice = 10;  /* Reset time slice */
+        scheduler_add(current);
+    } else if (current && current->state == PROCESS_TERMINATED && current->stack) {
+        /* Still running on its stack: freed once we are off it */
+        current->next = dead_list;
+        dead_list = current;
+    }
+    
+    /* Switch to next process */
+    next->state = PROCESS_RUNNING;
+    if (next->time_slice == 0) {
+        next->time_slice = 10;
+    }
+    process_set_current(next);
+    
+    /* Ring 3 entries (interrupts, SYSCALL) land on next's kernel stack */
+    uint64_t kernel_stack = process_kernel_stack_top(next);
+    if (kernel_stack) {
+        gdt_set_kernel_stack(kernel_stack);
+        syscall_set_kernel_stack(kernel_stack);
+    }
+    
+    /* Perform context switch */
+    if (current) {
+        counter_inc(&context_switches);
+        context_switch(&current->context, &next->context);
+        
+        /* Back on current's stack */
+        reap_dead();
+    }
+}
+
 process_t* scheduler_next(void) {
     if (!ready_queue_head) {
         return NULL;  /* No processes ready */
     }
     
-    /* Round-robin: get head and rotate */
+    /* Round-robin: take the head off the queue (the preempted
+     * process is re-added at the tail by scheduler_switch) */
     process_t* next = ready_queue_head;
-    ready_queue_head = ready_queue_head->next;
-    ready_queue_tail = next;
+    if (ready_queue_head == ready_queue_tail) {
+        ready_queue_head = NULL;
+        ready_queue_tail = NULL;
+    } else {
+        ready_queue_head = next->next;
+        ready_queue_tail->next = ready_queue_head;
+    }
+    next->next = NULL;
     
     return next;
 }
@@ -100,27 +171,59 @@ void scheduler_switch(void) {
             return;  /* No other process to run */
         }
         
-        /* Save current process state */
-        if (current && current->state == PROCESS_RUNNING) {
-            current->state = PROCESS_READY;
-            current->time_slice = 10;  /* Reset time slice */
-            scheduler_add(current);
-        }
-        
-        /* Switch to next process */
-        next->state = PROCESS_RUNNING;
-        
-        /* Perform context switch */
-        if (current) {
-            context_switch(&current->context, &next->context);
-        }
+        switch_to(current, next);
     }
 }
 
 void scheduler_yield(void) {
+    /* Keep the timer IRQ out while the ready queue is being changed */
+    uint64_t flags = irq_save();
+    
     process_t* current = process_current();
     if (current) {
         current->time_slice = 0;  /* Force switch */
     }
     scheduler_switch();
+    
+    irq_restore(flags);
+}
+
+void scheduler_block(void) {
+    uint64_t flags = irq_save();
+    
+    process_t* current = process_current();
+    current->state = PROCESS_BLOCKED;
+    current->time_slice = 0;
+    scheduler_switch();
+    
+    /* Nothing else was ready: sleep until an interrupt, then let the
+     * caller re-check its condition */
+    if (current->state == PROCESS_BLOCKED) {
+        irq_halt();
+        irq_save();  /* Off again; flags from the entry still apply */
+        current->state = PROCESS_RUNNING;
+    }
+    
+    irq_restore(flags);
+}
+
+void scheduler_wake(process_t* proc) {
+    if (!proc || proc->state != PROCESS_BLOCKED) return;
+    
+    if (proc == process_current()) {
+        /* Blocked with nothing else to run: just keep going */
+        proc->state = PROCESS_RUNNING;
+    } else {
+        scheduler_add(proc);
+    }
+}
+
+void scheduler_handoff(process_t* next) {
+    uint64_t flags = irq_save();
+    
+    /* Skip the ready queue: the target runs immediately, the caller is
+     * re-queued unless it has blocked itself */
+    switch_to(process_current(), next);
+    
+    irq_restore(flags);
 }
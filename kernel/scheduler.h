@@ -21,4 +21,14 @@ void scheduler_switch(void);
 /* Yield CPU to next process */
 void scheduler_yield(void);
 
+/* Block the current process until scheduler_wake() (may return early:
+ * callers re-check their wait condition in a loop) */
+void scheduler_block(void);
+
+/* Make a blocked process runnable again */
+void scheduler_wake(process_t* proc);
+
+/* Switch directly to a blocked process, bypassing the run queue */
+void scheduler_handoff(process_t* next);
+
 #endif
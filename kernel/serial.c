@@ -0,0 +1,250 @@
+#include "serial.h"
+#include "irq.h"
+#include "irqtrace.h"
+#include "kprintf.h"
+#include "keyboard.h"
+#include "initcall.h"
+
+#define COM1 0x3F8
+
+/* Register offsets */
+#define UART_DATA   0           /* RBR / THR (DLL with DLAB) */
+#define UART_IER    1           /* Interrupt enable (DLM with DLAB) */
+#define UART_IIR    2           /* Interrupt identification (read) */
+#define UART_FCR    2           /* FIFO control (write) */
+#define UART_LCR    3
+#define UART_MCR    4
+#define UART_LSR    5
+
+#define IER_RX      0x01
+#define IER_THRE    0x02
+
+#define LCR_8N1     0x03
+#define LCR_DLAB    0x80
+
+#define MCR_DTR     0x01
+#define MCR_RTS     0x02
+#define MCR_OUT2    0x08        /* Gates the UART interrupt onto IRQ4 */
+#define MCR_LOOP    0x10
+
+#define LSR_DR      0x01
+#define LSR_THRE    0x20
+
+#define IIR_NONE    0x01
+#define IIR_ID(x)   (((x) >> 1) & 0x7)
+#define IIR_THRE    0x1
+#define IIR_RX      0x2
+#define IIR_LINE    0x3
+#define IIR_TIMEOUT 0x6
+
+#define FIFO_DEPTH  16
+#define SERIAL_IRQ  4
+
+#define RING_MASK (SERIAL_TX_RING - 1)
+
+static int present = 0;
+static int irq_mode = 0;
+static int tx_active = 0;       /* THR-empty interrupt enabled */
+
+static char tx_ring[SERIAL_TX_RING];
+static uint32_t tx_head = 0;    /* Next byte to send */
+static uint32_t tx_tail = 0;    /* Next free slot */
+static uint64_t dropped = 0;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static void put_polled(char c) {
+    while (!(inb(COM1 + UART_LSR) & LSR_THRE));
+    outb(COM1 + UART_DATA, c);
+}
+
+/* Move queued bytes into the FIFO (interrupts off) */
+static void tx_fill(void) {
+    int room = FIFO_DEPTH;
+    while (room-- > 0 && tx_head != tx_tail) {
+        outb(COM1 + UART_DATA, tx_ring[tx_head & RING_MASK]);
+        tx_head++;
+    }
+    
+    /* Ring empty: stop THR-empty interrupts until there is more */
+    int want = tx_head != tx_tail;
+    if (want != tx_active) {
+        tx_active = want;
+        outb(COM1 + UART_IER, IER_RX | (want ? IER_THRE : 0));
+    }
+}
+
+static inline void tx_queue(char c) {
+    if (tx_tail - tx_head >= SERIAL_TX_RING) {
+        dropped++;
+        return;
+    }
+    tx_ring[tx_tail & RING_MASK] = c;
+    tx_tail++;
+}
+
+void serial_write(const char* text, size_t len) {
+    if (!present) return;
+    
+    if (!irq_mode) {
+        for (size_t i = 0; i < len; i++) {
+            if (text[i] == '\n') {
+                put_polled('\r');
+            }
+            put_polled(text[i]);
+        }
+        return;
+    }
+    
+    uint64_t flags = irq_save();
+    
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            tx_queue('\r');
+        }
+        tx_queue(text[i]);
+    }
+    
+    /* Idle transmitter: arm THR-empty. The UART raises it right away if
+     * the THR is empty, or once the bytes still in the FIFO have gone */
+    if (!tx_active && tx_head != tx_tail) {
+        tx_active = 1;
+        outb(COM1 + UART_IER, IER_RX | IER_THRE);
+    }
+    
+    irq_restore(flags);
+}
+
+/* Received ASCII to set 1 scancodes for the keys the UI understands */
+static uint8_t ascii_to_scancode(char c) {
+    static const char row1[] = "1234567890";
+    static const char row2[] = "qwertyuiop";
+    static const char row3[] = "asdfghjkl";
+    static const char row4[] = "zxcvbnm";
+    
+    if (c >= 'A' && c <= 'Z') {
+        c = c - 'A' + 'a';
+    }
+    for (int i = 0; row1[i]; i++) if (row1[i] == c) return 0x02 + i;
+    for (int i = 0; row2[i]; i++) if (row2[i] == c) return 0x10 + i;
+    for (int i = 0; row3[i]; i++) if (row3[i] == c) return 0x1E + i;
+    for (int i = 0; row4[i]; i++) if (row4[i] == c) return 0x2C + i;
+    
+    switch (c) {
+        case 0x1B: return 0x01;    /* Escape */
+        case '\r':
+        case '\n': return 0x1C;    /* Enter */
+        case ' ':  return 0x39;
+        case 0x08:
+        case 0x7F: return 0x0E;    /* Backspace */
+        case '\t': return 0x0F;
+        default:   return 0;
+    }
+}
+
+static int serial_handler(irq_frame_t* frame, void* ctx) {
+    (void)frame;
+    (void)ctx;
+    
+    int handled = IRQ_NONE;
+    uint8_t iir;
+    while (!((iir = inb(COM1 + UART_IIR)) & IIR_NONE)) {
+        handled = IRQ_HANDLED;
+        switch (IIR_ID(iir)) {
+            case IIR_THRE:
+                tx_fill();
+                break;
+            case IIR_RX:
+            case IIR_TIMEOUT:
+                while (inb(COM1 + UART_LSR) & LSR_DR) {
+                    uint8_t code = ascii_to_scancode((char)inb(COM1 + UART_DATA));
+                    if (code) {
+                        /* A press followed by its release */
+                        keyboard_post(code);
+                        keyboard_post(code | 0x80);
+                    }
+                }
+                break;
+            case IIR_LINE:
+                inb(COM1 + UART_LSR);
+                break;
+            default:
+                inb(COM1 + 6);     /* Modem status */
+                break;
+        }
+    }
+    return handled;
+}
+
+static void serial_sink_write(const char* text, size_t len, uint8_t color) {
+    (void)color;
+    serial_write(text, len);
+}
+
+static kprintf_sink_t serial_sink = { serial_sink_write, NULL };
+
+void serial_init(void) {
+    outb(COM1 + UART_IER, 0);
+    
+    /* 115200 baud (divisor 1), 8N1 */
+    outb(COM1 + UART_LCR, LCR_DLAB);
+    outb(COM1 + UART_DATA, 1);
+    outb(COM1 + UART_IER, 0);
+    outb(COM1 + UART_LCR, LCR_8N1);
+    
+    /* Enable and clear the FIFOs, 14-byte RX trigger */
+    outb(COM1 + UART_FCR, 0xC7);
+    
+    /* Loopback check: no UART answers with a different byte */
+    outb(COM1 + UART_MCR, MCR_LOOP | MCR_RTS | MCR_DTR);
+    outb(COM1 + UART_DATA, 0xAE);
+    for (int i = 0; i < 1000 && !(inb(COM1 + UART_LSR) & LSR_DR); i++);
+    if (inb(COM1 + UART_DATA) != 0xAE) {
+        return;
+    }
+    
+    outb(COM1 + UART_MCR, MCR_DTR | MCR_RTS | MCR_OUT2);
+    present = 1;
+    kprintf_add_sink(&serial_sink);
+}
+
+void serial_start_irq(void) {
+    if (!present) return;
+    
+    uint64_t flags = irq_save();
+    irq_mode = 1;
+    tx_active = 0;
+    outb(COM1 + UART_IER, IER_RX);
+    irq_restore(flags);
+    
+    irq_register(SERIAL_IRQ, serial_handler, NULL);
+}
+INITCALL(INIT_DEFERRED, serial_start_irq);
+
+void serial_set_polled(void) {
+    if (!present) return;
+    
+    uint64_t flags = irq_save();
+    
+    outb(COM1 + UART_IER, 0);
+    while (tx_head != tx_tail) {
+        put_polled(tx_ring[tx_head & RING_MASK]);
+        tx_head++;
+    }
+    irq_mode = 0;
+    tx_active = 0;
+    
+    irq_restore(flags);
+}
+
+uint64_t serial_tx_dropped(void) {
+    return dropped;
+}
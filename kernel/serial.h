@@ -0,0 +1,31 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* COM1 16550 Serial Console
+ * Mirrors kprintf output to COM1 (115200 8N1). Once IRQ4 is hooked,
+ * writers only queue into a TX ring that the THR-empty interrupt drains
+ * through the FIFO; bytes that do not fit are dropped, never waited on.
+ * Received characters are fed to the keyboard path as scancodes.
+ */
+
+#define SERIAL_TX_RING 4096     /* Bytes (power of two) */
+
+/* Probe and program COM1, attach it as a kprintf sink (polled output) */
+void serial_init(void);
+
+/* Hook IRQ4 and switch to interrupt-driven TX and RX */
+void serial_start_irq(void);
+
+/* Queue text (LF is sent as CR LF) */
+void serial_write(const char* text, size_t len);
+
+/* Drain the ring and poll from now on (panic paths) */
+void serial_set_polled(void);
+
+/* Bytes dropped because the TX ring was full */
+uint64_t serial_tx_dropped(void);
+
+#endif
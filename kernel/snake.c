@@ -0,0 +1,328 @@
+#include "snake.h"
+#include "fiber.h"
+#include "timer.h"
+#include "vga.h"
+
+#include <stddef.h>
+
+/* Scancodes (set 1 make codes) */
+#define KEY_W      0x11
+#define KEY_A      0x1E
+#define KEY_S      0x1F
+#define KEY_D      0x20
+#define KEY_SPACE  0x39
+#define KEY_UP     0x48
+#define KEY_LEFT   0x4B
+#define KEY_RIGHT  0x4D
+#define KEY_DOWN   0x50
+
+#define START_LENGTH 4
+
+typedef enum {
+    DIR_UP,
+    DIR_DOWN,
+    DIR_LEFT,
+    DIR_RIGHT
+} direction_t;
+
+static const int8_t dir_dx[4] = { 0, 0, -1, 1 };
+static const int8_t dir_dy[4] = { -1, 1, 0, 0 };
+
+/* Body cells (y * SNAKE_COLS + x), oldest at tail, newest at head */
+static uint16_t body[SNAKE_CELLS];
+static uint32_t head = 0;
+static uint32_t tail = 0;
+static uint32_t length = 0;
+
+/* One bit per board cell: set while the snake covers it */
+static uint64_t occupied[(SNAKE_CELLS + 63) / 64];
+
+static uint16_t food = 0;
+static direction_t heading = DIR_RIGHT;
+
+/* Turns pressed but not yet applied, oldest first */
+static direction_t turns[SNAKE_TURN_QUEUE];
+static uint32_t turn_count = 0;
+
+static uint8_t active = 0;      /* Game screen is shown */
+static uint8_t over = 0;
+static uint32_t score = 0;
+
+/* Fixed timestep: the tick the next step is due */
+static uint64_t next_step = 0;
+static uint64_t step_ticks = 1;
+
+static uint64_t steps = 0;
+static uint64_t late_steps = 0;
+static uint64_t dropped_steps = 0;
+
+static uint64_t rng_state = 0;
+
+static fiber_t snake_fiber;
+static fiber_event_t snake_wake;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* xorshift64 */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static inline int cell_occupied(uint32_t cell) {
+    return (occupied[cell / 64] >> (cell % 64)) & 1;
+}
+
+static inline void cell_set(uint32_t cell) {
+    occupied[cell / 64] |= 1ULL << (cell % 64);
+}
+
+static inline void cell_clear(uint32_t cell) {
+    occupied[cell / 64] &= ~(1ULL << (cell % 64));
+}
+
+static inline uint32_t ring_next(uint32_t i) {
+    return (i + 1 == SNAKE_CELLS) ? 0 : i + 1;
+}
+
+static void draw_cell(uint32_t cell, char c, uint8_t color) {
+    vga_set_cursor(SNAKE_BOARD_X + cell % SNAKE_COLS, SNAKE_BOARD_Y + cell / SNAKE_COLS);
+    vga_putchar(c, color);
+}
+
+/* Put food on a random free cell (returns 0 if the board is full) */
+static int place_food(void) {
+    if (length == SNAKE_CELLS) {
+        return 0;
+    }
+    
+    /* Random probing almost always hits quickly; scan from the last probe
+     * once the board is crowded */
+    uint32_t cell = 0;
+    for (int tries = 0; tries < 16; tries++) {
+        cell = next_random() % SNAKE_CELLS;
+        if (!cell_occupied(cell)) {
+            break;
+        }
+    }
+    while (cell_occupied(cell)) {
+        cell = ring_next(cell);
+    }
+    
+    food = cell;
+    draw_cell(food, '*', VGA_COLOR_LIGHT_RED);
+    return 1;
+}
+
+/* Clear the board and lay out a new snake */
+static void reset(void) {
+    for (uint32_t cell = 0; cell < SNAKE_CELLS; cell++) {
+        draw_cell(cell, ' ', VGA_COLOR_LIGHT_GRAY);
+    }
+    for (uint32_t i = 0; i < sizeof(occupied) / sizeof(occupied[0]); i++) {
+        occupied[i] = 0;
+    }
+    
+    /* Horizontal, heading right, in the middle of the board */
+    uint32_t start = (SNAKE_ROWS / 2) * SNAKE_COLS + SNAKE_COLS / 2 - START_LENGTH;
+    for (uint32_t i = 0; i < START_LENGTH; i++) {
+        body[i] = start + i;
+        cell_set(start + i);
+        draw_cell(start + i, 'o', VGA_COLOR_GREEN);
+    }
+    tail = 0;
+    head = START_LENGTH - 1;
+    length = START_LENGTH;
+    draw_cell(body[head], '@', VGA_COLOR_LIGHT_GREEN);
+    
+    heading = DIR_RIGHT;
+    turn_count = 0;
+    score = 0;
+    over = 0;
+    
+    rng_state = rdtsc() | 1;
+    place_food();
+}
+
+/* Advance the game by one step, drawing only the cells that change */
+static void step(void) {
+    if (turn_count) {
+        heading = turns[0];
+        for (uint32_t i = 1; i < turn_count; i++) {
+            turns[i - 1] = turns[i];
+        }
+        turn_count--;
+    }
+    
+    uint32_t old_head = body[head];
+    int x = (int)(old_head % SNAKE_COLS) + dir_dx[heading];
+    int y = (int)(old_head / SNAKE_COLS) + dir_dy[heading];
+    if (x < 0 || x >= SNAKE_COLS || y < 0 || y >= SNAKE_ROWS) {
+        over = 1;
+        draw_cell(old_head, 'X', VGA_COLOR_LIGHT_RED);
+        return;
+    }
+    
+    uint32_t cell = (uint32_t)y * SNAKE_COLS + (uint32_t)x;
+    int grow = (cell == food);
+    
+    /* The tail moves out of the way in the same step, so the head may
+     * take its cell */
+    uint32_t old_tail = body[tail];
+    if (!grow) {
+        cell_clear(old_tail);
+    }
+    if (cell_occupied(cell)) {
+        if (!grow) {
+            cell_set(old_tail);
+        }
+        over = 1;
+        draw_cell(old_head, 'X', VGA_COLOR_LIGHT_RED);
+        return;
+    }
+    
+    if (grow) {
+        length++;
+        score++;
+    } else {
+        tail = ring_next(tail);
+        draw_cell(old_tail, ' ', VGA_COLOR_LIGHT_GRAY);
+    }
+    
+    draw_cell(old_head, 'o', VGA_COLOR_GREEN);
+    head = ring_next(head);
+    body[head] = cell;
+    cell_set(cell);
+    draw_cell(cell, '@', VGA_COLOR_LIGHT_GREEN);
+    
+    if (grow && !place_food()) {
+        over = 1;   /* Board full: nothing left to eat */
+    }
+}
+
+/* Run the steps that are due (at most SNAKE_MAX_CATCHUP), then show them */
+static void run_due_steps(void) {
+    uint64_t now = timer_get_ticks();
+    uint32_t ran = 0;
+    
+    while (!over && next_step <= now && ran < SNAKE_MAX_CATCHUP) {
+        if (now > next_step) {
+            late_steps++;
+        }
+        step();
+        steps++;
+        ran++;
+        next_step += step_ticks;
+    }
+    
+    /* Too far behind to catch up: resume from now instead of bursting */
+    if (!over && next_step <= now) {
+        dropped_steps += (now - next_step) / step_ticks + 1;
+        next_step = now + step_ticks;
+    }
+    
+    if (ran) {
+        vga_flush();
+    }
+}
+
+/* Ticks until the next step is due (at least one) */
+static uint64_t ticks_to_next_step(void) {
+    uint64_t now = timer_get_ticks();
+    return next_step > now ? next_step - now : 1;
+}
+
+/* Game fiber: parked while the game is not running, else one batch of
+ * steps per wakeup, sleeping until the next step is due */
+static int snake_task(fiber_t* f) {
+    FIBER_BEGIN(f);
+    while (1) {
+        while (!active || over) {
+            FIBER_AWAIT(f, &snake_wake);
+        }
+        
+        run_due_steps();
+        
+        if (active && !over) {
+            FIBER_SLEEP(f, ticks_to_next_step());
+        }
+    }
+    FIBER_END(f);
+}
+
+void snake_init(void) {
+    fiber_event_init(&snake_wake);
+    fiber_init(&snake_fiber, snake_task, NULL);
+    fiber_spawn(&snake_fiber);
+}
+
+void snake_start(void) {
+    uint32_t hz = timer_get_frequency();
+    step_ticks = hz / SNAKE_STEP_HZ ? hz / SNAKE_STEP_HZ : 1;
+    
+    reset();
+    steps = 0;
+    late_steps = 0;
+    dropped_steps = 0;
+    next_step = timer_get_ticks() + step_ticks;
+    active = 1;
+    
+    fiber_event_signal(&snake_wake);
+}
+
+void snake_stop(void) {
+    active = 0;
+}
+
+/* Queue a turn unless it reverses (or repeats) the direction it follows */
+static void queue_turn(direction_t dir) {
+    direction_t last = turn_count ? turns[turn_count - 1] : heading;
+    if (turn_count == SNAKE_TURN_QUEUE || dir == last) {
+        return;
+    }
+    if (dir_dx[dir] == -dir_dx[last] && dir_dy[dir] == -dir_dy[last]) {
+        return;
+    }
+    turns[turn_count++] = dir;
+}
+
+void snake_input(uint8_t scancode) {
+    switch (scancode) {
+        case KEY_W:
+        case KEY_UP:
+            queue_turn(DIR_UP);
+            break;
+        case KEY_S:
+        case KEY_DOWN:
+            queue_turn(DIR_DOWN);
+            break;
+        case KEY_A:
+        case KEY_LEFT:
+            queue_turn(DIR_LEFT);
+            break;
+        case KEY_D:
+        case KEY_RIGHT:
+            queue_turn(DIR_RIGHT);
+            break;
+        case KEY_SPACE:
+            if (over) {
+                snake_start();
+            }
+            break;
+    }
+}
+
+void snake_get_status(snake_status_t* out) {
+    out->score = score;
+    out->length = length;
+    out->over = over;
+    out->steps = steps;
+    out->late_steps = late_steps;
+    out->dropped_steps = dropped_steps;
+}
@@ -0,0 +1,49 @@
+#ifndef SNAKE_H
+#define SNAKE_H
+
+#include <stdint.h>
+
+/* Snake Game
+ * Runs as a fiber stepping the simulation at a fixed rate off the timer,
+ * independent of the UI frame rate. The body is a ring buffer of cells
+ * (move and grow are O(1)) mirrored in an occupancy bitmap (collision
+ * checks are O(1)), and a step redraws only the head, tail and food
+ * cells. Also used to spot frame-timing and input-latency regressions.
+ */
+
+/* Playfield, inside the border drawn by the UI */
+#define SNAKE_BOARD_X     11
+#define SNAKE_BOARD_Y     6
+#define SNAKE_COLS        58
+#define SNAKE_ROWS        14
+#define SNAKE_CELLS       (SNAKE_COLS * SNAKE_ROWS)
+
+#define SNAKE_STEP_HZ     10    /* Simulation steps per second */
+#define SNAKE_MAX_CATCHUP 4     /* Steps run at once after a late wakeup */
+#define SNAKE_TURN_QUEUE  2     /* Buffered turns (two keys within one step) */
+
+typedef struct {
+    uint32_t score;
+    uint32_t length;
+    int over;                   /* Crashed, waiting for a restart */
+    uint64_t steps;             /* Steps simulated */
+    uint64_t late_steps;        /* Steps run after their deadline had passed */
+    uint64_t dropped_steps;     /* Steps skipped after a very late wakeup */
+} snake_status_t;
+
+/* Create the game fiber (parked until snake_start()) */
+void snake_init(void);
+
+/* Start a new game and draw the board (the UI draws the border) */
+void snake_start(void);
+
+/* Stop stepping (the game screen was left) */
+void snake_stop(void);
+
+/* Key press while the game is shown: WASD/arrows turn, SPACE restarts */
+void snake_input(uint8_t scancode);
+
+/* Current score and timing statistics */
+void snake_get_status(snake_status_t* out);
+
+#endif
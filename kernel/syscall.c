@@ -0,0 +1,272 @@
+#include "syscall.h"
+#include "gdt.h"
+#include "process.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "vma.h"
+#include "ipc.h"
+#include "vga.h"
+#include "kprint.h"
+#include "kprintf.h"
+#include "initcall.h"
+
+#define MSR_EFER   0xC0000080
+#define MSR_STAR   0xC0000081
+#define MSR_LSTAR  0xC0000082
+#define MSR_SFMASK 0xC0000084
+
+#define EFER_SCE   (1ULL << 0)
+
+/* RFLAGS bits cleared on entry: TF, IF, DF */
+#define SYSCALL_RFLAGS_MASK 0x700
+
+#define SYS_WRITE_MAX 256
+
+typedef uint64_t (*syscall_fn_t)(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3);
+
+/* Kernel stack loaded by syscall_entry.asm */
+uint64_t syscall_kernel_rsp = 0;
+
+static syscall_stats_t syscall_stats[SYSCALL_COUNT];
+
+extern void syscall_entry(void);
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Check that [addr, addr+len) lies in the caller's regions with prot
+ * (pages not populated yet are faulted in when the kernel touches them) */
+static int user_range_ok(uint64_t addr, uint64_t len, uint64_t prot) {
+    process_t* proc = process_current();
+    if (!proc || !proc->vm) {
+        return 0;
+    }
+    return vm_range_ok(proc->vm, addr, len, prot);
+}
+
+static uint64_t sys_exit(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    (void)a0; (void)a1; (void)a2; (void)a3;
+    process_exit();
+}
+
+static uint64_t sys_yield(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    (void)a0; (void)a1; (void)a2; (void)a3;
+    scheduler_yield();
+    return 0;
+}
+
+static uint64_t sys_getpid(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    (void)a0; (void)a1; (void)a2; (void)a3;
+    return process_current()->pid;
+}
+
+static uint64_t sys_write(uint64_t buf, uint64_t len, uint64_t a2, uint64_t a3) {
+    (void)a2; (void)a3;
+    char text[SYS_WRITE_MAX];
+
+    if (len > SYS_WRITE_MAX) {
+        len = SYS_WRITE_MAX;
+    }
+    if (!user_range_ok(buf, len, VM_PROT_READ)) {
+        return SYSCALL_ERROR;
+    }
+
+    /* Copy in before printing so the string can't change underneath us */
+    const char* src = (const char*)buf;
+    for (uint64_t i = 0; i < len; i++) {
+        text[i] = src[i];
+    }
+
+    /* Every console; the screen only while the UI does not own it */
+    kprintf_write(text, len, VGA_COLOR_WHITE);
+    return len;
+}
+
+static uint64_t sys_ticks(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    (void)a0; (void)a1; (void)a2; (void)a3;
+    return timer_get_ticks();
+}
+
+static uint64_t sys_mmap(uint64_t addr, uint64_t len, uint64_t prot, uint64_t flags) {
+    process_t* proc = process_current();
+    if (!proc->vm) {
+        return SYSCALL_ERROR;
+    }
+    uint64_t result = vm_map_anon(proc->vm, addr, len, prot, (uint32_t)flags);
+    return result ? result : SYSCALL_ERROR;
+}
+
+static uint64_t sys_munmap(uint64_t addr, uint64_t len, uint64_t a2, uint64_t a3) {
+    (void)a2; (void)a3;
+    process_t* proc = process_current();
+    if (!proc->vm) {
+        return SYSCALL_ERROR;
+    }
+    vm_unmap(proc->vm, addr, len);
+    return 0;
+}
+
+static uint64_t sys_mprotect(uint64_t addr, uint64_t len, uint64_t prot, uint64_t a3) {
+    (void)a3;
+    process_t* proc = process_current();
+    if (!proc->vm || !vm_protect(proc->vm, addr, len, prot)) {
+        return SYSCALL_ERROR;
+    }
+    return 0;
+}
+
+/* Copy a message between user memory and a kernel buffer */
+static int copy_msg(void* dst, const void* src, uint64_t user_addr, uint64_t prot) {
+    if (!user_range_ok(user_addr, sizeof(ipc_msg_t), prot)) {
+        return 0;
+    }
+    const uint8_t* s = src;
+    uint8_t* d = dst;
+    for (uint64_t i = 0; i < sizeof(ipc_msg_t); i++) {
+        d[i] = s[i];
+    }
+    return 1;
+}
+
+static uint64_t sys_port_create(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    (void)a0; (void)a1; (void)a2; (void)a3;
+    return (uint64_t)(int64_t)ipc_port_create();
+}
+
+static uint64_t sys_send(uint64_t port, uint64_t user_msg, uint64_t a2, uint64_t a3) {
+    (void)a2; (void)a3;
+    ipc_msg_t msg;
+    if (!copy_msg(&msg, (const void*)user_msg, user_msg, VM_PROT_READ)) {
+        return SYSCALL_ERROR;
+    }
+    return (uint64_t)(int64_t)ipc_send((int)port, &msg);
+}
+
+static uint64_t sys_receive(uint64_t port, uint64_t user_msg, uint64_t a2, uint64_t a3) {
+    (void)a2; (void)a3;
+    ipc_msg_t msg;
+    if (!user_range_ok(user_msg, sizeof(ipc_msg_t), VM_PROT_WRITE)) {
+        return SYSCALL_ERROR;
+    }
+    int status = ipc_receive((int)port, &msg);
+    if (status == IPC_OK && !copy_msg((void*)user_msg, &msg, user_msg, VM_PROT_WRITE)) {
+        return SYSCALL_ERROR;
+    }
+    return (uint64_t)(int64_t)status;
+}
+
+static uint64_t sys_call(uint64_t port, uint64_t user_msg, uint64_t user_reply, uint64_t a3) {
+    (void)a3;
+    ipc_msg_t msg;
+    ipc_msg_t reply;
+    if (!copy_msg(&msg, (const void*)user_msg, user_msg, VM_PROT_READ) ||
+        !user_range_ok(user_reply, sizeof(ipc_msg_t), VM_PROT_WRITE)) {
+        return SYSCALL_ERROR;
+    }
+    int status = ipc_call((int)port, &msg, &reply);
+    if (status == IPC_OK && !copy_msg((void*)user_reply, &reply, user_reply, VM_PROT_WRITE)) {
+        return SYSCALL_ERROR;
+    }
+    return (uint64_t)(int64_t)status;
+}
+
+static uint64_t sys_reply(uint64_t pid, uint64_t user_msg, uint64_t a2, uint64_t a3) {
+    (void)a2; (void)a3;
+    ipc_msg_t msg;
+    if (!copy_msg(&msg, (const void*)user_msg, user_msg, VM_PROT_READ)) {
+        return SYSCALL_ERROR;
+    }
+    return (uint64_t)(int64_t)ipc_reply((uint32_t)pid, &msg);
+}
+
+static uint64_t sys_fork(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    (void)a0; (void)a1; (void)a2; (void)a3;
+    process_t* child = process_fork();
+    if (!child) {
+        return SYSCALL_ERROR;
+    }
+    scheduler_add(child);
+    return child->pid;
+}
+
+/* Dispatch table indexed by syscall number */
+static const syscall_fn_t syscall_table[SYSCALL_COUNT] = {
+    [SYS_EXIT]   = sys_exit,
+    [SYS_YIELD]  = sys_yield,
+    [SYS_GETPID] = sys_getpid,
+    [SYS_WRITE]  = sys_write,
+    [SYS_TICKS]  = sys_ticks,
+    [SYS_MMAP]   = sys_mmap,
+    [SYS_MUNMAP] = sys_munmap,
+    [SYS_MPROTECT] = sys_mprotect,
+    [SYS_PORT_CREATE] = sys_port_create,
+    [SYS_SEND]     = sys_send,
+    [SYS_RECEIVE]  = sys_receive,
+    [SYS_CALL]     = sys_call,
+    [SYS_REPLY]    = sys_reply,
+    [SYS_FORK]     = sys_fork,
+};
+
+void syscall_init(void) {
+    /* Enable SYSCALL/SYSRET */
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+
+    /* SYSCALL loads CS=STAR[47:32], SS=+8
+     * SYSRET loads SS=STAR[63:48]+8, CS=STAR[63:48]+16 (user data, user code) */
+    wrmsr(MSR_STAR, ((uint64_t)GDT_KERNEL_DATA << 48) | ((uint64_t)GDT_KERNEL_CODE << 32));
+    wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+    wrmsr(MSR_SFMASK, SYSCALL_RFLAGS_MASK);
+
+    for (int i = 0; i < SYSCALL_COUNT; i++) {
+        syscall_stats[i].calls = 0;
+        syscall_stats[i].total_cycles = 0;
+        syscall_stats[i].max_cycles = 0;
+    }
+
+    kprint_ok("System calls initialized (SYSCALL/SYSRET)");
+}
+INITCALL(INIT_DEFERRED, syscall_init);
+
+void syscall_set_kernel_stack(uint64_t rsp) {
+    syscall_kernel_rsp = rsp;
+}
+
+uint64_t syscall_dispatch(uint64_t num, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    if (num >= SYSCALL_COUNT) {
+        return SYSCALL_ERROR;
+    }
+
+    uint64_t start = rdtsc();
+    uint64_t result = syscall_table[num](a0, a1, a2, a3);
+    uint64_t cycles = rdtsc() - start;
+
+    syscall_stats_t* stats = &syscall_stats[num];
+    stats->calls++;
+    stats->total_cycles += cycles;
+    if (cycles > stats->max_cycles) {
+        stats->max_cycles = cycles;
+    }
+
+    return result;
+}
+
+void syscall_get_stats(uint32_t num, syscall_stats_t* out) {
+    if (num >= SYSCALL_COUNT) {
+        out->calls = out->total_cycles = out->max_cycles = 0;
+        return;
+    }
+    *out = syscall_stats[num];
+}
@@ -0,0 +1,61 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+
+/* System Calls (SYSCALL/SYSRET)
+ * Calling convention from ring 3:
+ *   RAX = syscall number, RDI/RSI/RDX/R10 = arguments
+ *   RAX = return value, RCX and R11 are clobbered
+ */
+
+#define SYS_EXIT   0   /* void exit(void) */
+#define SYS_YIELD  1   /* void yield(void) */
+#define SYS_GETPID 2   /* uint64_t getpid(void) */
+#define SYS_WRITE  3   /* uint64_t write(const char* buf, uint64_t len) */
+#define SYS_TICKS  4   /* uint64_t ticks(void) */
+#define SYS_MMAP   5   /* uint64_t mmap(uint64_t addr, uint64_t len, uint64_t prot, uint64_t flags) */
+#define SYS_MUNMAP 6   /* uint64_t munmap(uint64_t addr, uint64_t len) */
+#define SYS_MPROTECT 7 /* uint64_t mprotect(uint64_t addr, uint64_t len, uint64_t prot) */
+#define SYS_PORT_CREATE 8  /* uint64_t port_create(void) */
+#define SYS_SEND     9     /* uint64_t send(uint64_t port, ipc_msg_t* msg) */
+#define SYS_RECEIVE  10    /* uint64_t receive(uint64_t port, ipc_msg_t* msg) */
+#define SYS_CALL     11    /* uint64_t call(uint64_t port, ipc_msg_t* msg, ipc_msg_t* reply) */
+#define SYS_REPLY    12    /* uint64_t reply(uint64_t pid, ipc_msg_t* reply) */
+#define SYS_FORK     13    /* uint64_t fork(void) - child pid, 0 in the child */
+
+#define SYSCALL_COUNT 14
+
+#define SYSCALL_ERROR ((uint64_t)-1)
+
+/* User state pushed by syscall_entry.asm at the top of the kernel stack
+ * (lowest address first) */
+typedef struct {
+    uint64_t pad;
+    uint64_t r15, r14, r13, r12, rbp, rbx;
+    uint64_t r10, r9, r8, rdx, rsi, rdi;
+    uint64_t rflags;    /* R11 */
+    uint64_t rip;       /* RCX */
+    uint64_t rsp;
+} syscall_frame_t;
+
+/* Per-syscall latency counters (TSC cycles) */
+typedef struct {
+    uint64_t calls;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+} syscall_stats_t;
+
+/* Program the SYSCALL MSRs */
+void syscall_init(void);
+
+/* Set the kernel stack used on syscall entry (current process) */
+void syscall_set_kernel_stack(uint64_t rsp);
+
+/* Dispatch a system call (called from syscall_entry.asm) */
+uint64_t syscall_dispatch(uint64_t num, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3);
+
+/* Get latency counters for one syscall */
+void syscall_get_stats(uint32_t num, syscall_stats_t* out);
+
+#endif
@@ -0,0 +1,113 @@
+; System Call Entry and User Mode Transitions
+
+global syscall_entry
+global usermode_enter
+global syscall_fork_return
+
+extern syscall_dispatch
+extern syscall_kernel_rsp
+
+section .bss
+syscall_user_rsp:
+    resq 1
+
+section .text
+
+; SYSCALL entry point (LSTAR)
+; CPU state: RCX = user RIP, R11 = user RFLAGS, IF cleared by SFMASK,
+; RSP still points to the user stack
+syscall_entry:
+    ; Switch to the kernel stack of the current process
+    mov [rel syscall_user_rsp], rsp
+    mov rsp, [rel syscall_kernel_rsp]
+
+    ; Save return state and caller-visible registers
+    push qword [rel syscall_user_rsp]
+    push rcx
+    push r11
+    push rdi
+    push rsi
+    push rdx
+    push r8
+    push r9
+    push r10
+    push rbx                ; Callee-saved too, so SYS_FORK can copy
+    push rbp                ; the whole frame (syscall_frame_t)
+    push r12
+    push r13
+    push r14
+    push r15
+    sub rsp, 8              ; Keep the stack 16-byte aligned for C
+
+    ; User state is saved - allow preemption during the call
+    sti
+
+    ; syscall_dispatch(num, a0, a1, a2, a3)
+    mov r8,  r10
+    mov rcx, rdx
+    mov rdx, rsi
+    mov rsi, rdi
+    mov rdi, rax
+    call syscall_dispatch
+
+    cli
+
+syscall_return:
+    add rsp, 8
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    pop r10
+    pop r9
+    pop r8
+    pop rdx
+    pop rsi
+    pop rdi
+    pop r11
+    pop rcx
+    pop rsp                 ; Back on the user stack
+
+    o64 sysret
+
+; Child side of SYS_FORK: first switched to with RSP at a copy of the
+; parent's syscall frame; returns to ring 3 with RAX = 0
+syscall_fork_return:
+    cli
+    xor eax, eax
+    jmp syscall_return
+
+; void usermode_enter(uint64_t rip, uint64_t rsp)
+; RDI = user entry point, RSI = user stack pointer
+usermode_enter:
+    mov ax, 0x1B            ; User data selector | RPL 3
+    mov ds, ax
+    mov es, ax
+
+    ; Build an IRETQ frame: SS, RSP, RFLAGS, CS, RIP
+    push qword 0x1B
+    push rsi
+    push qword 0x202        ; Interrupts enabled
+    push qword 0x23         ; User code selector | RPL 3
+    push rdi
+
+    ; Don't leak kernel values into ring 3
+    xor rax, rax
+    xor rbx, rbx
+    xor rcx, rcx
+    xor rdx, rdx
+    xor rsi, rsi
+    xor rdi, rdi
+    xor rbp, rbp
+    xor r8, r8
+    xor r9, r9
+    xor r10, r10
+    xor r11, r11
+    xor r12, r12
+    xor r13, r13
+    xor r14, r14
+    xor r15, r15
+
+    iretq
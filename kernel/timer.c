@@ -1,18 +1,66 @@
 #include "timer.h"
 #include "scheduler.h"
+#include "irq.h"
+#include "irqtrace.h"
+#include "vdso.h"
+#include "process.h"
+#include "counter.h"
+#include "clock.h"
+#include "initcall.h"
 #include <stdint.h>
+#include <stddef.h>
 
 #define PIT_CHANNEL0 0x40
 #define PIT_COMMAND  0x43
 #define PIT_BASE_FREQ 1193182
 
 static volatile uint64_t timer_ticks = 0;
+static uint32_t timer_frequency = 0;
+
+static counter_t idle_ticks = {
+    .name = "timer.idle_ticks",
+    .kind = COUNTER_EVENT,
+};
+
+static counter_t busy_ticks = {
+    .name = "timer.busy_ticks",
+    .kind = COUNTER_EVENT,
+};
 
 static inline void outb(uint16_t port, uint8_t val) {
     __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
 }
 
+static int timer_handler(irq_frame_t* frame, void* ctx) {
+    (void)frame;
+    (void)ctx;
+    
+    timer_ticks++;
+    irqtrace_timer_tick();
+    clock_tick();
+    
+    /* Publish the new time to the shared clock page */
+    vdso_update(timer_ticks);
+    
+    /* Charge the tick to whatever it interrupted */
+    if (irq_from_idle()) {
+        counter_inc(&idle_ticks);
+    } else {
+        counter_inc(&busy_ticks);
+        process_t* current = process_current();
+        if (current) {
+            current->cpu_ticks++;
+        }
+    }
+    
+    /* Call scheduler every tick for multitasking (after the EOI) */
+    irq_request_resched();
+    return IRQ_HANDLED;
+}
+
 void timer_init(uint32_t frequency) {
+    timer_frequency = frequency;
+    
     /* Calculate divisor */
     uint32_t divisor = PIT_BASE_FREQ / frequency;
     
@@ -22,15 +70,22 @@ void timer_init(uint32_t frequency) {
     /* Send frequency divisor */
     outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xFF));
     outb(PIT_CHANNEL0, (uint8_t)((divisor >> 8) & 0xFF));
+    
+    counter_register(&idle_ticks);
+    counter_register(&busy_ticks);
+    irq_register(0, timer_handler, NULL);
 }
 
-void timer_handler(void) {
-    timer_ticks++;
-    
-    /* Call scheduler every tick for multitasking */
-    scheduler_switch();
+/* Boot setup: tick at TIMER_HZ */
+static void timer_setup(void) {
+    timer_init(TIMER_HZ);
 }
+INITCALL(INIT_DEVICE, timer_setup);
 
 uint64_t timer_get_ticks(void) {
     return timer_ticks;
 }
+
+uint32_t timer_get_frequency(void) {
+    return timer_frequency;
+}
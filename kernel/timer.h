@@ -3,13 +3,16 @@
 
 #include <stdint.h>
 
-/* Initialize PIT timer */
-void timer_init(uint32_t frequency);
+/* Tick rate of the PIT; scheduling and tick-based timeouts run at it */
+#define TIMER_HZ 100
 
-/* Timer interrupt handler (called from IRQ0) */
-void timer_handler(void);
+/* Initialize PIT timer and hook IRQ0 */
+void timer_init(uint32_t frequency);
 
 /* Get current tick count */
 uint64_t timer_get_ticks(void);
 
+/* Get tick frequency in Hz */
+uint32_t timer_get_frequency(void);
+
 #endif
@@ -0,0 +1,95 @@
+#include "tlb.h"
+#include "paging.h"
+#include "pmm.h"
+
+#define RELEASE_TABLE 0x1ULL
+
+static uint32_t flush_threshold = TLB_DEFAULT_THRESHOLD;
+static tlb_stats_t stats;
+
+static inline void invalidate(uint64_t vaddr) {
+    __asm__ volatile("invlpg (%0)" : : "r"(vaddr) : "memory");
+}
+
+static inline void reload_cr3(void) {
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) : : "memory");
+}
+
+void tlb_gather_init(tlb_gather_t* g, uint64_t root) {
+    g->root = root;
+
+    /* Kernel tables are shared by every space, so their entries may be
+     * cached whichever root is loaded */
+    g->active = root == paging_current_root() || root == paging_kernel_root();
+    g->full = 0;
+    g->count = 0;
+    g->release_count = 0;
+}
+
+void tlb_gather_add(tlb_gather_t* g, uint64_t virt_addr) {
+    if (!g->active || g->full) {
+        return;
+    }
+    if (g->count == TLB_GATHER_MAX) {
+        g->full = 1;
+        return;
+    }
+    g->addrs[g->count++] = virt_addr;
+}
+
+static void queue_release(tlb_gather_t* g, uint64_t entry) {
+    if (g->release_count == TLB_GATHER_RELEASE) {
+        tlb_gather_flush(g);
+    }
+    g->release[g->release_count++] = entry;
+}
+
+void tlb_gather_release_page(tlb_gather_t* g, uint64_t phys_addr) {
+    queue_release(g, phys_addr & PAGE_ADDR_MASK);
+}
+
+void tlb_gather_release_table(tlb_gather_t* g, uint64_t phys_addr) {
+    queue_release(g, (phys_addr & PAGE_ADDR_MASK) | RELEASE_TABLE);
+}
+
+void tlb_gather_flush(tlb_gather_t* g) {
+    if (g->full || g->count) {
+        stats.flushes++;
+
+        if (g->full || g->count > flush_threshold) {
+            reload_cr3();
+            stats.full_flushes++;
+            stats.pages_invalidated += g->full ? TLB_GATHER_MAX : g->count;
+        } else {
+            for (uint32_t i = 0; i < g->count; i++) {
+                invalidate(g->addrs[i]);
+            }
+            stats.invlpg_count += g->count;
+            stats.pages_invalidated += g->count;
+        }
+    }
+
+    /* No translation can reach these pages any more */
+    for (uint32_t i = 0; i < g->release_count; i++) {
+        uint64_t entry = g->release[i];
+        if (entry & RELEASE_TABLE) {
+            paging_free_table(entry & PAGE_ADDR_MASK);
+            stats.tables_released++;
+        } else {
+            pmm_page_unref(entry);
+        }
+    }
+
+    g->full = 0;
+    g->count = 0;
+    g->release_count = 0;
+}
+
+void tlb_set_threshold(uint32_t pages) {
+    flush_threshold = pages;
+}
+
+void tlb_get_stats(tlb_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,61 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+
+/* TLB Invalidation Gathering
+ * Unmapping code records each address it changes in a gather instead of
+ * issuing invlpg on the spot. tlb_gather_flush() then invalidates them
+ * one by one when there are few, or reloads CR3 once when there are more
+ * than the threshold (a reload drops every non-global entry, which is
+ * cheaper than a long run of invlpg).
+ *
+ * Frames and page-table pages that were unmapped are queued in the same
+ * gather and only released after the flush, so no stale translation can
+ * point at a page that has already been reused.
+ */
+
+#define TLB_GATHER_MAX        64    /* Addresses tracked before switching to a full flush */
+#define TLB_GATHER_RELEASE    64    /* Pages queued for release (flushes early when full) */
+#define TLB_DEFAULT_THRESHOLD 32    /* Above this many pages, reload CR3 */
+
+typedef struct {
+    uint64_t root;                  /* Page table root the addresses belong to */
+    int active;                     /* Root is loaded (or the addresses are kernel-wide) */
+    int full;                       /* Too many addresses: reload CR3 */
+    uint32_t count;
+    uint64_t addrs[TLB_GATHER_MAX];
+    uint32_t release_count;
+    uint64_t release[TLB_GATHER_RELEASE];   /* Bit 0 set = page-table page */
+} tlb_gather_t;
+
+typedef struct {
+    uint64_t flushes;               /* tlb_gather_flush() calls with work to do */
+    uint64_t full_flushes;          /* Flushes done with a CR3 reload */
+    uint64_t pages_invalidated;     /* Addresses covered by flushes */
+    uint64_t invlpg_count;          /* Single-page invalidations issued */
+    uint64_t tables_released;       /* Page-table pages freed after a flush */
+} tlb_stats_t;
+
+/* Start gathering changes to a page table root */
+void tlb_gather_init(tlb_gather_t* g, uint64_t root);
+
+/* Record a changed mapping */
+void tlb_gather_add(tlb_gather_t* g, uint64_t virt_addr);
+
+/* Drop a reference to a data frame after the flush */
+void tlb_gather_release_page(tlb_gather_t* g, uint64_t phys_addr);
+
+/* Free a page-table page after the flush */
+void tlb_gather_release_table(tlb_gather_t* g, uint64_t phys_addr);
+
+/* Invalidate everything gathered and release queued pages */
+void tlb_gather_flush(tlb_gather_t* g);
+
+/* Pages per flush above which a full CR3 reload is used */
+void tlb_set_threshold(uint32_t pages);
+
+/* Get flush counters */
+void tlb_get_stats(tlb_stats_t* out);
+
+#endif
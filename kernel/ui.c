@@ -1,14 +1,69 @@
 #include "ui.h"
 #include "vga.h"
+#include "gfx.h"
+#include "font8x16.h"
+#include "fiber.h"
+#include "snake.h"
+#include "kprintf.h"
+#include "klog.h"
 #include "timer.h"
+#include "clock.h"
+#include "initcall.h"
+#include "panic.h"
 #include "pmm.h"
 #include "heap.h"
+#include "counter.h"
+#include "process.h"
+#include "vmspace.h"
+#include "irqtrace.h"
+#include "kprint.h"
 
-#define NUM_BUTTONS 3
+#include <stddef.h>
 
-static button_t buttons[NUM_BUTTONS];
+#define NUM_BUTTONS 4
+
+/* Scancodes (set 1 make codes) */
+#define KEY_ESC    0x01
+#define KEY_1      0x02
+#define KEY_4      0x05
+#define KEY_ENTER  0x1C
+#define KEY_UP     0x48
+#define KEY_DOWN   0x50
+#define KEY_T      0x14
+#define KEY_P      0x19
+#define KEY_C      0x2E
+#define KEY_M      0x32
+
+/* A screen builds its widgets on entry and refreshes them every frame */
+typedef struct {
+    void (*enter)(void);            /* Build widgets, draw static parts */
+    void (*update)(void);           /* Refresh widget state (may be NULL) */
+    void (*key)(uint8_t scancode);  /* Key press (may be NULL) */
+    void (*leave)(void);            /* Switching away (may be NULL) */
+} screen_t;
+
+/* Widgets of the current screen */
+static widget_t widgets[UI_MAX_WIDGETS];
+static int widget_count = 0;
+
+/* Screen on display, and the one the next frame switches to */
+static const screen_t* current = NULL;
+static const screen_t* volatile pending = NULL;
+static volatile uint8_t exit_requested = 0;
+
+/* Frame pacing */
+static fiber_t ui_fiber;
+static uint64_t next_frame_tick = 0;
+
+/* Main menu state */
+static widget_t* menu_buttons[NUM_BUTTONS];
 static uint8_t current_selection = 0;
-static uint8_t in_menu = 1;
+
+static const screen_t menu_screen;
+static const screen_t time_screen;
+static const screen_t snake_screen;
+static const screen_t sysinfo_screen;
+static const screen_t log_screen;
 
 /* Beautiful ASCII art logo */
 static const char* logo[] = {
@@ -19,295 +74,817 @@ static const char* logo[] = {
     " |_| \\_\\/_/   \\_\\   |_|   |_____||_| \\_|    \\___/ |____/ "
 };
 
-void ui_init(void) {
-    /* Initialize buttons - vertical centered layout */
-    buttons[0].x = 28;
-    buttons[0].y = 12;
-    buttons[0].width = 24;
-    buttons[0].height = 3;
-    buttons[0].label = "   [1] Show Time    ";
-    buttons[0].selected = 1;
-    
-    buttons[1].x = 28;
-    buttons[1].y = 16;
-    buttons[1].width = 24;
-    buttons[1].height = 3;
-    buttons[1].label = "   [2] Snake Game   ";
-    buttons[1].selected = 0;
-    
-    buttons[2].x = 28;
-    buttons[2].y = 20;
-    buttons[2].width = 24;
-    buttons[2].height = 3;
-    buttons[2].label = "  [3] System Info   ";
-    buttons[2].selected = 0;
-    
-    current_selection = 0;
-    in_menu = 1;
+static const char* button_labels[NUM_BUTTONS] = {
+    "   [1] Show Time    ",
+    "   [2] Snake Game   ",
+    " [3] System Monitor ",
+    "  [4] Kernel Log    "
+};
+
+/* ---- Widgets ---- */
+
+/* Copy text into a widget buffer (returns nonzero if it changed) */
+static int copy_text(char* dst, const char* src) {
+    int changed = 0;
+    int i = 0;
+    for (; src[i] && i < UI_TEXT_MAX - 1; i++) {
+        if (dst[i] != src[i]) {
+            dst[i] = src[i];
+            changed = 1;
+        }
+    }
+    if (dst[i] != '\0') {
+        dst[i] = '\0';
+        changed = 1;
+    }
+    return changed;
 }
 
-static void draw_logo(void) {
-    uint8_t start_y = 2;
-    uint8_t start_x = 10;
+static int text_length(const char* text) {
+    int len = 0;
+    while (text[len]) len++;
+    return len;
+}
+
+static widget_t* widget_add(widget_type_t type, uint8_t x, uint8_t y, uint8_t color) {
+    if (widget_count == UI_MAX_WIDGETS) {
+        panic("UI widget pool exhausted");
+    }
     
-    for (int i = 0; i < 5; i++) {
-        vga_set_cursor(start_x, start_y + i);
-        vga_print(logo[i], VGA_COLOR_LIGHT_CYAN);
+    widget_t* w = &widgets[widget_count++];
+    w->type = type;
+    w->x = x;
+    w->y = y;
+    w->width = 0;
+    w->height = 1;
+    w->color = color;
+    w->selected = 0;
+    w->dirty = 1;
+    w->format = NULL;
+    w->value = 0;
+    w->text[0] = '\0';
+    return w;
+}
+
+/* Text label; width 0 sizes it to the text */
+static widget_t* add_label(uint8_t x, uint8_t y, uint8_t width, const char* text, uint8_t color) {
+    widget_t* w = widget_add(WIDGET_LABEL, x, y, color);
+    copy_text(w->text, text);
+    w->width = width ? width : text_length(w->text);
+    return w;
+}
+
+/* Number printed with format in a field of width cells */
+static widget_t* add_counter(uint8_t x, uint8_t y, uint8_t width, const char* format, uint8_t color) {
+    widget_t* w = widget_add(WIDGET_COUNTER, x, y, color);
+    w->width = width;
+    w->format = format;
+    return w;
+}
+
+/* Three rows tall: border, label, border */
+static widget_t* add_button(uint8_t x, uint8_t y, uint8_t width, const char* label, uint8_t selected) {
+    widget_t* w = widget_add(WIDGET_BUTTON, x, y, VGA_COLOR_WHITE);
+    copy_text(w->text, label);
+    w->width = width;
+    w->height = 3;
+    w->selected = selected;
+    return w;
+}
+
+static void set_label(widget_t* w, const char* text, uint8_t color) {
+    if (copy_text(w->text, text) || w->color != color) {
+        w->color = color;
+        w->dirty = 1;
+    }
+}
+
+static void set_value(widget_t* w, uint64_t value) {
+    if (w->value != value) {
+        w->value = value;
+        w->dirty = 1;
+    }
+}
+
+static void set_selected(widget_t* w, uint8_t selected) {
+    if (w->selected != selected) {
+        w->selected = selected;
+        w->dirty = 1;
+    }
+}
+
+/* Write text, then blank the rest of the field so shorter text erases longer */
+static void draw_field(const char* text, int len, uint8_t width, uint8_t color) {
+    if (len > width) len = width;
+    vga_write(text, len, color);
+    for (int i = len; i < width; i++) {
+        vga_putchar(' ', color);
     }
 }
 
-static void draw_button(button_t* btn) {
+static void draw_button(widget_t* btn) {
     uint8_t color = btn->selected ? VGA_COLOR_YELLOW : VGA_COLOR_WHITE;
     uint8_t border_color = btn->selected ? VGA_COLOR_YELLOW : VGA_COLOR_LIGHT_GRAY;
     
+    /* With a framebuffer the border is drawn in pixels (decorate_button) */
+    const char* corner = gfx_active() ? " " : "+";
+    const char* edge_h = gfx_active() ? " " : "-";
+    const char* edge_v = gfx_active() ? " " : "|";
+    
     /* Top border */
     vga_set_cursor(btn->x, btn->y);
-    vga_print("+", border_color);
+    vga_print(corner, border_color);
     for (int i = 0; i < btn->width - 2; i++) {
-        vga_print("-", border_color);
+        vga_print(edge_h, border_color);
     }
-    vga_print("+", border_color);
+    vga_print(corner, border_color);
     
     /* Label */
     vga_set_cursor(btn->x, btn->y + 1);
-    vga_print("|", border_color);
-    vga_print(btn->label, color);
-    vga_print("|", border_color);
+    vga_print(edge_v, border_color);
+    vga_print(btn->text, color);
+    vga_print(edge_v, border_color);
     
     /* Bottom border */
     vga_set_cursor(btn->x, btn->y + 2);
-    vga_print("+", border_color);
+    vga_print(corner, border_color);
     for (int i = 0; i < btn->width - 2; i++) {
-        vga_print("-", border_color);
+        vga_print(edge_h, border_color);
     }
-    vga_print("+", border_color);
+    vga_print(corner, border_color);
 }
 
-void ui_draw_menu(void) {
-    vga_clear();
-    
-    /* Draw logo */
-    draw_logo();
-    
-    /* Draw subtitle */
-    vga_set_cursor(18, 8);
-    vga_print("Welcome to Rayen Ouerghui OS", VGA_COLOR_YELLOW);
-    
-    /* Draw buttons */
-    for (int i = 0; i < NUM_BUTTONS; i++) {
-        draw_button(&buttons[i]);
+/* Pixel frame for a button, and a tint if selected (after vga_flush) */
+static void decorate_button(widget_t* btn) {
+    gfx_rect_t r;
+    if (!vga_cell_rect(btn->x, btn->y, btn->width, btn->height, &r)) return;
+    
+    /* Run the frame through the middle of the blank border cells */
+    int inset = FONT_WIDTH / 2;
+    r.x += inset;
+    r.y += inset;
+    r.w -= 2 * inset;
+    r.h -= 2 * inset;
+    
+    if (btn->selected) {
+        uint32_t yellow = gfx_vga_color(VGA_COLOR_YELLOW);
+        gfx_blend_rect(r.x, r.y, r.w, r.h, yellow, 48);
+        gfx_frame_rect(r.x, r.y, r.w, r.h, 2, yellow);
+    } else {
+        gfx_frame_rect(r.x, r.y, r.w, r.h, 1, gfx_vga_color(VGA_COLOR_LIGHT_GRAY));
     }
     
-    /* Draw instructions at bottom */
-    vga_set_cursor(22, 24);
-    vga_print("Press [1] [2] [3] to select  |  [ESC] to exit", VGA_COLOR_DARK_GRAY);
+    /* The cells no longer match the pixels: the next redraw of the
+     * button starts from clean cells so the tint never accumulates */
+    vga_invalidate(btn->x, btn->y, btn->width, btn->height);
 }
 
-void ui_handle_input(uint8_t scancode) {
-    if (!in_menu) return;
+static void draw_widget(widget_t* w) {
+    char buffer[UI_TEXT_MAX];
+    int len;
+    
+    switch (w->type) {
+        case WIDGET_LABEL:
+            vga_set_cursor(w->x, w->y);
+            draw_field(w->text, text_length(w->text), w->width, w->color);
+            break;
+        case WIDGET_COUNTER:
+            len = ksnprintf(buffer, sizeof(buffer), w->format, w->value);
+            vga_set_cursor(w->x, w->y);
+            draw_field(buffer, len, w->width, w->color);
+            break;
+        case WIDGET_BUTTON:
+            draw_button(w);
+            break;
+    }
+}
+
+/* Draw the widgets that changed, then show them */
+static void render(void) {
+    int drawn = 0;
+    for (int i = 0; i < widget_count; i++) {
+        if (widgets[i].dirty) {
+            draw_widget(&widgets[i]);
+            drawn = 1;
+        }
+    }
+    if (!drawn) {
+        return;
+    }
     
-    /* Number keys 1, 2, 3 */
-    if (scancode >= 0x02 && scancode <= 0x04) {
-        uint8_t choice = scancode - 0x02;
-        
-        /* Update selection */
-        buttons[current_selection].selected = 0;
-        current_selection = choice;
-        buttons[current_selection].selected = 1;
-        
-        /* Redraw menu */
-        ui_draw_menu();
-        
-        /* Small delay */
-        for (volatile int i = 0; i < 10000000; i++);
-        
-        /* Execute */
-        in_menu = 0;
-        switch (choice) {
-            case 0:
-                ui_show_time();
-                break;
-            case 1:
-                ui_show_snake();
-                break;
-            case 2:
-                ui_show_sysinfo();
-                break;
+    vga_flush();
+    
+    for (int i = 0; i < widget_count; i++) {
+        widget_t* w = &widgets[i];
+        if (w->dirty && w->type == WIDGET_BUTTON && gfx_active()) {
+            decorate_button(w);
         }
-        in_menu = 1;
-        ui_draw_menu();
+        w->dirty = 0;
     }
+    gfx_present();
 }
 
-void ui_show_time(void) {
+/* ---- Frame loop and navigation ---- */
+
+static void enter_screen(const screen_t* screen) {
+    if (current && current->leave) {
+        current->leave();
+    }
+    widget_count = 0;
     vga_clear();
+    current = screen;
+    screen->enter();
+}
+
+void ui_update(void) {
+    uint8_t scancode;
+    while (fiber_input_pop(&scancode)) {
+        ui_handle_input(scancode);
+    }
     
-    vga_set_cursor(30, 5);
-    vga_print("=== SYSTEM TIME ===", VGA_COLOR_LIGHT_CYAN);
-    
-    uint64_t ticks = timer_get_ticks();
-    uint64_t seconds = ticks / 100;
-    uint64_t minutes = seconds / 60;
-    uint64_t hours = minutes / 60;
-    
-    seconds %= 60;
-    minutes %= 60;
-    hours %= 24;
-    
-    vga_set_cursor(25, 10);
-    vga_print("System Uptime:", VGA_COLOR_WHITE);
+    if (exit_requested) {
+        exit_requested = 0;
+        if (current != &menu_screen) {
+            pending = &menu_screen;
+        }
+    }
     
-    vga_set_cursor(30, 12);
-    vga_print("Hours:   ", VGA_COLOR_LIGHT_GRAY);
-    print_number(hours);
+    const screen_t* next = pending;
+    if (next) {
+        pending = NULL;
+        enter_screen(next);
+    }
     
-    vga_set_cursor(30, 13);
-    vga_print("Minutes: ", VGA_COLOR_LIGHT_GRAY);
-    print_number(minutes);
+    if (current && current->update) {
+        current->update();
+    }
+    render();
     
-    vga_set_cursor(30, 14);
-    vga_print("Seconds: ", VGA_COLOR_LIGHT_GRAY);
-    print_number(seconds);
+    /* Deferred initialization waits for the first frame */
+    initcall_ui_ready();
+}
+
+/* Ticks until the next frame is due. A frame that overran starts the
+ * next one a tick later rather than running a burst to catch up. */
+static uint64_t frame_delay(void) {
+    uint32_t hz = timer_get_frequency();
+    uint64_t period = hz / UI_FPS ? hz / UI_FPS : 1;
+    uint64_t now = timer_get_ticks();
+    
+    next_frame_tick += period;
+    if (next_frame_tick <= now) {
+        next_frame_tick = now + 1;
+    }
+    return next_frame_tick - now;
+}
+
+/* UI fiber: one frame, then sleep until the next is due */
+static int ui_task(fiber_t* f) {
+    FIBER_BEGIN(f);
+    next_frame_tick = timer_get_ticks();
+    while (1) {
+        ui_update();
+        FIBER_SLEEP(f, frame_delay());
+    }
+    FIBER_END(f);
+}
+
+void ui_init(void) {
+    widget_count = 0;
+    current = NULL;
+    pending = NULL;
+    exit_requested = 0;
+    current_selection = 0;
+}
+INITCALL(INIT_CORE, ui_init);
+
+void ui_start(void) {
+    /* From here on log output would scribble over the widgets */
+    kprint_set_screen(0);
+    snake_init();
+    ui_draw_menu();
+    fiber_init(&ui_fiber, ui_task, NULL);
+    fiber_spawn(&ui_fiber);
+}
+
+void ui_handle_input(uint8_t scancode) {
+    /* Key releases (bit 7) and the extended-key prefix are ignored */
+    if (scancode & 0x80) return;
     
-    vga_set_cursor(30, 16);
-    vga_print("Total Ticks: ", VGA_COLOR_LIGHT_GRAY);
-    print_number(ticks);
+    if (scancode == KEY_ESC) {
+        ui_request_exit();
+        return;
+    }
+    if (current && current->key) {
+        current->key(scancode);
+    }
+}
+
+void ui_request_exit(void) {
+    exit_requested = 1;
+}
+
+void ui_draw_menu(void) {
+    pending = &menu_screen;
+}
+
+void ui_show_time(void) {
+    pending = &time_screen;
+}
+
+void ui_show_snake(void) {
+    pending = &snake_screen;
+}
+
+void ui_show_sysinfo(void) {
+    pending = &sysinfo_screen;
+}
+
+void ui_show_log(void) {
+    pending = &log_screen;
+}
+
+/* ---- Main menu ---- */
+
+static void menu_select(uint8_t choice) {
+    current_selection = choice;
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        set_selected(menu_buttons[i], i == choice);
+    }
+}
+
+static void menu_open(uint8_t choice) {
+    switch (choice) {
+        case 0:
+            ui_show_time();
+            break;
+        case 1:
+            ui_show_snake();
+            break;
+        case 2:
+            ui_show_sysinfo();
+            break;
+        case 3:
+            ui_show_log();
+            break;
+    }
+}
+
+static void menu_enter(void) {
+    for (int i = 0; i < 5; i++) {
+        add_label(10, 2 + i, 0, logo[i], VGA_COLOR_LIGHT_CYAN);
+    }
+    add_label(18, 8, 0, "Welcome to Rayen Ouerghui OS", VGA_COLOR_YELLOW);
     
-    vga_set_cursor(25, 20);
-    vga_print("Press ESC to return to menu...", VGA_COLOR_YELLOW);
+    /* Vertical centered layout */
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        menu_buttons[i] = add_button(28, 10 + i * 3, 24, button_labels[i], i == current_selection);
+    }
     
-    while (1) {
-        __asm__ volatile("hlt");
+    add_label(19, 24, 0, "Press [1] [2] [3] [4] to select  |  [ESC] to exit",
+              VGA_COLOR_DARK_GRAY);
+}
+
+static void menu_key(uint8_t scancode) {
+    if (scancode >= KEY_1 && scancode <= KEY_4) {
+        uint8_t choice = scancode - KEY_1;
+        menu_select(choice);
+        menu_open(choice);
+    } else if (scancode == KEY_UP) {
+        menu_select((current_selection + NUM_BUTTONS - 1) % NUM_BUTTONS);
+    } else if (scancode == KEY_DOWN) {
+        menu_select((current_selection + 1) % NUM_BUTTONS);
+    } else if (scancode == KEY_ENTER) {
+        menu_open(current_selection);
     }
 }
 
-void ui_show_snake(void) {
-    vga_clear();
+static const screen_t menu_screen = { menu_enter, NULL, menu_key, NULL };
+
+/* ---- Time ---- */
+
+static widget_t* time_date;
+static widget_t* time_uptime;
+static widget_t* time_ticks;
+
+static void time_enter(void) {
+    add_label(30, 5, 0, "=== SYSTEM TIME ===", VGA_COLOR_LIGHT_CYAN);
+    
+    add_label(20, 9, 0, "Date (UTC):  ", VGA_COLOR_LIGHT_GRAY);
+    time_date = add_label(33, 9, 30, "", VGA_COLOR_LIGHT_CYAN);
+    add_label(20, 11, 0, "Uptime:      ", VGA_COLOR_LIGHT_GRAY);
+    time_uptime = add_label(33, 11, 30, "", VGA_COLOR_LIGHT_CYAN);
+    add_label(20, 13, 0, "Total Ticks: ", VGA_COLOR_LIGHT_GRAY);
+    time_ticks = add_counter(33, 13, 20, "%lu", VGA_COLOR_LIGHT_CYAN);
+    
+    char text[UI_TEXT_MAX];
+    const clocksource_t* cs = clock_source();
+    if (cs) {
+        ksnprintf(text, sizeof(text), "Clocksource: %s at %lu kHz, tick %u Hz",
+                  cs->name, cs->freq_hz / 1000, timer_get_frequency());
+        add_label(20, 15, 0, text, VGA_COLOR_DARK_GRAY);
+    }
+    
+    add_label(25, 20, 0, "Press ESC to return to menu...", VGA_COLOR_YELLOW);
+}
+
+static void time_update(void) {
+    char text[UI_TEXT_MAX];
+    clock_datetime_t now;
+    clock_to_datetime(clock_realtime() / NS_PER_SEC, &now);
+    ksnprintf(text, sizeof(text), "%u-%02u-%02u %02u:%02u:%02u",
+              now.year, now.month, now.day, now.hour, now.minute, now.second);
+    set_label(time_date, text, VGA_COLOR_LIGHT_CYAN);
+    
+    uint64_t ms = clock_monotonic_ns() / NS_PER_MS;
+    uint64_t seconds = ms / 1000;
+    ksnprintf(text, sizeof(text), "%lu:%02lu:%02lu.%03lu",
+              seconds / 3600, (seconds / 60) % 60, seconds % 60, ms % 1000);
+    set_label(time_uptime, text, VGA_COLOR_LIGHT_CYAN);
+    
+    set_value(time_ticks, timer_get_ticks());
+}
+
+static const screen_t time_screen = { time_enter, time_update, NULL, NULL };
+
+/* ---- Snake ---- */
+
+static widget_t* snake_score;
+static widget_t* snake_late;
+static widget_t* snake_hint;
+
+static void snake_enter(void) {
+    add_label(32, 2, 0, "=== SNAKE GAME ===", VGA_COLOR_LIGHT_GREEN);
     
-    vga_set_cursor(32, 2);
-    vga_print("=== SNAKE GAME ===", VGA_COLOR_LIGHT_GREEN);
+    add_label(11, 4, 0, "Score: ", VGA_COLOR_WHITE);
+    snake_score = add_counter(18, 4, 10, "%lu", VGA_COLOR_LIGHT_CYAN);
+    add_label(44, 4, 0, "Late/dropped steps: ", VGA_COLOR_DARK_GRAY);
+    snake_late = add_label(64, 4, 6, "", VGA_COLOR_DARK_GRAY);
     
-    /* Game border */
-    for (int x = 10; x < 70; x++) {
-        vga_set_cursor(x, 5);
+    /* Game border (static, the game draws inside it) */
+    for (int x = SNAKE_BOARD_X - 1; x <= SNAKE_BOARD_X + SNAKE_COLS; x++) {
+        vga_set_cursor(x, SNAKE_BOARD_Y - 1);
         vga_print("#", VGA_COLOR_LIGHT_GRAY);
-        vga_set_cursor(x, 20);
+        vga_set_cursor(x, SNAKE_BOARD_Y + SNAKE_ROWS);
         vga_print("#", VGA_COLOR_LIGHT_GRAY);
     }
-    for (int y = 5; y <= 20; y++) {
-        vga_set_cursor(10, y);
+    for (int y = SNAKE_BOARD_Y - 1; y <= SNAKE_BOARD_Y + SNAKE_ROWS; y++) {
+        vga_set_cursor(SNAKE_BOARD_X - 1, y);
         vga_print("#", VGA_COLOR_LIGHT_GRAY);
-        vga_set_cursor(69, y);
+        vga_set_cursor(SNAKE_BOARD_X + SNAKE_COLS, y);
         vga_print("#", VGA_COLOR_LIGHT_GRAY);
     }
     
-    /* Snake */
-    vga_set_cursor(40, 12);
-    vga_print("@", VGA_COLOR_LIGHT_GREEN);
+    snake_hint = add_label(15, 22, 50, "", VGA_COLOR_YELLOW);
+    snake_start();
+}
+
+static void snake_update(void) {
+    snake_status_t status;
+    snake_get_status(&status);
     
-    /* Food */
-    vga_set_cursor(50, 15);
-    vga_print("*", VGA_COLOR_LIGHT_RED);
+    set_value(snake_score, status.score);
     
-    vga_set_cursor(15, 22);
-    vga_print("Use WASD to move  |  ESC to return", VGA_COLOR_YELLOW);
+    char text[UI_TEXT_MAX];
+    ksnprintf(text, sizeof(text), "%lu/%lu", status.late_steps, status.dropped_steps);
+    set_label(snake_late, text, VGA_COLOR_DARK_GRAY);
+    
+    if (status.over) {
+        set_label(snake_hint, "GAME OVER  |  SPACE to restart  |  ESC to return",
+                  VGA_COLOR_LIGHT_RED);
+    } else {
+        set_label(snake_hint, "Use WASD to move  |  ESC to return", VGA_COLOR_YELLOW);
+    }
+}
+
+static void snake_leave(void) {
+    snake_stop();
+}
+
+static const screen_t snake_screen = { snake_enter, snake_update, snake_input, snake_leave };
+
+/* ---- System monitor ---- */
+
+#define MONITOR_HZ            2     /* Samples per second */
+#define MONITOR_COUNTER_TOP   3
+#define MONITOR_COUNTER_ROWS  10    /* Two columns of counters */
+#define MONITOR_COUNTERS      (MONITOR_COUNTER_ROWS * 2)
+#define MONITOR_MAX_COUNTERS  64    /* Registry entries with a tracked rate */
+#define MONITOR_PROC_TOP      15
+#define MONITOR_PROC_ROWS     8
+
+typedef enum {
+    SORT_PID,
+    SORT_CPU,
+    SORT_TIME,
+    SORT_MEM
+} monitor_sort_t;
+
+typedef struct {
+    uint32_t pid;
+    process_state_t state;
+    uint64_t cpu_permille;      /* Share of the last interval */
+    uint64_t cpu_ticks;
+    uint64_t memory;
+} monitor_row_t;
+
+static const char* const sort_names[] = { "pid", "cpu", "time", "mem" };
+
+static widget_t* mon_summary;
+static widget_t* mon_counters[MONITOR_COUNTERS];
+static widget_t* mon_sort_label;
+static widget_t* mon_procs[MONITOR_PROC_ROWS];
+static monitor_sort_t mon_sort = SORT_CPU;
+
+/* Previous sample, for rates */
+static uint64_t mon_last_tick;
+static uint64_t mon_next_sample;
+static uint64_t mon_counter_prev[MONITOR_MAX_COUNTERS];
+static uint64_t mon_proc_prev[MAX_PROCESSES];
+
+static const char* state_name(process_state_t state) {
+    switch (state) {
+        case PROCESS_READY:   return "ready";
+        case PROCESS_RUNNING: return "running";
+        case PROCESS_BLOCKED: return "blocked";
+        default:              return "exited";
+    }
+}
+
+/* Kernel stack, PCB and mapped user pages */
+static uint64_t process_memory(process_t* proc) {
+    uint64_t bytes = sizeof(process_t) + proc->stack_size;
+    if (proc->vm) {
+        bytes += vm_space_resident_pages(proc->vm) * PAGE_SIZE;
+    }
+    return bytes;
+}
+
+/* Ordering of two rows under the current sort key */
+static int row_before(const monitor_row_t* a, const monitor_row_t* b) {
+    switch (mon_sort) {
+        case SORT_CPU:
+            if (a->cpu_permille != b->cpu_permille) return a->cpu_permille > b->cpu_permille;
+            break;
+        case SORT_TIME:
+            if (a->cpu_ticks != b->cpu_ticks) return a->cpu_ticks > b->cpu_ticks;
+            break;
+        case SORT_MEM:
+            if (a->memory != b->memory) return a->memory > b->memory;
+            break;
+        case SORT_PID:
+            break;
+    }
+    return a->pid < b->pid;
+}
+
+static void monitor_sample_counters(uint64_t elapsed, uint32_t hz) {
+    char line[UI_TEXT_MAX];
+    int slot = 0;
+    int index = 0;
+    
+    for (counter_t* c = counter_first(); c; c = c->next, index++) {
+        uint64_t value = counter_read(c);
+        uint64_t prev = value;
+        if (index < MONITOR_MAX_COUNTERS) {
+            prev = mon_counter_prev[index];
+            mon_counter_prev[index] = value;
+        }
+        
+        /* Counters that never moved only take up room */
+        if (value == 0 || slot == MONITOR_COUNTERS) {
+            continue;
+        }
+        
+        if (c->kind == COUNTER_EVENT) {
+            uint64_t rate = elapsed ? (value - prev) * hz / elapsed : 0;
+            ksnprintf(line, sizeof(line), "%-17s %10lu %6lu/s", c->name, value, rate);
+        } else {
+            ksnprintf(line, sizeof(line), "%-17s %10lu", c->name, value);
+        }
+        set_label(mon_counters[slot++], line, VGA_COLOR_LIGHT_GRAY);
+    }
     
-    vga_set_cursor(20, 23);
-    vga_print("(Demo version - full game coming soon!)", VGA_COLOR_DARK_GRAY);
+    for (; slot < MONITOR_COUNTERS; slot++) {
+        set_label(mon_counters[slot], "", VGA_COLOR_LIGHT_GRAY);
+    }
+}
+
+static void monitor_sample_processes(uint64_t elapsed, uint32_t hz) {
+    monitor_row_t rows[MAX_PROCESSES];
+    int count = 0;
+    
+    /* Keep the process table still while reading it */
+    uint64_t flags = irq_save();
+    for (uint32_t pid = 0; pid < MAX_PROCESSES; pid++) {
+        process_t* proc = process_get(pid);
+        if (!proc || proc->state == PROCESS_TERMINATED) {
+            mon_proc_prev[pid] = 0;
+            continue;
+        }
+        
+        monitor_row_t* row = &rows[count++];
+        row->pid = pid;
+        row->state = proc->state;
+        row->cpu_ticks = proc->cpu_ticks;
+        row->cpu_permille = elapsed ? (proc->cpu_ticks - mon_proc_prev[pid]) * 1000 / elapsed : 0;
+        row->memory = process_memory(proc);
+        mon_proc_prev[pid] = proc->cpu_ticks;
+    }
+    irq_restore(flags);
+    
+    /* Insertion sort: there are only a handful of processes */
+    for (int i = 1; i < count; i++) {
+        monitor_row_t row = rows[i];
+        int j = i;
+        while (j > 0 && row_before(&row, &rows[j - 1])) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j] = row;
+    }
     
-    while (1) {
-        __asm__ volatile("hlt");
+    char line[UI_TEXT_MAX];
+    for (int i = 0; i < MONITOR_PROC_ROWS; i++) {
+        if (i >= count) {
+            set_label(mon_procs[i], "", VGA_COLOR_LIGHT_GRAY);
+            continue;
+        }
+        
+        monitor_row_t* row = &rows[i];
+        uint64_t centis = hz ? row->cpu_ticks * 100 / hz : 0;
+        ksnprintf(line, sizeof(line), "%5u  %-8s %3lu.%lu  %7lu.%02lu  %M",
+                  row->pid, state_name(row->state),
+                  row->cpu_permille / 10, row->cpu_permille % 10,
+                  centis / 100, centis % 100, row->memory);
+        set_label(mon_procs[i], line,
+                  row->state == PROCESS_RUNNING ? VGA_COLOR_WHITE : VGA_COLOR_LIGHT_GRAY);
     }
 }
 
-void ui_show_sysinfo(void) {
-    vga_clear();
+static void monitor_sample(void) {
+    uint32_t hz = timer_get_frequency();
+    uint64_t now = timer_get_ticks();
+    uint64_t elapsed = now - mon_last_tick;
+    mon_last_tick = now;
+    
+    /* Busy share of the ticks since the last sample */
+    counter_t* busy = counter_find("timer.busy_ticks");
+    counter_t* idle = counter_find("timer.idle_ticks");
+    static uint64_t last_busy, last_idle;
+    uint64_t busy_now = busy ? counter_read(busy) : 0;
+    uint64_t idle_now = idle ? counter_read(idle) : 0;
+    uint64_t busy_delta = busy_now - last_busy;
+    uint64_t total_delta = busy_delta + (idle_now - last_idle);
+    last_busy = busy_now;
+    last_idle = idle_now;
+    
+    char line[UI_TEXT_MAX];
+    ksnprintf(line, sizeof(line), "Up %lus  CPU %3lu%% busy  Mem %M / %M  Free %M",
+              hz ? now / hz : 0, total_delta ? busy_delta * 100 / total_delta : 0,
+              pmm_get_used_memory(), pmm_get_total_memory(), pmm_get_free_memory());
+    set_label(mon_summary, line, VGA_COLOR_LIGHT_GREEN);
+    
+    monitor_sample_counters(elapsed, hz);
+    monitor_sample_processes(elapsed, hz);
+}
+
+static void sysinfo_enter(void) {
+    add_label(29, 0, 0, "=== SYSTEM MONITOR ===", VGA_COLOR_LIGHT_CYAN);
+    mon_summary = add_label(1, 1, VGA_WIDTH - 2, "", VGA_COLOR_LIGHT_GREEN);
+    
+    add_label(1, 2, 0, "COUNTER                VALUE   RATE", VGA_COLOR_YELLOW);
+    add_label(41, 2, 0, "COUNTER                VALUE   RATE", VGA_COLOR_YELLOW);
+    for (int i = 0; i < MONITOR_COUNTERS; i++) {
+        mon_counters[i] = add_label(i < MONITOR_COUNTER_ROWS ? 1 : 41,
+                                    MONITOR_COUNTER_TOP + i % MONITOR_COUNTER_ROWS,
+                                    38, "", VGA_COLOR_LIGHT_GRAY);
+    }
     
-    vga_set_cursor(28, 3);
-    vga_print("=== SYSTEM INFORMATION ===", VGA_COLOR_LIGHT_CYAN);
-    
-    vga_set_cursor(15, 6);
-    vga_print("Operating System:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 6);
-    vga_print("RayenOS v1.0", VGA_COLOR_LIGHT_GREEN);
-    
-    vga_set_cursor(15, 7);
-    vga_print("Architecture:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 7);
-    vga_print("x86_64", VGA_COLOR_LIGHT_GREEN);
-    
-    vga_set_cursor(15, 8);
-    vga_print("Kernel:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 8);
-    vga_print("Freestanding", VGA_COLOR_LIGHT_GREEN);
-    
-    vga_set_cursor(15, 10);
-    vga_print("=== Memory Statistics ===", VGA_COLOR_YELLOW);
-    
-    uint64_t total = pmm_get_total_memory();
-    uint64_t used = pmm_get_used_memory();
-    uint64_t free = pmm_get_free_memory();
-    
-    vga_set_cursor(15, 12);
-    vga_print("Total Memory:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 12);
-    print_number(total / 1024);
-    vga_print(" KB", VGA_COLOR_LIGHT_GRAY);
-    
-    vga_set_cursor(15, 13);
-    vga_print("Used Memory:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 13);
-    print_number(used / 1024);
-    vga_print(" KB", VGA_COLOR_LIGHT_GRAY);
-    
-    vga_set_cursor(15, 14);
-    vga_print("Free Memory:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 14);
-    print_number(free / 1024);
-    vga_print(" KB", VGA_COLOR_LIGHT_GRAY);
-    
-    uint64_t heap_total, heap_used, heap_free;
-    heap_stats(&heap_total, &heap_used, &heap_free);
-    
-    vga_set_cursor(15, 16);
-    vga_print("Heap Total:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 16);
-    print_number(heap_total / 1024);
-    vga_print(" KB", VGA_COLOR_LIGHT_GRAY);
-    
-    uint64_t ticks = timer_get_ticks();
-    uint64_t seconds = ticks / 100;
-    
-    vga_set_cursor(15, 18);
-    vga_print("System Uptime:", VGA_COLOR_WHITE);
-    vga_set_cursor(35, 18);
-    print_number(seconds);
-    vga_print(" seconds", VGA_COLOR_LIGHT_GRAY);
-    
-    vga_set_cursor(25, 22);
-    vga_print("Press ESC to return to menu...", VGA_COLOR_YELLOW);
+    add_label(1, MONITOR_PROC_TOP - 1, 0,
+              "  PID  STATE     CPU%        TIME  MEMORY", VGA_COLOR_YELLOW);
+    mon_sort_label = add_label(60, MONITOR_PROC_TOP - 1, 19, "", VGA_COLOR_DARK_GRAY);
+    for (int i = 0; i < MONITOR_PROC_ROWS; i++) {
+        mon_procs[i] = add_label(1, MONITOR_PROC_TOP + i, 60, "", VGA_COLOR_LIGHT_GRAY);
+    }
     
-    while (1) {
-        __asm__ volatile("hlt");
+    add_label(10, 24, 0, "Sort: [P]id [C]pu [T]ime [M]em  |  ESC to return",
+              VGA_COLOR_YELLOW);
+    
+    /* First sample right away; rates start from it */
+    mon_last_tick = timer_get_ticks();
+    mon_next_sample = mon_last_tick;
+    int index = 0;
+    for (counter_t* c = counter_first(); c && index < MONITOR_MAX_COUNTERS; c = c->next) {
+        mon_counter_prev[index++] = counter_read(c);
+    }
+    for (uint32_t pid = 0; pid < MAX_PROCESSES; pid++) {
+        process_t* proc = process_get(pid);
+        mon_proc_prev[pid] = proc ? proc->cpu_ticks : 0;
     }
 }
 
-void print_number(uint64_t num) {
-    if (num == 0) {
-        vga_print("0", VGA_COLOR_LIGHT_CYAN);
+static void sysinfo_update(void) {
+    char text[UI_TEXT_MAX];
+    ksnprintf(text, sizeof(text), "sorted by %s", sort_names[mon_sort]);
+    set_label(mon_sort_label, text, VGA_COLOR_DARK_GRAY);
+    
+    uint64_t now = timer_get_ticks();
+    if (now < mon_next_sample) {
         return;
     }
+    uint32_t hz = timer_get_frequency();
+    mon_next_sample = now + (hz / MONITOR_HZ ? hz / MONITOR_HZ : 1);
+    monitor_sample();
+}
+
+static void sysinfo_key(uint8_t scancode) {
+    switch (scancode) {
+        case KEY_P:
+            mon_sort = SORT_PID;
+            break;
+        case KEY_C:
+            mon_sort = SORT_CPU;
+            break;
+        case KEY_T:
+            mon_sort = SORT_TIME;
+            break;
+        case KEY_M:
+            mon_sort = SORT_MEM;
+            break;
+        default:
+            return;
+    }
+    /* Re-sort now rather than at the next sample */
+    mon_next_sample = 0;
+}
+
+static const screen_t sysinfo_screen = { sysinfo_enter, sysinfo_update, sysinfo_key, NULL };
+
+/* ---- Kernel log ---- */
+
+#define LOG_VIEW_TOP   3
+#define LOG_VIEW_LINES 19
+
+static widget_t* log_lines[LOG_VIEW_LINES];
+static widget_t* log_lost;
+static uint64_t log_shown_next;
+
+static void log_enter(void) {
+    add_label(31, 1, 0, "=== KERNEL LOG ===", VGA_COLOR_LIGHT_CYAN);
+    
+    /* One row short of the screen width so the cursor never wraps */
+    for (int i = 0; i < LOG_VIEW_LINES; i++) {
+        log_lines[i] = add_label(0, LOG_VIEW_TOP + i, VGA_WIDTH - 1, "", VGA_COLOR_LIGHT_GRAY);
+    }
     
-    char buffer[20];
-    int i = 0;
+    add_label(2, 23, 0, "Records lost: ", VGA_COLOR_LIGHT_GRAY);
+    log_lost = add_counter(16, 23, 20, "%lu", VGA_COLOR_LIGHT_CYAN);
     
-    while (num > 0) {
-        buffer[i++] = '0' + (num % 10);
-        num /= 10;
+    add_label(25, 24, 0, "Press ESC to return to menu...", VGA_COLOR_YELLOW);
+    log_shown_next = (uint64_t)-1;
+}
+
+static void log_update(void) {
+    set_value(log_lost, klog_lost());
+    
+    uint64_t next = klog_next();
+    if (next == log_shown_next) {
+        return;
     }
+    log_shown_next = next;
     
-    for (int j = i - 1; j >= 0; j--) {
-        char c[2] = {buffer[j], '\0'};
-        vga_print(c, VGA_COLOR_LIGHT_CYAN);
+    /* Newest records that fit on screen */
+    uint64_t pos = klog_first();
+    if (next - pos > LOG_VIEW_LINES) {
+        pos = next - LOG_VIEW_LINES;
     }
+    
+    int row = 0;
+    klog_record_t rec;
+    for (; pos < next && row < LOG_VIEW_LINES; pos++) {
+        if (!klog_read(pos, &rec)) {
+            continue;
+        }
+        
+        uint8_t color;
+        const char* prefix = kprint_style((log_level_t)rec.level, &color);
+        uint64_t us = rec.time_ns / NS_PER_US;
+        
+        char line[UI_TEXT_MAX];
+        ksnprintf(line, sizeof(line), "[%5lu.%06lu] %s%.*s",
+                  us / 1000000, us % 1000000, prefix, (int)rec.len, rec.text);
+        set_label(log_lines[row++], line, color);
+    }
+    for (; row < LOG_VIEW_LINES; row++) {
+        set_label(log_lines[row], "", VGA_COLOR_LIGHT_GRAY);
+    }
+}
+
+static const screen_t log_screen = { log_enter, log_update, NULL, NULL };
+
+void print_number(uint64_t num) {
+    char buffer[21];
+    int len = ksnprintf(buffer, sizeof(buffer), "%lu", num);
+    vga_write(buffer, len, VGA_COLOR_LIGHT_CYAN);
 }
@@ -3,38 +3,65 @@
 
 #include <stdint.h>
 
-/* UI button structure */
+/* Retained-mode UI
+ * Each screen builds a list of widgets once when it is entered and then
+ * only updates their state. A UI fiber runs ui_update() at UI_FPS: it
+ * handles queued keys, lets the screen refresh its values, and redraws
+ * the widgets whose state actually changed since the last frame.
+ */
+
+#define UI_FPS          25
+#define UI_MAX_WIDGETS  48
+#define UI_TEXT_MAX     80
+
+typedef enum {
+    WIDGET_LABEL,           /* Text */
+    WIDGET_BUTTON,          /* Framed text, may be selected */
+    WIDGET_COUNTER          /* A number printed with a format */
+} widget_type_t;
+
 typedef struct {
+    widget_type_t type;
     uint8_t x, y;           /* Position */
-    uint8_t width, height;  /* Size */
-    const char* label;      /* Button text */
-    uint8_t selected;       /* Is selected */
-} button_t;
+    uint8_t width, height;  /* Size in cells (erased on redraw) */
+    uint8_t color;
+    uint8_t selected;       /* Buttons: is selected */
+    uint8_t dirty;          /* Needs drawing next frame */
+    const char* format;     /* Counters: ksnprintf format of value */
+    uint64_t value;         /* Counters */
+    char text[UI_TEXT_MAX]; /* Labels and buttons */
+} widget_t;
 
 /* Initialize UI system */
 void ui_init(void);
 
-/* Draw the main menu */
+/* Start the UI fiber on the main menu */
+void ui_start(void);
+
+/* Switch to the main menu */
 void ui_draw_menu(void);
 
-/* Handle keyboard input for menu */
+/* Handle a key press (called by ui_update() for each queued scancode) */
 void ui_handle_input(uint8_t scancode);
 
 /* Request exiting the current UI screen back to the main menu */
 void ui_request_exit(void);
 
-/* Run one UI update step from the main loop */
+/* Run one UI frame: input, screen refresh, redraw of changed widgets */
 void ui_update(void);
 
-/* Show time screen */
+/* Switch to the time screen */
 void ui_show_time(void);
 
-/* Show snake game */
+/* Switch to the snake game */
 void ui_show_snake(void);
 
-/* Show system info */
+/* Switch to the system monitor (counters and processes) */
 void ui_show_sysinfo(void);
 
+/* Switch to the most recent kernel log records */
+void ui_show_log(void);
+
 /* Helper function to print numbers */
 void print_number(uint64_t num);
 
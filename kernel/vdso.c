@@ -0,0 +1,61 @@
+#include "vdso.h"
+#include "paging.h"
+#include "pmm.h"
+#include "timer.h"
+#include "kprint.h"
+#include "clock.h"
+#include "initcall.h"
+
+#define TSC_SHIFT 32
+
+static vdso_clock_t* clock_page = (vdso_clock_t*)VDSO_KERNEL_ADDR;
+
+void vdso_init(void) {
+    uint64_t phys = pmm_alloc_page();
+
+    /* Writable alias for the kernel, read-only view for everyone */
+    paging_map_page(VDSO_KERNEL_ADDR, phys, PAGE_PRESENT | PAGE_WRITE);
+    paging_map_page(VDSO_CLOCK_ADDR, phys, PAGE_PRESENT | PAGE_USER);
+
+    uint64_t* words = (uint64_t*)VDSO_KERNEL_ADDR;
+    for (int i = 0; i < PAGE_SIZE / 8; i++) {
+        words[i] = 0;
+    }
+
+    clock_page->tsc_shift = TSC_SHIFT;
+
+    kprint_ok("Shared clock page mapped at 0x3FFFF000");
+}
+INITCALL(INIT_MEMORY, vdso_init, "paging_enable");
+
+void vdso_update(uint64_t ticks) {
+    uint64_t tsc = vdso_rdtsc();
+    uint64_t ns = clock_monotonic_ns();
+    uint64_t tsc_mult = clock_page->tsc_mult;
+
+    /* Readers extrapolate with the TSC between ticks; never publish a
+     * time before one they may already have seen */
+    if (tsc_mult) {
+        uint64_t delta = tsc - clock_page->tsc_base;
+        uint64_t seen = clock_page->ns_base +
+                        (uint64_t)(((unsigned __int128)delta * tsc_mult) >> TSC_SHIFT);
+        if (seen > ns) {
+            ns = seen;
+        }
+    } else if (clock_tsc_hz()) {
+        tsc_mult = (NS_PER_SEC << TSC_SHIFT) / clock_tsc_hz();
+    }
+
+    /* Writer side of the seqlock (single writer: the timer IRQ) */
+    clock_page->seq++;
+    __asm__ volatile("" : : : "memory");
+
+    clock_page->tick_hz = timer_get_frequency();
+    clock_page->ticks = ticks;
+    clock_page->tsc_base = tsc;
+    clock_page->ns_base = ns;
+    clock_page->tsc_mult = tsc_mult;
+
+    __asm__ volatile("" : : : "memory");
+    clock_page->seq++;
+}
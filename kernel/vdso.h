@@ -0,0 +1,95 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+
+/* Shared Clock Page (vDSO-style)
+ * One physical page holding the current time, mapped read-only and
+ * user-accessible at VDSO_CLOCK_ADDR. It lives in the kernel's first
+ * PML4 entry, which every address space shares, so any task can read
+ * the time with plain loads instead of a system call.
+ *
+ * The timer IRQ is the only writer and publishes updates with a
+ * sequence counter (seqlock): odd while an update is in progress.
+ * Readers retry until they see the same even value before and after.
+ */
+
+#define VDSO_CLOCK_ADDR  0x3FFFF000ULL   /* Read-only, ring 3 visible */
+#define VDSO_KERNEL_ADDR 0x3FFFE000ULL   /* Writable kernel alias */
+
+/* Page layout */
+typedef struct {
+    volatile uint32_t seq;        /* Sequence counter (odd = updating) */
+    volatile uint32_t tick_hz;    /* Timer tick frequency */
+    volatile uint64_t ticks;      /* Timer ticks since boot */
+    volatile uint64_t tsc_base;   /* TSC value at the last tick */
+    volatile uint64_t ns_base;    /* Nanoseconds since boot at the last tick */
+    volatile uint64_t tsc_mult;   /* ns = (tsc_delta * mult) >> shift (0 = not calibrated) */
+    volatile uint32_t tsc_shift;
+} vdso_clock_t;
+
+/* Kernel side */
+
+/* Map the clock page (before timer_init) */
+void vdso_init(void);
+
+/* Publish a new tick (called from timer_handler) */
+void vdso_update(uint64_t ticks);
+
+/* Reader library - usable from any ring, never enters the kernel */
+
+#define VDSO_CLOCK ((const vdso_clock_t*)VDSO_CLOCK_ADDR)
+
+static inline uint64_t vdso_rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Wait for a stable (even) sequence number */
+static inline uint32_t vdso_read_begin(const vdso_clock_t* clk) {
+    uint32_t seq;
+    while ((seq = clk->seq) & 1) {
+        __asm__ volatile("pause");
+    }
+    __asm__ volatile("" : : : "memory");
+    return seq;
+}
+
+/* Returns nonzero if the snapshot was torn and must be retried */
+static inline int vdso_read_retry(const vdso_clock_t* clk, uint32_t seq) {
+    __asm__ volatile("" : : : "memory");
+    return clk->seq != seq;
+}
+
+/* Timer ticks since boot */
+static inline uint64_t vdso_clock_ticks(void) {
+    return VDSO_CLOCK->ticks;
+}
+
+/* Nanoseconds since boot (TSC-interpolated between ticks) */
+static inline uint64_t vdso_clock_ns(void) {
+    const vdso_clock_t* clk = VDSO_CLOCK;
+    uint32_t seq;
+    uint64_t ns;
+
+    do {
+        seq = vdso_read_begin(clk);
+        ns = clk->ns_base;
+        if (clk->tsc_mult) {
+            uint64_t delta = vdso_rdtsc() - clk->tsc_base;
+            ns += (uint64_t)(((unsigned __int128)delta * clk->tsc_mult) >> clk->tsc_shift);
+        }
+    } while (vdso_read_retry(clk, seq));
+
+    return ns;
+}
+
+/* clock_gettime-style split into seconds and nanoseconds */
+static inline void vdso_clock_gettime(uint64_t* sec, uint64_t* nsec) {
+    uint64_t ns = vdso_clock_ns();
+    *sec = ns / 1000000000ULL;
+    *nsec = ns % 1000000000ULL;
+}
+
+#endif
@@ -1,11 +1,63 @@
 #include "vga.h"
+#include "irqtrace.h"
+#include "font8x16.h"
+#include "multiboot.h"
+#include "initcall.h"
 
 /* VGA text buffer address */
-static volatile uint16_t* const VGA_BUFFER = (uint16_t*)0xB8000;
+static volatile uint64_t* const VGA_BUFFER = (uint64_t*)0xB8000;
 
-/* Current cursor position */
+/* Cells per 64-bit store */
+#define CELLS_PER_WORD 4
+#define ROW_WORDS      (VGA_WIDTH / CELLS_PER_WORD)
+#define SCREEN_WORDS   (ROW_WORDS * VGA_HEIGHT)
+
+/* The 32KB text window holds this many rows; scrolling moves the CRTC
+ * display origin down it and only copies when it runs out */
+#define WINDOW_ROWS    (0x8000 / (VGA_WIDTH * 2))
+
+/* CRTC registers */
+#define CRTC_INDEX        0x3D4
+#define CRTC_DATA         0x3D5
+#define CRTC_START_HIGH   0x0C
+#define CRTC_START_LOW    0x0D
+#define CRTC_CURSOR_HIGH  0x0E
+#define CRTC_CURSOR_LOW   0x0F
+
+/* Off-screen frame all vga_* calls draw into, and a copy of what video
+ * memory currently holds so a flush only writes cells that changed */
+static uint16_t back[VGA_WIDTH * VGA_HEIGHT] __attribute__((aligned(8)));
+static uint16_t front[VGA_WIDTH * VGA_HEIGHT] __attribute__((aligned(8)));
+
+/* Rows touched since the last flush (bit y) */
+static volatile uint32_t dirty_rows = 0;
+
+/* Window row shown at the top of the screen: wanted by the next flush,
+ * and currently programmed into the CRTC */
+static uint32_t origin = 0;
+static uint32_t shown_origin = 0;
+
+/* Current cursor position, and the cell last given to the CRTC */
 static uint8_t cursor_x = 0;
 static uint8_t cursor_y = 0;
+static uint32_t shown_cursor = 0xFFFFFFFF;
+
+/* Drawing through gfx instead of text memory, and the pixel position of
+ * the grid, centered on the screen. There is no text cursor in this mode. */
+static int gfx_console = 0;
+static int grid_x = 0;
+static int grid_y = 0;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static void crtc_write16(uint8_t high_reg, uint16_t value) {
+    outb(CRTC_INDEX, high_reg);
+    outb(CRTC_DATA, (uint8_t)(value >> 8));
+    outb(CRTC_INDEX, high_reg + 1);
+    outb(CRTC_DATA, (uint8_t)(value & 0xFF));
+}
 
 /* Helper: create VGA entry (character + color) */
 static inline uint16_t vga_entry(char c, uint8_t color) {
@@ -17,36 +69,97 @@ static inline uint16_t vga_index(uint8_t x, uint8_t y) {
     return y * VGA_WIDTH + x;
 }
 
+/* Helper: note a changed row (after the cells are written, so a flush
+ * from an interrupt can never clear the mark but miss the cells) */
+static inline void mark_dirty(uint32_t rows) {
+    __atomic_fetch_or(&dirty_rows, rows, __ATOMIC_RELEASE);
+}
+
 /* Initialize VGA driver */
 void vga_init(void) {
     cursor_x = 0;
     cursor_y = 0;
+    
+    /* Video memory holds whatever the bootloader left: force a full write */
+    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
+        front[i] = 0;
+    }
+    origin = 0;
+    shown_origin = 0;
+    crtc_write16(CRTC_START_HIGH, 0);
     vga_clear();
+    vga_flush();
 }
 
 /* Clear the entire screen */
 void vga_clear(void) {
-    for (int i = 0; i < 2000; i++) {
-        VGA_BUFFER[i] = vga_entry(' ', VGA_COLOR_LIGHT_GRAY);
+    uint16_t blank = vga_entry(' ', VGA_COLOR_LIGHT_GRAY);
+    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
+        back[i] = blank;
     }
+    mark_dirty((1u << VGA_HEIGHT) - 1);
+    
     cursor_x = 0;
     cursor_y = 0;
 }
 
 /* Scroll screen up by one line */
 static void vga_scroll(void) {
-    /* Move all lines up by one */
-    for (uint8_t y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (uint8_t x = 0; x < VGA_WIDTH; x++) {
-            VGA_BUFFER[vga_index(x, y)] = VGA_BUFFER[vga_index(x, y + 1)];
-        }
+    uint64_t* back_words = (uint64_t*)back;
+    uint64_t* front_words = (uint64_t*)front;
+    uint64_t blank = 0x0720072007200720ULL;  /* Four light gray spaces */
+    
+    /* The rows, their dirty marks, the origin and the shadow must all
+     * move together under a flush */
+    uint64_t flags = irq_save();
+    
+    /* Move all lines up by one, four cells at a time */
+    for (int i = 0; i < SCREEN_WORDS - ROW_WORDS; i++) {
+        back_words[i] = back_words[i + ROW_WORDS];
     }
     
     /* Clear the last line */
-    for (uint8_t x = 0; x < VGA_WIDTH; x++) {
-        VGA_BUFFER[vga_index(x, VGA_HEIGHT - 1)] = vga_entry(' ', VGA_COLOR_LIGHT_GRAY);
+    for (int i = SCREEN_WORDS - ROW_WORDS; i < SCREEN_WORDS; i++) {
+        back_words[i] = blank;
+    }
+    
+    /* Rows not flushed yet keep their mark as they move up; the new
+     * bottom row is blank in back but unknown on screen */
+    uint32_t moved = (dirty_rows >> 1) | (1u << (VGA_HEIGHT - 1));
+    
+    if (gfx_console) {
+        /* Move the rendered rows up in the back buffer instead */
+        gfx_copy_rect(grid_x, grid_y, grid_x, grid_y + FONT_HEIGHT,
+                      VGA_WIDTH * FONT_WIDTH, (VGA_HEIGHT - 1) * FONT_HEIGHT);
+        for (int i = 0; i < SCREEN_WORDS - ROW_WORDS; i++) {
+            front_words[i] = front_words[i + ROW_WORDS];
+        }
+        for (int i = SCREEN_WORDS - ROW_WORDS; i < SCREEN_WORDS; i++) {
+            front_words[i] = 0;
+        }
+        dirty_rows = moved;
+    } else if (origin + VGA_HEIGHT < WINDOW_ROWS) {
+        /* Slide the display origin: video memory already holds every row
+         * but the new bottom one, whose old contents are unknown */
+        origin++;
+        for (int i = 0; i < SCREEN_WORDS - ROW_WORDS; i++) {
+            front_words[i] = front_words[i + ROW_WORDS];
+        }
+        for (int i = SCREEN_WORDS - ROW_WORDS; i < SCREEN_WORDS; i++) {
+            front_words[i] = 0;
+        }
+        dirty_rows = moved;
+    } else {
+        /* Window exhausted: wrap to the top and rewrite the whole screen */
+        origin = 0;
+        for (int i = 0; i < SCREEN_WORDS; i++) {
+            front_words[i] = 0;
+        }
+        mark_dirty((1u << VGA_HEIGHT) - 1);
     }
     
+    irq_restore(flags);
+    
     cursor_y = VGA_HEIGHT - 1;
 }
 
@@ -72,8 +185,9 @@ void vga_putchar(char c, uint8_t color) {
         return;
     }
     
-    /* Write character to buffer */
-    VGA_BUFFER[vga_index(cursor_x, cursor_y)] = vga_entry(c, color);
+    /* Write character to the back buffer */
+    back[vga_index(cursor_x, cursor_y)] = vga_entry(c, color);
+    mark_dirty(1u << cursor_y);
     
     /* Advance cursor */
     cursor_x++;
@@ -90,6 +204,33 @@ void vga_print(const char* str, uint8_t color) {
     }
 }
 
+/* Print a run of text, filling each row in one pass */
+void vga_write(const char* text, size_t len, uint8_t color) {
+    size_t i = 0;
+    while (i < len) {
+        char c = text[i];
+        if (c == '\n' || c == '\r') {
+            vga_putchar(c, color);
+            i++;
+            continue;
+        }
+        
+        /* Copy up to the end of the row or the next control character */
+        uint16_t* cell = &back[vga_index(cursor_x, cursor_y)];
+        uint8_t x = cursor_x;
+        while (i < len && x < VGA_WIDTH && text[i] != '\n' && text[i] != '\r') {
+            *cell++ = vga_entry(text[i++], color);
+            x++;
+        }
+        mark_dirty(1u << cursor_y);
+        
+        cursor_x = x;
+        if (cursor_x >= VGA_WIDTH) {
+            vga_newline();
+        }
+    }
+}
+
 /* Print a string and move to next line */
 void vga_println(const char* str, uint8_t color) {
     vga_print(str, color);
@@ -103,3 +244,127 @@ void vga_set_cursor(uint8_t x, uint8_t y) {
         cursor_y = y;
     }
 }
+
+/* Render a cell as a glyph in its text attribute's palette colors */
+static void draw_cell(int x, int y, uint16_t cell) {
+    gfx_draw_glyph(grid_x + x * FONT_WIDTH, grid_y + y * FONT_HEIGHT, (char)(cell & 0xFF),
+                   gfx_vga_color((cell >> 8) & 0xF), gfx_vga_color(cell >> 12));
+}
+
+/* Graphics version of vga_flush(): draw the changed cells, then present */
+static void flush_gfx(uint32_t rows) {
+    while (rows) {
+        int y = __builtin_ctz(rows);
+        rows &= rows - 1;
+        
+        const uint64_t* src = (const uint64_t*)&back[y * VGA_WIDTH];
+        uint64_t* shadow = (uint64_t*)&front[y * VGA_WIDTH];
+        for (int w = 0; w < ROW_WORDS; w++) {
+            if (src[w] == shadow[w]) continue;
+            
+            for (int i = 0; i < CELLS_PER_WORD; i++) {
+                int x = w * CELLS_PER_WORD + i;
+                if (back[y * VGA_WIDTH + x] != front[y * VGA_WIDTH + x]) {
+                    draw_cell(x, y, back[y * VGA_WIDTH + x]);
+                }
+            }
+            shadow[w] = src[w];
+        }
+    }
+    gfx_present();
+}
+
+/* Copy changed cells of dirty rows to video memory */
+void vga_flush(void) {
+    /* Keep a flush from an interrupt from racing this one */
+    uint64_t flags = irq_save();
+    
+    uint32_t rows = __atomic_exchange_n(&dirty_rows, 0, __ATOMIC_ACQUIRE);
+    if (gfx_console) {
+        flush_gfx(rows);
+        irq_restore(flags);
+        return;
+    }
+    
+    while (rows) {
+        int y = __builtin_ctz(rows);
+        rows &= rows - 1;
+        
+        const uint64_t* src = (const uint64_t*)&back[y * VGA_WIDTH];
+        uint64_t* shadow = (uint64_t*)&front[y * VGA_WIDTH];
+        volatile uint64_t* dst = VGA_BUFFER + (origin + y) * ROW_WORDS;
+        
+        /* Four cells per store, skipping words video memory already has */
+        for (int w = 0; w < ROW_WORDS; w++) {
+            uint64_t cells = src[w];
+            if (cells != shadow[w]) {
+                shadow[w] = cells;
+                dst[w] = cells;
+            }
+        }
+    }
+    
+    /* Show the new rows, then move the cursor, once per flush */
+    if (origin != shown_origin) {
+        crtc_write16(CRTC_START_HIGH, (uint16_t)(origin * VGA_WIDTH));
+        shown_origin = origin;
+    }
+    
+    uint32_t cursor = (origin + cursor_y) * VGA_WIDTH + cursor_x;
+    if (cursor != shown_cursor) {
+        crtc_write16(CRTC_CURSOR_HIGH, (uint16_t)cursor);
+        shown_cursor = cursor;
+    }
+    
+    irq_restore(flags);
+}
+
+/* Switch rendering to the graphics backend */
+void vga_use_gfx(void) {
+    uint64_t flags = irq_save();
+    
+    gfx_console = 1;
+    grid_x = (gfx_width() - VGA_WIDTH * FONT_WIDTH) / 2;
+    grid_y = (gfx_height() - VGA_HEIGHT * FONT_HEIGHT) / 2;
+    if (grid_x < 0) grid_x = 0;
+    if (grid_y < 0) grid_y = 0;
+    
+    /* Nothing is drawn yet: render every cell */
+    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
+        front[i] = 0;
+    }
+    mark_dirty((1u << VGA_HEIGHT) - 1);
+    
+    irq_restore(flags);
+    vga_flush();
+}
+
+/* Boot setup: move the console to the framebuffer if GRUB set one up */
+static void vga_setup_gfx(void) {
+    if (gfx_init(multiboot_framebuffer())) {
+        vga_use_gfx();
+    }
+}
+INITCALL(INIT_PLATFORM, vga_setup_gfx);
+
+/* Forget what the screen holds for a block of cells */
+void vga_invalidate(uint8_t x, uint8_t y, uint8_t w, uint8_t h) {
+    uint64_t flags = irq_save();
+    for (uint8_t row = y; row < y + h && row < VGA_HEIGHT; row++) {
+        for (uint8_t col = x; col < x + w && col < VGA_WIDTH; col++) {
+            front[vga_index(col, row)] = 0;
+        }
+    }
+    irq_restore(flags);
+}
+
+int vga_cell_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, gfx_rect_t* out) {
+    if (!gfx_console) {
+        return 0;
+    }
+    out->x = grid_x + x * FONT_WIDTH;
+    out->y = grid_y + y * FONT_HEIGHT;
+    out->w = w * FONT_WIDTH;
+    out->h = h * FONT_HEIGHT;
+    return 1;
+}
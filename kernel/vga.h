@@ -2,6 +2,9 @@
 #define VGA_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "gfx.h"
 
 /* VGA color codes */
 #define VGA_COLOR_BLACK         0x0
@@ -25,6 +28,9 @@
 #define VGA_WIDTH  80
 #define VGA_HEIGHT 25
 
+/* All calls draw into an off-screen buffer; vga_flush() copies the cells
+ * that changed since the last flush to video memory. */
+
 /* Initialize VGA driver */
 void vga_init(void);
 
@@ -40,7 +46,24 @@ void vga_print(const char* str, uint8_t color);
 /* Print a string and move to next line */
 void vga_println(const char* str, uint8_t color);
 
+/* Print len bytes of text (no terminator needed) */
+void vga_write(const char* text, size_t len, uint8_t color);
+
 /* Set cursor position */
 void vga_set_cursor(uint8_t x, uint8_t y);
 
+/* Write pending changes to the screen */
+void vga_flush(void);
+
+/* Draw the text grid through the graphics backend from now on
+ * (call once gfx_init() has succeeded) */
+void vga_use_gfx(void);
+
+/* Forget what the screen shows for a block of cells (e.g. after drawing
+ * over them with gfx): the next flush of their rows redraws them */
+void vga_invalidate(uint8_t x, uint8_t y, uint8_t w, uint8_t h);
+
+/* Pixel rectangle covered by a block of cells (returns 0 in text mode) */
+int vga_cell_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, gfx_rect_t* out);
+
 #endif
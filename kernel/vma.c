@@ -0,0 +1,643 @@
+#include "vma.h"
+#include "paging.h"
+#include "pmm.h"
+#include "heap.h"
+#include "process.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+/* Page fault error code bits */
+#define PF_PRESENT (1ULL << 0)
+#define PF_WRITE   (1ULL << 1)
+
+#define PAGE_MASK  (~((uint64_t)PAGE_SIZE - 1))
+#define LARGE_PAGE_SIZE 0x200000ULL
+
+/* ---- AVL tree with max-gap augmentation ---- */
+
+static inline int node_height(vma_t* n) {
+    return n ? n->height : 0;
+}
+
+static inline uint64_t node_max_gap(vma_t* n) {
+    return n ? n->max_gap : 0;
+}
+
+/* Recompute height and max_gap from the children */
+static void node_update(vma_t* n) {
+    int hl = node_height(n->left);
+    int hr = node_height(n->right);
+    n->height = 1 + (hl > hr ? hl : hr);
+
+    uint64_t gap = n->gap;
+    if (node_max_gap(n->left) > gap) gap = node_max_gap(n->left);
+    if (node_max_gap(n->right) > gap) gap = node_max_gap(n->right);
+    n->max_gap = gap;
+}
+
+static vma_t* rotate_right(vma_t* y) {
+    vma_t* x = y->left;
+    y->left = x->right;
+    x->right = y;
+    node_update(y);
+    node_update(x);
+    return x;
+}
+
+static vma_t* rotate_left(vma_t* x) {
+    vma_t* y = x->right;
+    x->right = y->left;
+    y->left = x;
+    node_update(x);
+    node_update(y);
+    return y;
+}
+
+static vma_t* rebalance(vma_t* n) {
+    node_update(n);
+    int balance = node_height(n->left) - node_height(n->right);
+
+    if (balance > 1) {
+        if (node_height(n->left->left) < node_height(n->left->right)) {
+            n->left = rotate_left(n->left);
+        }
+        return rotate_right(n);
+    }
+    if (balance < -1) {
+        if (node_height(n->right->right) < node_height(n->right->left)) {
+            n->right = rotate_right(n->right);
+        }
+        return rotate_left(n);
+    }
+    return n;
+}
+
+static vma_t* tree_insert(vma_t* root, vma_t* node) {
+    if (!root) {
+        node->left = NULL;
+        node->right = NULL;
+        node_update(node);
+        return node;
+    }
+    if (node->start < root->start) {
+        root->left = tree_insert(root->left, node);
+    } else {
+        root->right = tree_insert(root->right, node);
+    }
+    return rebalance(root);
+}
+
+static vma_t* tree_remove_min(vma_t* root, vma_t** min) {
+    if (!root->left) {
+        *min = root;
+        return root->right;
+    }
+    root->left = tree_remove_min(root->left, min);
+    return rebalance(root);
+}
+
+static vma_t* tree_remove(vma_t* root, vma_t* node) {
+    if (!root) {
+        return NULL;
+    }
+    if (node->start < root->start) {
+        root->left = tree_remove(root->left, node);
+    } else if (node->start > root->start) {
+        root->right = tree_remove(root->right, node);
+    } else {
+        if (!root->left) return root->right;
+        if (!root->right) return root->left;
+
+        /* Replace with the in-order successor */
+        vma_t* successor;
+        vma_t* right = tree_remove_min(root->right, &successor);
+        successor->left = root->left;
+        successor->right = right;
+        return rebalance(successor);
+    }
+    return rebalance(root);
+}
+
+/* Recompute augmentation along the path to key (after a gap changed) */
+static void tree_refresh(vma_t* root, uint64_t key) {
+    if (!root) {
+        return;
+    }
+    if (key < root->start) {
+        tree_refresh(root->left, key);
+    } else if (key > root->start) {
+        tree_refresh(root->right, key);
+    }
+    node_update(root);
+}
+
+/* Last region starting before addr */
+static vma_t* vma_prev(vma_t* root, uint64_t addr) {
+    vma_t* found = NULL;
+    while (root) {
+        if (root->start < addr) {
+            found = root;
+            root = root->right;
+        } else {
+            root = root->left;
+        }
+    }
+    return found;
+}
+
+/* First region ending after addr (the one containing addr, or the next) */
+static vma_t* vma_first_after(vma_t* root, uint64_t addr) {
+    vma_t* found = NULL;
+    while (root) {
+        if (root->end > addr) {
+            found = root;
+            root = root->left;
+        } else {
+            root = root->right;
+        }
+    }
+    return found;
+}
+
+/* Recompute the gap in front of a region */
+static void fix_gap(vm_space_t* space, vma_t* node) {
+    vma_t* prev = vma_prev(space->vma_root, node->start);
+    node->gap = node->start - (prev ? prev->end : USER_SPACE_START);
+    tree_refresh(space->vma_root, node->start);
+}
+
+static void vma_insert(vm_space_t* space, vma_t* node) {
+    vma_t* prev = vma_prev(space->vma_root, node->start);
+    node->gap = node->start - (prev ? prev->end : USER_SPACE_START);
+    space->vma_root = tree_insert(space->vma_root, node);
+
+    vma_t* next = vma_first_after(space->vma_root, node->end);
+    if (next) {
+        fix_gap(space, next);
+    }
+}
+
+static void vma_remove(vm_space_t* space, vma_t* node) {
+    vma_t* next = vma_first_after(space->vma_root, node->end);
+    space->vma_root = tree_remove(space->vma_root, node);
+    if (next) {
+        fix_gap(space, next);
+    }
+}
+
+/* Lowest free range of at least len bytes (0 if none inside the tree) */
+static uint64_t find_gap(vma_t* node, uint64_t len) {
+    if (!node || node->max_gap < len) {
+        return 0;
+    }
+    uint64_t addr = find_gap(node->left, len);
+    if (addr) {
+        return addr;
+    }
+    if (node->gap >= len) {
+        return node->start - node->gap;
+    }
+    return find_gap(node->right, len);
+}
+
+/* ---- Region helpers ---- */
+
+static vma_t* vma_alloc(void) {
+    vma_t* vma = heap_alloc(sizeof(vma_t));
+    if (vma) {
+        vma->shm = NULL;
+        vma->shm_first = 0;
+        vma->left = NULL;
+        vma->right = NULL;
+        vma->height = 1;
+        vma->gap = 0;
+        vma->max_gap = 0;
+    }
+    return vma;
+}
+
+static void vma_free(vma_t* vma) {
+    if (vma->shm) {
+        vm_shm_release(vma->shm);
+    }
+    heap_free(vma);
+}
+
+/* Page table flags for a region's pages */
+static uint64_t vma_pte_flags(vma_t* vma) {
+    uint64_t flags = PAGE_PRESENT | PAGE_USER;
+    if (vma->prot & VM_PROT_WRITE) {
+        flags |= PAGE_WRITE;
+    }
+    if (vma->kind == VMA_SHARED) {
+        flags |= PAGE_SHARED;
+    }
+    return flags;
+}
+
+/* Drop every populated page in [start, end) */
+static void release_pages(vm_space_t* space, uint64_t start, uint64_t end) {
+    tlb_gather_t g;
+    tlb_gather_init(&g, space->pml4_phys);
+    paging_unmap_range_in(space->pml4_phys, start, end, PAGING_UNMAP_RELEASE, &g);
+    tlb_gather_flush(&g);
+}
+
+/* Apply a region's protection to its populated pages */
+static void reprotect_pages(vm_space_t* space, vma_t* vma) {
+    tlb_gather_t g;
+    tlb_gather_init(&g, space->pml4_phys);
+
+    for (uint64_t va = vma->start; va < vma->end; va += PAGE_SIZE) {
+        pte_t* pte = paging_get_pte(space->pml4_phys, va);
+        if (!pte) {
+            va = (va | (LARGE_PAGE_SIZE - 1)) + 1 - PAGE_SIZE;
+            continue;
+        }
+        if (!pte_mapped(*pte)) {
+            continue;
+        }
+
+        /* PROT_NONE keeps the frame but takes the page out of the MMU */
+        pte_t value = *pte & ~(PAGE_PRESENT | PAGE_PROTNONE | PAGE_WRITE | PAGE_COW);
+        value |= (vma->prot & VM_PROT_READ) ? PAGE_PRESENT : PAGE_PROTNONE;
+        if (vma->prot & VM_PROT_WRITE) {
+            /* Private pages still shared with a clone stay copy-on-write */
+            if (vma->kind == VMA_SHARED || pmm_page_refcount(value & PAGE_ADDR_MASK) == 1) {
+                value |= PAGE_WRITE;
+            } else {
+                value |= PAGE_COW;
+            }
+        }
+        *pte = value;
+        tlb_gather_add(&g, va);
+    }
+    tlb_gather_flush(&g);
+}
+
+/* Split a region at addr; returns the upper half */
+static vma_t* vma_split(vm_space_t* space, vma_t* vma, uint64_t addr) {
+    vma_t* upper = vma_alloc();
+    if (!upper) {
+        panic("VMA: Out of memory while splitting");
+    }
+
+    upper->start = addr;
+    upper->end = vma->end;
+    upper->prot = vma->prot;
+    upper->kind = vma->kind;
+    upper->shm = vma->shm;
+    if (upper->shm) {
+        upper->shm->refcount++;
+        upper->shm_first = vma->shm_first + (addr - vma->start) / PAGE_SIZE;
+    }
+
+    /* The lower half keeps its gap; the upper half starts right after it */
+    vma->end = addr;
+    tree_refresh(space->vma_root, vma->start);
+    vma_insert(space, upper);
+    return upper;
+}
+
+/* Split regions so that addr is a region boundary */
+static void split_at(vm_space_t* space, uint64_t addr) {
+    vma_t* vma = vma_find(space, addr);
+    if (vma && vma->start < addr) {
+        vma_split(space, vma, addr);
+    }
+}
+
+/* Validate and page-align a user range */
+static int range_valid(uint64_t addr, uint64_t len) {
+    return len && !(addr & ~PAGE_MASK) && addr >= USER_SPACE_START &&
+           len <= USER_SPACE_END - addr;
+}
+
+static uint64_t map_region(vm_space_t* space, uint64_t addr, uint64_t len, uint64_t prot,
+                           uint32_t flags, uint32_t kind, vm_shm_t* shm) {
+    uint64_t size = (len + PAGE_SIZE - 1) & PAGE_MASK;
+    if (size == 0 || size < len) {
+        return 0;  /* Empty, or the rounding wrapped */
+    }
+    len = size;
+
+    if (flags & VM_MAP_FIXED) {
+        if (!range_valid(addr, len)) {
+            return 0;
+        }
+        vma_t* next = vma_first_after(space->vma_root, addr);
+        if (next && next->start < addr + len) {
+            return 0;  /* Overlaps an existing region */
+        }
+    } else {
+        addr = find_gap(space->vma_root, len);
+        if (!addr) {
+            /* Try the free space after the last region */
+            vma_t* last = space->vma_root;
+            while (last && last->right) {
+                last = last->right;
+            }
+            uint64_t tail = last ? last->end : USER_SPACE_START;
+            if (len > USER_SPACE_END - tail) {
+                return 0;
+            }
+            addr = tail;
+        }
+    }
+
+    vma_t* vma = vma_alloc();
+    if (!vma) {
+        return 0;
+    }
+    vma->start = addr;
+    vma->end = addr + len;
+    vma->prot = prot;
+    vma->kind = kind;
+    vma->shm = shm;
+    if (shm) {
+        shm->refcount++;
+    }
+
+    vma_insert(space, vma);
+    return addr;
+}
+
+/* ---- Public API ---- */
+
+uint64_t vm_map_anon(vm_space_t* space, uint64_t addr, uint64_t len, uint64_t prot, uint32_t flags) {
+    if (len == 0) {
+        return 0;
+    }
+    return map_region(space, addr, len, prot, flags, VMA_ANON, NULL);
+}
+
+uint64_t vm_map_shared(vm_space_t* space, vm_shm_t* shm, uint64_t addr, uint64_t prot, uint32_t flags) {
+    return map_region(space, addr, shm->pages * PAGE_SIZE, prot, flags, VMA_SHARED, shm);
+}
+
+void vm_unmap(vm_space_t* space, uint64_t addr, uint64_t len) {
+    len = (len + PAGE_SIZE - 1) & PAGE_MASK;
+    if (!range_valid(addr, len)) {
+        return;
+    }
+    uint64_t end = addr + len;
+
+    split_at(space, addr);
+    split_at(space, end);
+
+    vma_t* vma;
+    while ((vma = vma_first_after(space->vma_root, addr)) && vma->start < end) {
+        release_pages(space, vma->start, vma->end);
+        vma_remove(space, vma);
+        vma_free(vma);
+    }
+}
+
+int vm_protect(vm_space_t* space, uint64_t addr, uint64_t len, uint64_t prot) {
+    len = (len + PAGE_SIZE - 1) & PAGE_MASK;
+    if (!range_valid(addr, len) || !vm_range_ok(space, addr, len, 0)) {
+        return 0;
+    }
+    uint64_t end = addr + len;
+
+    split_at(space, addr);
+    split_at(space, end);
+
+    for (uint64_t va = addr; va < end; ) {
+        vma_t* vma = vma_find(space, va);
+        vma->prot = prot;
+        reprotect_pages(space, vma);
+        va = vma->end;
+    }
+    return 1;
+}
+
+int vm_detach_pages(vm_space_t* space, uint64_t addr, uint64_t pages, uint64_t* frames) {
+    uint64_t len = pages * PAGE_SIZE;
+    if (!range_valid(addr, len)) {
+        return 0;
+    }
+    uint64_t end = addr + len;
+
+    for (uint64_t va = addr; va < end; ) {
+        vma_t* vma = vma_find(space, va);
+        if (!vma || vma->kind != VMA_ANON) {
+            return 0;
+        }
+        va = vma->end;
+    }
+
+    tlb_gather_t g;
+    tlb_gather_init(&g, space->pml4_phys);
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t va = addr + i * PAGE_SIZE;
+        pte_t pte = paging_take_page_in(space->pml4_phys, va);
+
+        if (pte_mapped(pte)) {
+            frames[i] = pte & PAGE_ADDR_MASK;
+            tlb_gather_add(&g, va);
+        } else {
+            /* Never touched: hand over a zero page */
+            frames[i] = pmm_alloc_page();
+            uint64_t* words = (uint64_t*)frames[i];
+            for (int w = 0; w < PAGE_SIZE / 8; w++) {
+                words[w] = 0;
+            }
+        }
+    }
+
+    tlb_gather_flush(&g);
+
+    /* Only the (now empty) regions are left to remove */
+    vm_unmap(space, addr, len);
+    return 1;
+}
+
+uint64_t vm_attach_pages(vm_space_t* space, uint64_t addr, const uint64_t* frames, uint64_t pages,
+                         uint64_t prot, uint32_t flags) {
+    addr = vm_map_anon(space, addr, pages * PAGE_SIZE, prot, flags);
+    if (!addr) {
+        return 0;
+    }
+
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t flags = ((prot & VM_PROT_READ) ? PAGE_PRESENT : PAGE_PROTNONE) | PAGE_USER;
+        if (prot & VM_PROT_WRITE) {
+            /* A frame still shared with a clone of the sender stays COW */
+            flags |= pmm_page_refcount(frames[i]) == 1 ? PAGE_WRITE : PAGE_COW;
+        }
+        vm_space_map(space, addr + i * PAGE_SIZE, frames[i], flags);
+    }
+    return addr;
+}
+
+vma_t* vma_find(vm_space_t* space, uint64_t addr) {
+    vma_t* node = space->vma_root;
+    while (node) {
+        if (addr < node->start) {
+            node = node->left;
+        } else if (addr >= node->end) {
+            node = node->right;
+        } else {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+int vm_range_ok(vm_space_t* space, uint64_t addr, uint64_t len, uint64_t prot) {
+    if (addr < USER_SPACE_START || len > USER_SPACE_END - addr) {
+        return 0;
+    }
+    /* Any access needs a readable page (see vm_handle_fault) */
+    if (prot) {
+        prot |= VM_PROT_READ;
+    }
+    uint64_t end = addr + len;
+    while (addr < end) {
+        vma_t* vma = vma_find(space, addr);
+        if (!vma || (vma->prot & prot) != prot) {
+            return 0;
+        }
+        addr = vma->end;
+    }
+    return 1;
+}
+
+int vm_handle_fault(uint64_t fault_addr, uint64_t err_code) {
+    process_t* proc = process_current();
+    if (!proc || !proc->vm || fault_addr < USER_SPACE_START || fault_addr >= USER_SPACE_END) {
+        return 0;
+    }
+    vm_space_t* space = proc->vm;
+
+    vma_t* vma = vma_find(space, fault_addr);
+    if (!vma) {
+        return 0;
+    }
+    if (!(vma->prot & VM_PROT_READ)) {
+        return 0;
+    }
+    if ((err_code & PF_WRITE) && !(vma->prot & VM_PROT_WRITE)) {
+        return 0;
+    }
+
+    /* Present page: only a copy-on-write write fault is legitimate */
+    if (err_code & PF_PRESENT) {
+        return vm_handle_cow_fault(fault_addr, err_code);
+    }
+
+    uint64_t page = fault_addr & PAGE_MASK;
+    uint64_t phys;
+
+    if (vma->kind == VMA_SHARED) {
+        uint64_t index = vma->shm_first + (page - vma->start) / PAGE_SIZE;
+        if (!vma->shm->frames[index]) {
+            uint64_t frame = pmm_alloc_page_flags(ALLOC_WAIT);
+            if (!frame) {
+                return 0;  /* Out of memory: the faulting process is killed */
+            }
+            uint64_t* words = (uint64_t*)frame;
+            for (int i = 0; i < PAGE_SIZE / 8; i++) {
+                words[i] = 0;
+            }
+            vma->shm->frames[index] = frame;  /* Object's own reference */
+        }
+        phys = vma->shm->frames[index];
+        pmm_page_ref(phys);
+    } else {
+        phys = pmm_alloc_page_flags(ALLOC_WAIT);
+        if (!phys) {
+            return 0;
+        }
+        uint64_t* words = (uint64_t*)phys;
+        for (int i = 0; i < PAGE_SIZE / 8; i++) {
+            words[i] = 0;
+        }
+    }
+
+    vm_space_map(space, page, phys, vma_pte_flags(vma));
+    return 1;
+}
+
+vm_shm_t* vm_shm_create(uint64_t len) {
+    uint64_t pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages == 0) {
+        return NULL;
+    }
+
+    vm_shm_t* shm = heap_alloc(sizeof(vm_shm_t));
+    if (!shm) {
+        return NULL;
+    }
+    shm->frames = heap_alloc(pages * sizeof(uint64_t));
+    if (!shm->frames) {
+        heap_free(shm);
+        return NULL;
+    }
+    for (uint64_t i = 0; i < pages; i++) {
+        shm->frames[i] = 0;
+    }
+    shm->pages = pages;
+    shm->refcount = 1;
+    return shm;
+}
+
+void vm_shm_release(vm_shm_t* shm) {
+    if (--shm->refcount > 0) {
+        return;
+    }
+    for (uint64_t i = 0; i < shm->pages; i++) {
+        if (shm->frames[i]) {
+            pmm_page_unref(shm->frames[i]);
+        }
+    }
+    heap_free(shm->frames);
+    heap_free(shm);
+}
+
+/* In-order copy of a subtree into dst */
+static int clone_subtree(vm_space_t* dst, vma_t* node) {
+    if (!node) {
+        return 1;
+    }
+    if (!clone_subtree(dst, node->left)) {
+        return 0;
+    }
+
+    vma_t* copy = vma_alloc();
+    if (!copy) {
+        return 0;
+    }
+    copy->start = node->start;
+    copy->end = node->end;
+    copy->prot = node->prot;
+    copy->kind = node->kind;
+    copy->shm = node->shm;
+    copy->shm_first = node->shm_first;
+    if (copy->shm) {
+        copy->shm->refcount++;
+    }
+    vma_insert(dst, copy);
+
+    return clone_subtree(dst, node->right);
+}
+
+int vma_clone_all(vm_space_t* dst, vm_space_t* src) {
+    return clone_subtree(dst, src->vma_root);
+}
+
+static void destroy_subtree(vma_t* node) {
+    if (!node) {
+        return;
+    }
+    destroy_subtree(node->left);
+    destroy_subtree(node->right);
+    vma_free(node);
+}
+
+void vma_destroy_all(vm_space_t* space) {
+    destroy_subtree(space->vma_root);
+    space->vma_root = NULL;
+}
@@ -0,0 +1,95 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include <stdint.h>
+#include "vmspace.h"
+
+/* Virtual Memory Areas
+ * Each address space keeps its user mappings as non-overlapping regions
+ * in an AVL tree ordered by start address. Every node is augmented with
+ * the largest free gap in its subtree, so both fault lookup and free-range
+ * search are O(log n). Regions are populated lazily on page fault.
+ */
+
+/* Protection bits (write or exec without read is treated as no access) */
+#define VM_PROT_NONE  0x0
+#define VM_PROT_READ  0x1
+#define VM_PROT_WRITE 0x2
+#define VM_PROT_EXEC  0x4
+
+/* Mapping flags */
+#define VM_MAP_FIXED  0x1   /* Map exactly at addr (fail if occupied) */
+
+/* Region kinds */
+#define VMA_ANON      0x1   /* Private zero-filled memory (COW on clone) */
+#define VMA_SHARED    0x2   /* Backed by a shared memory object */
+
+/* Shared memory object: pages are visible to every space mapping it */
+typedef struct vm_shm {
+    uint64_t pages;         /* Size in pages */
+    uint64_t* frames;       /* Physical page per index (0 = not populated yet) */
+    uint32_t refcount;      /* Creator handle + one per mapping */
+} vm_shm_t;
+
+/* Virtual memory area */
+typedef struct vma {
+    uint64_t start;         /* First byte (page aligned) */
+    uint64_t end;           /* One past the last byte (page aligned) */
+    uint64_t prot;          /* VM_PROT_* */
+    uint32_t kind;          /* VMA_ANON or VMA_SHARED */
+    vm_shm_t* shm;          /* Backing object (shared regions) */
+    uint64_t shm_first;     /* First object page mapped by this region */
+
+    /* AVL tree links and augmentation */
+    struct vma* left;
+    struct vma* right;
+    int height;
+    uint64_t gap;           /* Free space between the previous region and start */
+    uint64_t max_gap;       /* Largest gap in this subtree */
+} vma_t;
+
+/* Map anonymous memory (returns address, 0 on failure)
+ * addr is only used with VM_MAP_FIXED; otherwise the lowest free range fits */
+uint64_t vm_map_anon(vm_space_t* space, uint64_t addr, uint64_t len, uint64_t prot, uint32_t flags);
+
+/* Map a whole shared memory object (returns address, 0 on failure) */
+uint64_t vm_map_shared(vm_space_t* space, vm_shm_t* shm, uint64_t addr, uint64_t prot, uint32_t flags);
+
+/* Remove mappings in [addr, addr + len), splitting regions as needed */
+void vm_unmap(vm_space_t* space, uint64_t addr, uint64_t len);
+
+/* Change protection of [addr, addr + len) (returns 0 if not fully mapped) */
+int vm_protect(vm_space_t* space, uint64_t addr, uint64_t len, uint64_t prot);
+
+/* Move pages out of a space: their frames (with this space's reference)
+ * are stored in frames[] and the range is unmapped. Only anonymous
+ * regions can be detached (returns 0 otherwise) */
+int vm_detach_pages(vm_space_t* space, uint64_t addr, uint64_t pages, uint64_t* frames);
+
+/* Map detached frames, taking over their references (addr and flags as
+ * for vm_map_anon; returns the address, 0 on failure) */
+uint64_t vm_attach_pages(vm_space_t* space, uint64_t addr, const uint64_t* frames, uint64_t pages,
+                         uint64_t prot, uint32_t flags);
+
+/* Find the region containing addr */
+vma_t* vma_find(vm_space_t* space, uint64_t addr);
+
+/* Check [addr, addr + len) is covered by regions allowing prot */
+int vm_range_ok(vm_space_t* space, uint64_t addr, uint64_t len, uint64_t prot);
+
+/* Populate a page on fault in the current process (returns 1 if handled) */
+int vm_handle_fault(uint64_t fault_addr, uint64_t err_code);
+
+/* Create a shared memory object of len bytes */
+vm_shm_t* vm_shm_create(uint64_t len);
+
+/* Drop a reference to a shared memory object */
+void vm_shm_release(vm_shm_t* shm);
+
+/* Copy all regions of src into dst (used by vm_space_clone) */
+int vma_clone_all(vm_space_t* dst, vm_space_t* src);
+
+/* Free all regions of a space (used by vm_space_destroy) */
+void vma_destroy_all(vm_space_t* space);
+
+#endif
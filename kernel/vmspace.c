@@ -0,0 +1,247 @@
+#include "vmspace.h"
+#include "vma.h"
+#include "paging.h"
+#include "pmm.h"
+#include "heap.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+#define ENTRIES_PER_TABLE 512
+
+/* PML4 slots that belong to user space */
+#define USER_PML4_FIRST ((USER_SPACE_START >> 39) & 0x1FF)
+#define USER_PML4_LAST  ((USER_SPACE_END >> 39) & 0x1FF)
+
+/* Page fault error code bits */
+#define PF_PRESENT (1ULL << 0)
+#define PF_WRITE   (1ULL << 1)
+
+/* Flags kept on intermediate entries */
+#define TABLE_FLAGS (PAGE_PRESENT | PAGE_WRITE | PAGE_USER)
+
+static void copy_page(uint64_t dst_phys, uint64_t src_phys) {
+    uint64_t* dst = (uint64_t*)dst_phys;
+    const uint64_t* src = (const uint64_t*)src_phys;
+    for (int i = 0; i < PAGE_SIZE / 8; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/* Allocate a zeroed page table */
+static pte_t* alloc_table(void) {
+    return (pte_t*)paging_alloc_table();
+}
+
+/* Record the present entries of a table built here (for reclamation) */
+static void recount_table(pte_t* table) {
+    uint16_t live = 0;
+    for (int i = 0; i < ENTRIES_PER_TABLE; i++) {
+        if (pte_mapped(table[i])) live++;
+    }
+    paging_table_set_live((uint64_t)table, live);
+}
+
+static inline void invalidate(uint64_t vaddr) {
+    __asm__ volatile("invlpg (%0)" : : "r"(vaddr) : "memory");
+}
+
+vm_space_t* vm_space_create(void) {
+    vm_space_t* space = heap_alloc(sizeof(vm_space_t));
+    if (!space) {
+        return NULL;
+    }
+
+    pte_t* pml4 = alloc_table();
+    space->pml4_phys = (uint64_t)pml4;
+    space->vma_root = NULL;
+
+    /* Share every kernel PML4 entry */
+    pte_t* kernel_pml4 = (pte_t*)paging_kernel_root();
+    for (int i = 0; i < ENTRIES_PER_TABLE; i++) {
+        if (i < (int)USER_PML4_FIRST || i > (int)USER_PML4_LAST) {
+            pml4[i] = kernel_pml4[i];
+        }
+    }
+    recount_table(pml4);
+
+    return space;
+}
+
+/* Turn a leaf entry into a shared reference for a clone */
+static pte_t share_entry(pte_t* entry) {
+    pte_t pte = *entry;
+
+    if (!(pte & PAGE_SHARED) && (pte & (PAGE_WRITE | PAGE_COW))) {
+        pte = (pte & ~PAGE_WRITE) | PAGE_COW;
+        *entry = pte;
+    }
+
+    pmm_page_ref(pte & PAGE_ADDR_MASK);
+    return pte;
+}
+
+vm_space_t* vm_space_clone(vm_space_t* src) {
+    vm_space_t* dst = vm_space_create();
+    if (!dst) {
+        return NULL;
+    }
+
+    if (!vma_clone_all(dst, src)) {
+        vm_space_destroy(dst);
+        return NULL;
+    }
+
+    pte_t* src_pml4 = (pte_t*)src->pml4_phys;
+    pte_t* dst_pml4 = (pte_t*)dst->pml4_phys;
+
+    /* Copy the user page tables; data pages are shared copy-on-write */
+    for (uint64_t i4 = USER_PML4_FIRST; i4 <= USER_PML4_LAST; i4++) {
+        if (!(src_pml4[i4] & PAGE_PRESENT)) continue;
+        pte_t* src_pdpt = (pte_t*)(src_pml4[i4] & PAGE_ADDR_MASK);
+        pte_t* dst_pdpt = alloc_table();
+        dst_pml4[i4] = (uint64_t)dst_pdpt | TABLE_FLAGS;
+
+        for (int i3 = 0; i3 < ENTRIES_PER_TABLE; i3++) {
+            if (!(src_pdpt[i3] & PAGE_PRESENT)) continue;
+            pte_t* src_pd = (pte_t*)(src_pdpt[i3] & PAGE_ADDR_MASK);
+            pte_t* dst_pd = alloc_table();
+            dst_pdpt[i3] = (uint64_t)dst_pd | TABLE_FLAGS;
+
+            for (int i2 = 0; i2 < ENTRIES_PER_TABLE; i2++) {
+                if (!(src_pd[i2] & PAGE_PRESENT)) continue;
+                pte_t* src_pt = (pte_t*)(src_pd[i2] & PAGE_ADDR_MASK);
+                pte_t* dst_pt = alloc_table();
+                dst_pd[i2] = (uint64_t)dst_pt | TABLE_FLAGS;
+
+                for (int i1 = 0; i1 < ENTRIES_PER_TABLE; i1++) {
+                    if (pte_mapped(src_pt[i1])) {
+                        dst_pt[i1] = share_entry(&src_pt[i1]);
+                    }
+                }
+                recount_table(dst_pt);
+            }
+            recount_table(dst_pd);
+        }
+        recount_table(dst_pdpt);
+    }
+    recount_table(dst_pml4);
+
+    /* The source lost its write permissions: drop stale TLB entries */
+    if (paging_current_root() == src->pml4_phys) {
+        paging_switch_root(src->pml4_phys);
+    }
+
+    return dst;
+}
+
+uint64_t vm_space_resident_pages(vm_space_t* space) {
+    pte_t* pml4 = (pte_t*)space->pml4_phys;
+    uint64_t pages = 0;
+
+    for (uint64_t i4 = USER_PML4_FIRST; i4 <= USER_PML4_LAST; i4++) {
+        if (!(pml4[i4] & PAGE_PRESENT)) continue;
+        pte_t* pdpt = (pte_t*)(pml4[i4] & PAGE_ADDR_MASK);
+
+        for (int i3 = 0; i3 < ENTRIES_PER_TABLE; i3++) {
+            if (!(pdpt[i3] & PAGE_PRESENT)) continue;
+            pte_t* pd = (pte_t*)(pdpt[i3] & PAGE_ADDR_MASK);
+
+            for (int i2 = 0; i2 < ENTRIES_PER_TABLE; i2++) {
+                if (!(pd[i2] & PAGE_PRESENT)) continue;
+                pte_t* pt = (pte_t*)(pd[i2] & PAGE_ADDR_MASK);
+
+                for (int i1 = 0; i1 < ENTRIES_PER_TABLE; i1++) {
+                    if (pte_mapped(pt[i1])) {
+                        pages++;
+                    }
+                }
+            }
+        }
+    }
+
+    return pages;
+}
+
+void vm_space_destroy(vm_space_t* space) {
+    if (paging_current_root() == space->pml4_phys) {
+        panic("vm_space_destroy: space is active");
+    }
+
+    pte_t* pml4 = (pte_t*)space->pml4_phys;
+
+    for (uint64_t i4 = USER_PML4_FIRST; i4 <= USER_PML4_LAST; i4++) {
+        if (!(pml4[i4] & PAGE_PRESENT)) continue;
+        pte_t* pdpt = (pte_t*)(pml4[i4] & PAGE_ADDR_MASK);
+
+        for (int i3 = 0; i3 < ENTRIES_PER_TABLE; i3++) {
+            if (!(pdpt[i3] & PAGE_PRESENT)) continue;
+            pte_t* pd = (pte_t*)(pdpt[i3] & PAGE_ADDR_MASK);
+
+            for (int i2 = 0; i2 < ENTRIES_PER_TABLE; i2++) {
+                if (!(pd[i2] & PAGE_PRESENT)) continue;
+                pte_t* pt = (pte_t*)(pd[i2] & PAGE_ADDR_MASK);
+
+                /* Drop our reference to every data page */
+                for (int i1 = 0; i1 < ENTRIES_PER_TABLE; i1++) {
+                    if (pte_mapped(pt[i1])) {
+                        pmm_page_unref(pt[i1] & PAGE_ADDR_MASK);
+                    }
+                }
+                paging_free_table((uint64_t)pt);
+            }
+            paging_free_table((uint64_t)pd);
+        }
+        paging_free_table((uint64_t)pdpt);
+    }
+
+    vma_destroy_all(space);
+    paging_free_table(space->pml4_phys);
+    heap_free(space);
+}
+
+void vm_space_map(vm_space_t* space, uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
+    if (virt_addr < USER_SPACE_START || virt_addr >= USER_SPACE_END) {
+        panic("vm_space_map: not a user address");
+    }
+
+    paging_map_page_in(space->pml4_phys, virt_addr, phys_addr, flags);
+
+    if (paging_current_root() == space->pml4_phys) {
+        invalidate(virt_addr);
+    }
+}
+
+int vm_handle_cow_fault(uint64_t fault_addr, uint64_t err_code) {
+    /* Only write faults on present pages can be copy-on-write */
+    if ((err_code & (PF_PRESENT | PF_WRITE)) != (PF_PRESENT | PF_WRITE)) {
+        return 0;
+    }
+    if (fault_addr < USER_SPACE_START || fault_addr >= USER_SPACE_END) {
+        return 0;
+    }
+
+    pte_t* pte = paging_get_pte(paging_current_root(), fault_addr);
+    if (!pte || !(*pte & PAGE_COW)) {
+        return 0;
+    }
+
+    uint64_t old_phys = *pte & PAGE_ADDR_MASK;
+    uint64_t flags = (*pte & ~PAGE_ADDR_MASK & ~PAGE_COW) | PAGE_WRITE;
+
+    if (pmm_page_refcount(old_phys) == 1) {
+        /* Last owner: take the page back as writable */
+        *pte = old_phys | flags;
+    } else {
+        uint64_t new_phys = pmm_alloc_page_flags(ALLOC_WAIT);
+        if (!new_phys) {
+            return 0;  /* Out of memory: the faulting process is killed */
+        }
+        copy_page(new_phys, old_phys);
+        *pte = new_phys | flags;
+        pmm_page_unref(old_phys);
+    }
+
+    invalidate(fault_addr);
+    return 1;
+}
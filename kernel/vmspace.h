@@ -0,0 +1,43 @@
+#ifndef VMSPACE_H
+#define VMSPACE_H
+
+#include <stdint.h>
+
+/* Address Spaces
+ * Each user process owns a PML4. Entries outside the user range
+ * (USER_SPACE_START..USER_SPACE_END) point at the kernel's own tables,
+ * so kernel mappings are shared by every space without copying.
+ *
+ * Cloning copies only the user page tables: writable pages become
+ * read-only + PAGE_COW in both spaces and gain a reference. The first
+ * write faults and gets a private copy (or just the write bit back if
+ * nobody else holds a reference any more). Pages of shared memory
+ * objects (PAGE_SHARED) keep their permissions in both spaces.
+ */
+
+struct vma;
+
+typedef struct vm_space {
+    uint64_t pml4_phys;         /* Root table (loaded into CR3) */
+    struct vma* vma_root;       /* Mapped regions (see vma.h) */
+} vm_space_t;
+
+/* Create an empty address space sharing the kernel mappings */
+vm_space_t* vm_space_create(void);
+
+/* Clone an address space copy-on-write */
+vm_space_t* vm_space_clone(vm_space_t* src);
+
+/* Free all user pages and page tables of a space (must not be active) */
+void vm_space_destroy(vm_space_t* space);
+
+/* Count the user pages mapped in a space */
+uint64_t vm_space_resident_pages(vm_space_t* space);
+
+/* Map a physical page into a space */
+void vm_space_map(vm_space_t* space, uint64_t virt_addr, uint64_t phys_addr, uint64_t flags);
+
+/* Resolve a copy-on-write fault in the active space (returns 1 if handled) */
+int vm_handle_cow_fault(uint64_t fault_addr, uint64_t err_code);
+
+#endif
@@ -0,0 +1,137 @@
+; First User Process (/bin/init on the ramdisk)
+; Flat, position-independent image: the kernel copies it to
+; USER_CODE_BASE and starts it at its first byte in ring 3.
+; Says hello, forks a child over a fresh mapping, checks the mapping
+; stayed copy-on-write and exits.
+
+bits 64
+
+SYS_EXIT   equ 0
+SYS_YIELD  equ 1
+SYS_GETPID equ 2
+SYS_WRITE  equ 3
+SYS_MMAP   equ 5
+SYS_MUNMAP equ 6
+SYS_FORK   equ 13
+
+PROT_RW    equ 0x3
+PAGE_SIZE  equ 4096
+YIELDS     equ 8
+
+; SYSCALL: number in RAX, arguments in RDI, RSI, RDX, R10; the result
+; comes back in RAX and RCX/R11 are clobbered
+
+start:
+    lea rdi, [rel hello]
+    mov esi, hello_len
+    mov eax, SYS_WRITE
+    syscall
+
+    ; "init: pid NN" built on the stack
+    mov eax, SYS_GETPID
+    syscall
+    sub rsp, 32
+    lea rdi, [rsp + 16]
+    mov byte [rdi], 10      ; Newline, digits go in front of it
+    mov ecx, 10
+.digit:
+    xor edx, edx
+    div rcx
+    add dl, '0'
+    dec rdi
+    mov [rdi], dl
+    test rax, rax
+    jnz .digit
+    mov rsi, rdi
+    lea rdi, [rel pid_label]
+    mov edx, pid_label_len
+    sub rsi, rdx
+    mov rcx, rdx
+.label:
+    mov al, [rdi + rcx - 1]
+    mov [rsi + rcx - 1], al
+    loop .label
+    mov rdi, rsi
+    lea rsi, [rsp + 17]
+    sub rsi, rdi
+    mov eax, SYS_WRITE
+    syscall
+    add rsp, 32
+
+    ; A page populated on first touch, then shared with a forked child
+    ; copy-on-write: the child's store must not show up on this side
+    xor edi, edi
+    mov esi, PAGE_SIZE
+    mov edx, PROT_RW
+    xor r10d, r10d
+    mov eax, SYS_MMAP
+    syscall
+    cmp rax, -1
+    je .done
+    mov rbx, rax
+    mov qword [rbx], 1
+
+    mov eax, SYS_FORK
+    syscall
+    cmp rax, -1
+    je .unmap
+    test rax, rax
+    jnz .parent
+
+    ; Child: write the shared page and leave
+    mov qword [rbx], 2
+    lea rdi, [rel child]
+    mov esi, child_len
+    mov eax, SYS_WRITE
+    syscall
+    mov eax, SYS_EXIT
+    syscall
+    jmp $
+
+.parent:
+    ; Give the child a chance to run first
+    mov r12d, YIELDS
+.again:
+    mov eax, SYS_YIELD
+    syscall
+    dec r12d
+    jnz .again
+
+    lea rdi, [rel cow_ok]
+    mov esi, cow_ok_len
+    cmp qword [rbx], 1
+    je .report
+    lea rdi, [rel cow_bad]
+    mov esi, cow_bad_len
+.report:
+    mov eax, SYS_WRITE
+    syscall
+
+.unmap:
+    mov rdi, rbx
+    mov esi, PAGE_SIZE
+    mov eax, SYS_MUNMAP
+    syscall
+
+.done:
+    lea rdi, [rel bye]
+    mov esi, bye_len
+    mov eax, SYS_WRITE
+    syscall
+
+    mov eax, SYS_EXIT
+    syscall
+    jmp $
+
+hello:      db "init: hello from ring 3", 10
+hello_len   equ $ - hello
+pid_label:  db "init: pid "
+pid_label_len equ $ - pid_label
+child:      db "init: hello from the child", 10
+child_len   equ $ - child
+cow_ok:     db "init: fork ok, page still private", 10
+cow_ok_len  equ $ - cow_ok
+cow_bad:    db "init: fork broke copy-on-write", 10
+cow_bad_len equ $ - cow_bad
+bye:        db "init: done", 10
+bye_len     equ $ - bye